@@ -403,25 +403,6 @@ _xdf_destroy(struct pyxdf *self)
 }
 
 
-static
-struct xdfch * get_xdf_channel(struct xdf * xdf, char const * name)
-{
-	int i;
-	struct xdfch * ch;
-	char * label;
-
-	i = 0;
-	while ((ch = xdf_get_channel(xdf, i)) != NULL) {
-
-		if (xdf_get_chconf(ch, XDF_CF_LABEL, &label, XDF_NOF) == 0
-		    && strcmp(label, name) == 0)
-			return ch;
-		i++;
-	}
-
-	return NULL;
-}
-
 static
 int filter_channels(struct pyxdf *self, PyObject * channels)
 {
@@ -445,7 +426,7 @@ int filter_channels(struct pyxdf *self, PyObject * channels)
 	i = 0;
 	len = PyList_Size(channels); /* prevent raising IndexError */
 	while (i < len && (pych = PyList_GetItem(channels, i)) != NULL) {
-		ch = get_xdf_channel(self->xdf, PyUnicode_AsUTF8(pych));
+		ch = xdf_find_channel(self->xdf, PyUnicode_AsUTF8(pych));
 		if (ch == NULL)
 			return -1;
 
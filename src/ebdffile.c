@@ -34,6 +34,7 @@
 #include "xdffile.h"
 #include "xdfio.h"
 #include "xdftypes.h"
+#include "xdfevent.h"
 /******************************************************
  *               EDF/BDF specific declaration             *
  ******************************************************/
@@ -49,6 +50,7 @@ static int ebdf_get_conf(const struct xdf*, enum xdffield,
 static int ebdf_write_header(struct xdf*);
 static int ebdf_read_header(struct xdf*);
 static int ebdf_complete_file(struct xdf*);
+static int ebdf_load_events(struct xdf*, unsigned int);
 
 // EDF/BDF channel structure
 struct ebdf_channel {
@@ -67,10 +69,15 @@ struct ebdf_file {
 	char subjstr[81];
 	char recstr[81];
 	time_t rectime;
+	const struct xdfch* statusch;
 };
 
 #define NUMREC_FIELD_LOC 236
 
+// Label of the channel decoded into events and bits holding the codes
+#define STATUS_LABEL	"Status"
+#define STATUS_MASK	0xFFFF
+
 #define get_ebdf(xdf_p) \
 	((struct ebdf_file*)(((char*)(xdf_p))-offsetof(struct ebdf_file, xdf)))
 #define get_ebdfch(xdfch_p) 				\
@@ -116,6 +123,7 @@ static const struct format_operations bdf_ops = {
 	.write_header = ebdf_write_header,
 	.read_header = ebdf_read_header,
 	.complete_file = ebdf_complete_file,
+	.load_events = ebdf_load_events,
 	.type = XDF_BDF,
 	.supported_type = {[XDFINT24] = true},
 	.choff = offsetof(struct ebdf_channel, xdfch),
@@ -141,6 +149,7 @@ static const struct format_operations edf_ops = {
 	.write_header = ebdf_write_header,
 	.read_header = ebdf_read_header,
 	.complete_file = ebdf_complete_file,
+	.load_events = ebdf_load_events,
 	.type = XDF_EDF,
 	.supported_type = {[XDFINT16] = true},
 	.choff = offsetof(struct ebdf_channel, xdfch),
@@ -364,13 +373,14 @@ union optval *val, int prevretval)
 
 
 /* \param ebdf	pointer to a ebdf_file opened for writing
- * \param file  stream associated to the file 
- *              (should be positioned at the beginning of the file)
+ * \param hdr   header buffer formatting the file (positioned at its
+ *              beginning)
  *
  * Write the general EDF/BDF file header. Write -1 in the number of records
  * field. The real value is written after the transfer is finished
  */
-static int ebdf_write_file_header(struct ebdf_file* ebdf, FILE* file)
+static int ebdf_write_file_header(struct ebdf_file* ebdf,
+                                  struct hdrbuff* hdr)
 {
 	char timestring[17];
  	unsigned headersize = 256 + (ebdf->xdf.numch)*256;
@@ -386,11 +396,11 @@ static int ebdf_write_file_header(struct ebdf_file* ebdf, FILE* file)
 	strftime(timestring, sizeof(timestring),"%d.%m.%y%H.%M.%S", &ltm);
 
 	// Write data format identifier
-	if (fwrite(mkey, 8, 1, file) < 1)
+	if (hwrite8bval(hdr, 8, mkey))
 		return -1;
 
 	// Write all the general file header
-	retval = fprintf(file, 
+	retval = hprintf(hdr, 
 			"%-80.80s%-80.80s%16s%-8u%-44.44s%-8i%-8u%-4u",
 			ebdf->subjstr,
 			ebdf->recstr,
@@ -408,53 +418,54 @@ static int ebdf_write_file_header(struct ebdf_file* ebdf, FILE* file)
 }
 
 /* \param bdf	pointer to a ebdf_file opened for writing
- * \param file  stream associated to the file 
- *              (should be positioned at the beginning of channel fields)
+ * \param hdr   header buffer formatting the file (positioned at the
+ *              beginning of channel fields)
  *
  * Write the EDF/BDF channels related fields in the header.
  */
-static int ebdf_write_channels_header(struct ebdf_file* bdf, FILE* file)
+static int ebdf_write_channels_header(struct ebdf_file* bdf,
+                                      struct hdrbuff* hdr)
 {
 	struct xdfch* ch;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-16.16s", get_ebdfch(ch)->label) < 0)
+		if (hprintf(hdr, "%-16.16s", get_ebdfch(ch)->label) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-80.80s", get_ebdfch(ch)->transducter) < 0)
+		if (hprintf(hdr, "%-80.80s", get_ebdfch(ch)->transducter) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-8.8s", get_ebdfch(ch)->unit) < 0)
+		if (hprintf(hdr, "%-8.8s", get_ebdfch(ch)->unit) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-8i", (int)(ch->physical_mm[0])) < 0)
+		if (hprintf(hdr, "%-8i", (int)(ch->physical_mm[0])) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-8i", (int)(ch->physical_mm[1])) < 0)
+		if (hprintf(hdr, "%-8i", (int)(ch->physical_mm[1])) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-8i", (int)(ch->digital_mm[0])) < 0)
+		if (hprintf(hdr, "%-8i", (int)(ch->digital_mm[0])) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-8i", (int)(ch->digital_mm[1])) < 0)
+		if (hprintf(hdr, "%-8i", (int)(ch->digital_mm[1])) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-80.80s", get_ebdfch(ch)->prefiltering) < 0)
+		if (hprintf(hdr, "%-80.80s", get_ebdfch(ch)->prefiltering) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-8u", bdf->xdf.ns_per_rec) < 0)
+		if (hprintf(hdr, "%-8u", bdf->xdf.ns_per_rec) < 0)
 			return -1;
 
 	for (ch = bdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-32.32s", get_ebdfch(ch)->reserved) < 0)
+		if (hprintf(hdr, "%-32.32s", get_ebdfch(ch)->reserved) < 0)
 			return -1;
 
 	return 0;
@@ -465,54 +476,54 @@ static int ebdf_write_channels_header(struct ebdf_file* bdf, FILE* file)
  *
  * EDF/BDF METHOD.
  * Write the general file header and channels fields
- * It creates from the file a stream that will be used to easily format
- * the header fields.
+ * The header is formatted in memory and then written in one go.
  */
 static int ebdf_write_header(struct xdf* xdf)
 {
 	int retval = 0;
 	struct ebdf_file* bdf = get_ebdf(xdf);
-	FILE* file = fdopen(mm_dup(xdf->fd), "wb");
-	if (!file)
-		return -1;
+	struct hdrbuff hdr = {.data = NULL};
 
 	// Write file header each field of all channels
-	if ( ebdf_write_file_header(bdf, file)
-	    || ebdf_write_channels_header(bdf, file) )
-		retval = -1;
-
-	if (fflush(file) || fclose(file))
+	if ( ebdf_write_file_header(bdf, &hdr)
+	    || ebdf_write_channels_header(bdf, &hdr)
+	    || hdrbuff_store(&hdr, &xdf->io, 0) )
 		retval = -1;
 
-	mm_seek(xdf->fd, (xdf->numch+1)*256, SEEK_SET);
+	hdrbuff_free(&hdr);
+	xdf->io.pos = (xdf->numch+1)*256;
 
 	return retval;
 }
 
 /* \param bdf	pointer to a ebdf_file open for reading
- * \param file  stream associated to the file 
- *              (should be at the beginning of the file)
+ * \param hdr   header of the file loaded in memory
  *
  * Read the general BDF file header
  */
-static int ebdf_read_file_header(struct ebdf_file* bdf, FILE* file)
+static int ebdf_read_file_header(struct ebdf_file* bdf, struct hdrbuff* hdr)
 {
 	char timestring[17], type[45];
 	int recdur, hdrsize, retval = 0;
 	struct tm ltm = {.tm_isdst = -1};
 
-	fseek(file, 8, SEEK_SET);
+	hdr->pos = 8;
 
-	if (read_string_field(file, bdf->subjstr, 80)
-	   || read_string_field(file, bdf->recstr, 80)
-	   || read_string_field(file, timestring, 16)
-	   || read_int_field(file, &hdrsize, 8)
-	   || read_string_field(file, type, 44)
-	   || read_int_field(file, &(bdf->xdf.nrecord), 8)
-	   || read_int_field(file, &recdur, 8)
-	   || read_int_field(file, (int*)&(bdf->xdf.numch), 4) )
+	if (hread_string_field(hdr, bdf->subjstr, 80)
+	   || hread_string_field(hdr, bdf->recstr, 80)
+	   || hread_string_field(hdr, timestring, 16)
+	   || hread_int_field(hdr, &hdrsize, 8)
+	   || hread_string_field(hdr, type, 44)
+	   || hread_int_field(hdr, &(bdf->xdf.nrecord), 8)
+	   || hread_int_field(hdr, &recdur, 8)
+	   || hread_int_field(hdr, (int*)&(bdf->xdf.numch), 4) )
 		return -1;
 
+	if ((int)bdf->xdf.numch < 0) {
+		errno = EILSEQ;
+		return -1;
+	}
+
 	bdf->xdf.rec_duration = (double)recdur;
 	bdf->xdf.hdr_offset = hdrsize;
 
@@ -531,101 +542,130 @@ static int ebdf_read_file_header(struct ebdf_file* bdf, FILE* file)
 
 
 /* \param bdf	pointer to a ebdf_file open for reading
- * \param file  stream associated to the file 
- *              (should be at the correct file position)
+ * \param hdr   header of the file loaded in memory
+ *              (positioned at the beginning of the channel fields)
  *
  * Read all channels related field in the header and setup the channels
  * accordingly. set the channels for no scaling and inmemtype = infiletype
  */
-static int ebdf_read_channels_header(struct ebdf_file* ebdf, FILE* file)
+static int ebdf_read_channels_header(struct ebdf_file* ebdf,
+                                     struct hdrbuff* hdr)
 {
 	struct xdfch* ch;
 	int ival;
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_ebdfch(ch)->label, 16))
+		if (hread_string_field(hdr, get_ebdfch(ch)->label, 16))
 			return -1;
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_ebdfch(ch)->transducter, 80))
+		if (hread_string_field(hdr, get_ebdfch(ch)->transducter, 80))
 			return -1;
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_ebdfch(ch)->unit, 8))
+		if (hread_string_field(hdr, get_ebdfch(ch)->unit, 8))
 			return -1;
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next) {
-		if (read_int_field(file, &ival, 8))
+		if (hread_int_field(hdr, &ival, 8))
 			return -1;
 		ch->physical_mm[0] = (double)ival;
 	}
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next) {
-		if (read_int_field(file, &ival, 8))
+		if (hread_int_field(hdr, &ival, 8))
 			return -1;
 		ch->physical_mm[1] = (double)ival;
 	}
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next) {
-		if (read_int_field(file, &ival, 8))
+		if (hread_int_field(hdr, &ival, 8))
 			return -1;
 		ch->digital_mm[0] = (double)ival;
 	}
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next) {
-		if (read_int_field(file, &ival, 8))
+		if (hread_int_field(hdr, &ival, 8))
 			return -1;
 		ch->digital_mm[1] = (double)ival;
 	}
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_ebdfch(ch)->prefiltering, 80))
+		if (hread_string_field(hdr, get_ebdfch(ch)->prefiltering, 80))
 			return -1;
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_int_field(file, (int*)&(ebdf->xdf.ns_per_rec), 8))
+		if (hread_int_field(hdr, (int*)&(ebdf->xdf.ns_per_rec), 8))
 			return -1;
 
 	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_ebdfch(ch)->reserved, 32))
+		if (hread_string_field(hdr, get_ebdfch(ch)->reserved, 32))
 			return -1;
 
 	return 0;
 }
 
+/* \param ebdf	pointer to a ebdf_file open for reading
+ *
+ * Create the event table receiving the events of the status channel. The
+ * number of events is known only once the channel is decoded.
+ */
+static int ebdf_setup_status_events(struct ebdf_file* ebdf)
+{
+	struct xdfch* ch;
+
+	if (!(ebdf->xdf.table = create_event_table()))
+		return -1;
+
+	for (ch = ebdf->xdf.channels; ch != NULL; ch = ch->next) {
+		if (!strcmp(get_ebdfch(ch)->label, STATUS_LABEL)) {
+			ebdf->statusch = ch;
+			ebdf->xdf.nevent_pending = NEVENT_UNKNOWN;
+			break;
+		}
+	}
+
+	return 0;
+}
+
+
 /* \param xdf	pointer to an xdf file with XDF_READ mode
  *
  * EDF/BDF METHOD.
  * Read the header and allocate the channels
- * It creates from the file a stream that will be used to easily interpret
- * and parse the header.
+ * The header is loaded in memory in two reads, the fixed part giving the
+ * size of the channel part, and then parsed from there.
  */
 static int ebdf_read_header(struct xdf* xdf)
 {
 	int retval = -1;
 	unsigned int i;
 	struct ebdf_file* ebdf = get_ebdf(xdf);
-	FILE* file = fdopen(mm_dup(xdf->fd), "rb");
-	if (!file)
-		return -1;
+	struct hdrbuff hdr = {.data = NULL};
 
-	if (ebdf_read_file_header(ebdf, file))
+	if (hdrbuff_load(&hdr, &xdf->io, 256)
+	   || ebdf_read_file_header(ebdf, &hdr)
+	   || hdrbuff_load(&hdr, &xdf->io, (xdf->numch+1)*256))
 		goto exit;
 
-	// Allocate all the channels
+	// Allocate all the channels (from a single block)
+	if (xdf_reserve_channels(xdf, xdf->numch))
+		goto exit;
 	for (i=0; i<xdf->numch; i++) {
 		if (xdf_alloc_channel(xdf) == NULL)
 			goto exit;
 	}
 
-	if (ebdf_read_channels_header(ebdf, file))
+	if (ebdf_read_channels_header(ebdf, &hdr))
+		goto exit;
+
+	if (xdf->status_events && ebdf_setup_status_events(ebdf))
 		goto exit;
 
-	
 	retval = 0;
 exit:
-	fclose(file);
-	mm_seek(xdf->fd, (xdf->numch+1)*256, SEEK_SET);
+	hdrbuff_free(&hdr);
+	xdf->io.pos = (xdf->numch+1)*256;
 	return retval;
 }
 
@@ -642,10 +682,106 @@ static int ebdf_complete_file(struct xdf* xdf)
 
 	// Write the number of records in the header
 	snprintf(numrecstr, 9, "%-8i", xdf->nrecord);
-	if ( (mm_seek(xdf->fd, NUMREC_FIELD_LOC, SEEK_SET) < 0)
-	    || (mm_write(xdf->fd, numrecstr, 8) < 0) )
+	if (pwrite8bval(&xdf->io, NUMREC_FIELD_LOC, 8, numrecstr))
 		retval = -1;
 
 	return retval;
 }
 
+
+/* \param table	event table receiving the event
+ * \param code	value of the status channel
+ * \param onset	time of the first sample holding @code
+ * \param duration	duration during which @code is held
+ *
+ * Add an event decoded from the status channel in @table.
+ */
+static
+int add_status_event(struct eventtable* table, int code,
+                     double onset, double duration)
+{
+	struct xdfevent evt = {.onset = onset, .duration = duration};
+
+	evt.evttype = add_event_entry(table, code, NULL);
+	if ((evt.evttype < 0) || add_event(table, &evt))
+		return xdf_set_error(ENOMEM);
+
+	return 0;
+}
+
+
+/* \param xdf	pointer to an xdf file with XDF_READ mode
+ * \param nevent	number of events to decode (ignored)
+ *
+ * EDF/BDF METHOD.
+ * Decode the status channel into events: each run of samples whose value
+ * masked by STATUS_MASK is the same non zero value is an event. The whole
+ * channel is decoded at once since the number of events is unknown before.
+ * The channel is read record by record without moving the file pointer:
+ * this may occur during a transfer.
+ */
+static int ebdf_load_events(struct xdf* xdf, unsigned int nevent)
+{
+	const struct xdfch *ch, *statusch = get_ebdf(xdf)->statusch;
+	struct convprm prm;
+	mm_off_t off, recsize = 0, choff = 0;
+	unsigned int i, size, ns = xdf->ns_per_rec;
+	int irec, retval = -1;
+	int32_t prev = 0;
+	int32_t* val;
+	void *raw, *tmp;
+	double t, start = 0.0;
+
+	(void)nevent;
+
+	// Locate the samples of the status channel in a record
+	for (ch = xdf->channels; ch != NULL; ch = ch->next) {
+		if (ch == statusch)
+			choff = recsize * ns;
+		recsize += xdf_get_datasize(ch->infiletype);
+	}
+	recsize *= ns;
+	size = xdf_get_datasize(statusch->infiletype);
+
+	xdf_setup_transform(&prm, SWAP_IN, size, statusch->infiletype, NULL,
+	                    sizeof(*val), XDFINT32, NULL, NULL);
+	raw = malloc(ns * size);
+	val = malloc(ns * sizeof(*val));
+	tmp = malloc(ns * 8);
+	if (!raw || !val || !tmp)
+		goto exit;
+
+	off = xdf->hdr_offset + choff;
+	for (irec = 0; irec < xdf->nrecord; irec++, off += recsize) {
+		if (pread8bval(&xdf->io, off, ns * size, raw))
+			goto exit;
+		xdf_transconv_data(ns, val, raw, &prm, tmp);
+
+		i = xdf_find_change(ns, val, prev, STATUS_MASK);
+		while (i < ns) {
+			t = ((double)irec * ns + i) * xdf->rec_duration / ns;
+			if (prev && add_status_event(xdf->table, prev,
+			                             start, t - start))
+				goto exit;
+
+			prev = val[i] & STATUS_MASK;
+			start = t;
+			i += 1 + xdf_find_change(ns-i-1, val+i+1,
+			                         prev, STATUS_MASK);
+		}
+	}
+
+	// Event still running at the end of the file
+	t = xdf->nrecord * xdf->rec_duration;
+	if (prev && add_status_event(xdf->table, prev, start, t - start))
+		goto exit;
+
+	retval = 0;
+
+exit:
+	xdf_free_transform(&prm);
+	free(raw);
+	free(val);
+	free(tmp);
+	return retval;
+}
@@ -173,6 +173,328 @@ int recompose_gdf(struct xdf * srcfile, FILE * eventfile, FILE * codefile,
 }
 
 
+/*
+ * Fields of the GDF2 event table, one array per field as in the file
+ */
+struct gdf2_events {
+	unsigned int num, nmax;
+	uint32_t *pos, *dur;
+	uint16_t *code, *ch;
+
+	unsigned int ntype;
+	uint16_t *type_code, *type_ch;
+};
+
+
+static
+int load_evttypes(struct gdf2_events* evts, FILE * codefile)
+{
+	uint32_t hdr[3];
+	unsigned int evttype, chval;
+	size_t nread;
+	char desc[32];
+	void *tmp1, *tmp2;
+
+	if (codefile == NULL)
+		return 0;
+
+	while (fread(hdr, sizeof(hdr), 1, codefile) == 1) {
+#if WORDS_BIGENDIAN
+		hdr[0] = bswap_32(hdr[0]);
+		hdr[1] = bswap_32(hdr[1]);
+		hdr[2] = bswap_32(hdr[2]);
+#endif
+		/* Only the channel part of the description is kept */
+		evttype = hdr[0];
+		nread = (hdr[2] < sizeof(desc)) ? hdr[2] : sizeof(desc)-1;
+		if (fread(desc, 1, nread, codefile) != nread
+		    || fseek(codefile, hdr[2] - nread, SEEK_CUR))
+			break;  /* could not read a full entry -> stop */
+		desc[nread] = '\0';
+		if (sscanf(desc, "ch:%u", &chval) < 1)
+			chval = 0;
+
+		if (evttype >= evts->ntype) {
+			tmp1 = realloc(evts->type_code, (evttype+1)*sizeof(uint16_t));
+			if (tmp1)
+				evts->type_code = tmp1;
+			tmp2 = realloc(evts->type_ch, (evttype+1)*sizeof(uint16_t));
+			if (tmp2)
+				evts->type_ch = tmp2;
+			if (!tmp1 || !tmp2)
+				return -1;
+			evts->ntype = evttype+1;
+		}
+		evts->type_code[evttype] = hdr[1];
+		evts->type_ch[evttype] = chval;
+	}
+
+	return 0;
+}
+
+
+static
+int push_event(struct gdf2_events* evts, const struct xdfevent* evt, float fs)
+{
+	unsigned int nmax, i = evts->num;
+	void *tmp[4];
+	int k;
+
+	if ((unsigned int)evt->evttype >= evts->ntype)
+		return 0;  /* event type unknown -> skip the event */
+
+	if (i == evts->nmax) {
+		nmax = evts->nmax ? 2*evts->nmax : 256;
+		tmp[0] = realloc(evts->pos, nmax*sizeof(uint32_t));
+		if (tmp[0])
+			evts->pos = tmp[0];
+		tmp[1] = realloc(evts->dur, nmax*sizeof(uint32_t));
+		if (tmp[1])
+			evts->dur = tmp[1];
+		tmp[2] = realloc(evts->code, nmax*sizeof(uint16_t));
+		if (tmp[2])
+			evts->code = tmp[2];
+		tmp[3] = realloc(evts->ch, nmax*sizeof(uint16_t));
+		if (tmp[3])
+			evts->ch = tmp[3];
+		for (k = 0; k < 4; k++)
+			if (tmp[k] == NULL)
+				return -1;
+		evts->nmax = nmax;
+	}
+
+	evts->pos[i] = fs * evt->onset;
+	evts->dur[i] = (evt->duration > 0) ? fs * evt->duration : 0;
+	evts->code[i] = evts->type_code[evt->evttype];
+	evts->ch[i] = evts->type_ch[evt->evttype];
+	evts->num++;
+	return 0;
+}
+
+
+static
+int load_events(struct gdf2_events* evts, FILE * eventfile, float fs)
+{
+	struct xdfevent evt;
+
+	if (eventfile == NULL)
+		return 0;
+
+	while (fread(&evt, sizeof(evt), 1, eventfile) == 1) {
+#if WORDS_BIGENDIAN
+		uint64_t tmp;
+		memcpy(&tmp, &evt.onset, sizeof(tmp));
+		tmp = bswap_64(tmp);
+		memcpy(&evt.onset, &tmp, sizeof(tmp));
+		memcpy(&tmp, &evt.duration, sizeof(tmp));
+		tmp = bswap_64(tmp);
+		memcpy(&evt.duration, &tmp, sizeof(tmp));
+		evt.evttype = bswap_32(evt.evttype);
+#endif
+		if (push_event(evts, &evt, fs))
+			return -1;
+	}
+
+	return 0;
+}
+
+
+/* \param fd     file descriptor of the file being repaired
+ * \param off    offset at which the values are written, moved after them
+ * \param buff   values to write (swapped in place on big endian hosts)
+ * \param size   size of each value
+ * \param n      number of values
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int write_le(int fd, mm_off_t* off, void* buff, size_t size, size_t n)
+{
+	char* cbuff = buff;
+	size_t len = size*n;
+	ssize_t wsize;
+
+#if WORDS_BIGENDIAN
+	size_t i;
+	uint16_t* buff16 = buff;
+	uint32_t* buff32 = buff;
+	uint64_t* buff64 = buff;
+
+	for (i = 0; i < n; i++) {
+		if (size == 2)
+			buff16[i] = bswap_16(buff16[i]);
+		else if (size == 4)
+			buff32[i] = bswap_32(buff32[i]);
+		else if (size == 8)
+			buff64[i] = bswap_64(buff64[i]);
+	}
+#endif
+	while (len) {
+		wsize = mm_pwrite(fd, cbuff, len, *off);
+		if (wsize < 0)
+			return -1;
+
+		cbuff += wsize;
+		*off += wsize;
+		len -= wsize;
+	}
+
+	return 0;
+}
+
+
+static
+int write_event_table(struct gdf2_events* evts, int fd, mm_off_t off,
+                      float fs)
+{
+	unsigned int i;
+	uint8_t evthdr[4] = {1, evts->num & 0xFF, (evts->num >> 8) & 0xFF,
+	                     (evts->num >> 16) & 0xFF};
+
+	if (evts->num == 0)
+		return 0;
+
+	for (i = 0; i < evts->num; i++)
+		if (evts->ch[i] || evts->dur[i])
+			evthdr[0] = 3;
+
+	if (write_le(fd, &off, evthdr, 1, sizeof(evthdr))
+	    || write_le(fd, &off, &fs, sizeof(fs), 1)
+	    || write_le(fd, &off, evts->pos, sizeof(uint32_t), evts->num)
+	    || write_le(fd, &off, evts->code, sizeof(uint16_t), evts->num)
+	    || (evthdr[0] == 3
+	        && (write_le(fd, &off, evts->ch, sizeof(uint16_t), evts->num)
+	           || write_le(fd, &off, evts->dur,
+	                       sizeof(uint32_t), evts->num))))
+		return -1;
+
+	return 0;
+}
+
+
+#define NUMREC_FIELD_LOC 236
+#define CHECKPOINT_FIELD_LOC 254
+static const char checkpoint_mark[2] = {'C', 'K'};
+
+/* \param fd     file descriptor of the GDF2 file
+ *
+ * Tell whether the recording of a GDF2 file has not been completed: the
+ * number of records in its header is unknown (-1) or is the one of its last
+ * checkpoint. A completed file must not be repaired: its event table would
+ * be lost.
+ *
+ * Returns 1 if the file is incomplete, 0 if it is complete, -1 in case of
+ * error
+ */
+static
+int is_incomplete(int fd)
+{
+	uint8_t hdrend[256 - NUMREC_FIELD_LOC];
+	int64_t nrec;
+
+	if (mm_pread(fd, hdrend, sizeof(hdrend), NUMREC_FIELD_LOC)
+	      != sizeof(hdrend)) {
+		errno = EILSEQ;
+		return -1;
+	}
+
+	memcpy(&nrec, hdrend, sizeof(nrec));
+#if WORDS_BIGENDIAN
+	nrec = bswap_64(nrec);
+#endif
+	if (nrec < 0)
+		return 1;
+
+	return !memcmp(hdrend + CHECKPOINT_FIELD_LOC - NUMREC_FIELD_LOC,
+	               checkpoint_mark, sizeof(checkpoint_mark));
+}
+
+
+/* \param filename     path of the GDF2 file to repair
+ * \param eventfile    event journal of the file (may be NULL)
+ * \param codefile     code journal of the file (may be NULL)
+ *
+ * Repair an interrupted GDF2 recording in place: the last incomplete
+ * record is truncated, the event table is appended after the records and
+ * the number of records is written in the header. Unlike recompose_gdf(),
+ * the data is not copied: the cost only depends on the number of events.
+ * A file whose recording has been completed is left untouched.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int repair_gdf_inplace(const char* filename, FILE * eventfile, FILE * codefile)
+{
+	struct xdf* xdf;
+	struct gdf2_events evts = {.num = 0};
+	mm_off_t hdr_offset, evt_sect, flen, off;
+	size_t recsize;
+	int64_t nrec;
+	uint8_t nomark[2] = {0, 0};
+	float fs;
+	int fd, incomplete, retval = -1;
+
+	fd = mm_open(filename, O_RDWR, 0);
+	if (fd < 0)
+		return -1;
+
+	incomplete = is_incomplete(fd);
+	if (incomplete <= 0) {
+		if (incomplete == 0) {
+			fprintf(stderr, "%s has been completed: "
+			                "nothing to repair\n", filename);
+			errno = EINVAL;
+		}
+		mm_close(fd);
+		return -1;
+	}
+
+	// Get the layout of the records from the header
+	xdf = xdf_open(filename, XDF_READ, XDF_GDF2);
+	if (xdf == NULL)
+		goto exit;
+	hdr_offset = xdf->hdr_offset;
+	recsize = xdf->filerec_size;
+	fs = (float)xdf->ns_per_rec / (float)xdf->rec_duration;
+	xdf_close(xdf);
+
+	if (load_evttypes(&evts, codefile)
+	    || load_events(&evts, eventfile, fs))
+		goto exit;
+
+	// Keep only the complete records and append the event table
+	if ((flen = mm_seek(fd, 0, SEEK_END)) < 0)
+		goto exit;
+	nrec = (flen - hdr_offset) / recsize;
+	evt_sect = hdr_offset + nrec*recsize;
+	if (mm_ftruncate(fd, evt_sect)
+	    || write_event_table(&evts, fd, evt_sect, fs))
+		goto exit;
+
+	// Finally validate the records with their number in the header and
+	// drop the checkpoint flag
+	off = NUMREC_FIELD_LOC;
+	if (write_le(fd, &off, &nrec, sizeof(nrec), 1))
+		goto exit;
+	off = CHECKPOINT_FIELD_LOC;
+	if (write_le(fd, &off, nomark, 1, sizeof(nomark))
+	    || mm_fsync(fd))
+		goto exit;
+
+	retval = 0;
+
+exit:
+	mm_close(fd);
+	free(evts.pos);
+	free(evts.dur);
+	free(evts.code);
+	free(evts.ch);
+	free(evts.type_code);
+	free(evts.type_ch);
+	return retval;
+}
+
+
 int main(int argc, char ** argv)
 {
 	char * tmp;
@@ -184,9 +506,14 @@ int main(int argc, char ** argv)
 	struct xdf * dstfile = NULL;
 	FILE * eventfile = NULL;
 	FILE * codefile = NULL;
-
-	if (argc != 3) {
-		fprintf(stderr,"usage: %s <in-file> <out-file>\n", argv[0]);
+	int inplace = 0;
+
+	if (argc == 3 && strcmp(argv[1], "-i") == 0) {
+		inplace = 1;
+		argv[1] = argv[2];
+	} else if (argc != 3) {
+		fprintf(stderr,"usage: %s <in-file> <out-file>\n"
+		               "       %s -i <file>\n", argv[0], argv[0]);
 		return -1;
 	}
 
@@ -223,6 +550,20 @@ int main(int argc, char ** argv)
 		fprintf(stderr, "%s only works with gdf files\n", argv[0]);
 		goto exit;
 	}
+
+	if (inplace) {
+		if (srcfmt != XDF_GDF2) {
+			fprintf(stderr, "%s -i only works with gdf2 files\n",
+			        argv[0]);
+			goto exit;
+		}
+		xdf_close(srcfile);
+		srcfile = NULL;
+		exitcode = repair_gdf_inplace(argv[1], eventfile, codefile);
+		if (exitcode != 0)
+			fprintf(stderr, "%s failed: %s\n", argv[0], strerror(errno));
+		goto exit;
+	}
 	dst_fd = mm_open(argv[2], O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
 	if (dst_fd < 0) {
 		fprintf(stderr, "%s failed to open %s for writing\n", argv[0], argv[2]);
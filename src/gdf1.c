@@ -21,6 +21,7 @@
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -54,6 +55,7 @@ static int gdf1_get_conf(const struct xdf*, enum xdffield,
 static int gdf1_write_header(struct xdf*);
 static int gdf1_read_header(struct xdf*);
 static int gdf1_complete_file(struct xdf*);
+static int gdf1_load_events(struct xdf*, unsigned int);
 
 // GDF1 channel structure
 struct gdf1_channel {
@@ -75,6 +77,10 @@ struct gdf1_file {
 	uint64_t epid, lid, tid;
 	char sn[21];
 	unsigned int version;
+	mm_off_t evt_sect;
+	uint32_t evt_num;
+	uint8_t evt_mode;
+	double evt_fs;
 };
 
 #define NUMREC_FIELD_LOC 236
@@ -139,6 +145,7 @@ static const struct format_operations gdf1_ops = {
 	.write_header = gdf1_write_header,
 	.read_header = gdf1_read_header,
 	.complete_file = gdf1_complete_file,
+	.load_events = gdf1_load_events,
 	.type = XDF_GDF1,
 	.supported_type = {
 		[XDFUINT8] = true,
@@ -363,13 +370,14 @@ static void convert_recduration(double len, uint32_t ratio[2])
 
 
 /* \param gdf1	pointer to a gdf1_file opened for writing
- * \param file  stream associated to the file 
- *              (should be positioned at the beginning of the file)
+ * \param hdr   header buffer formatting the file (positioned at its
+ *              beginning)
  *
  * Write the general GDF1 file header. Write -1 in the number of records
  * field. The real value is written after the transfer is finished
  */
-static int gdf1_write_file_header(struct gdf1_file* gdf1, FILE* file)
+static int gdf1_write_file_header(struct gdf1_file* gdf1,
+                                  struct hdrbuff* hdr)
 {
 	char timestring[17];
  	uint32_t nch, recduration[2];
@@ -388,22 +396,22 @@ static int gdf1_write_file_header(struct gdf1_file* gdf1, FILE* file)
 
 	// Write data format identifier
 	snprintf(key, sizeof(key), "GDF 1.%02u", gdf1->version);
-	if (fwrite(key, 8, 1, file) < 1)
+	if (hwrite8bval(hdr, 8, key))
 		return -1;
 
 	// Write all the general file header
-	if ((fprintf(file, "%-80.80s%-80.80s%16s", 
+	if (hprintf(hdr, "%-80.80s%-80.80s%16s",
 			  gdf1->subjstr,
 			  gdf1->recstr,
-			  timestring) < 0)
-	   || write64bval(file, 1, &hdrsize)
-	   || write64bval(file, 1, &(gdf1->epid))
-	   || write64bval(file, 1, &(gdf1->lid))
-	   || write64bval(file, 1, &(gdf1->tid))
-	   || (fprintf(file, "%-20.20s", gdf1->sn) < 0)
-	   || write64bval(file, 1, &nrec)
-	   || write32bval(file, 2, recduration)
-	   || write32bval(file, 1, &nch))
+			  timestring)
+	   || hwrite64bval(hdr, 1, &hdrsize)
+	   || hwrite64bval(hdr, 1, &(gdf1->epid))
+	   || hwrite64bval(hdr, 1, &(gdf1->lid))
+	   || hwrite64bval(hdr, 1, &(gdf1->tid))
+	   || hprintf(hdr, "%-20.20s", gdf1->sn)
+	   || hwrite64bval(hdr, 1, &nrec)
+	   || hwrite32bval(hdr, 2, recduration)
+	   || hwrite32bval(hdr, 1, &nch))
 		return -1;
 	
 	gdf1->xdf.hdr_offset = hdrsize;
@@ -411,65 +419,66 @@ static int gdf1_write_file_header(struct gdf1_file* gdf1, FILE* file)
 }
 
 /* \param bdf	pointer to a gdf1_file opened for writing
- * \param file  stream associated to the file 
- *              (should be positioned at the beginning of channel fields)
+ * \param hdr   header buffer formatting the file (positioned at the
+ *              beginning of channel fields)
  *
  * Write the GDF1 channels related fields in the header.
  */
-static int gdf1_write_channels_header(struct gdf1_file* gdf1, FILE* file)
+static int gdf1_write_channels_header(struct gdf1_file* gdf1,
+                                      struct hdrbuff* hdr)
 {
 	struct xdfch* ch;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-16.16s", get_gdf1ch(ch)->label) < 0)
+		if (hprintf(hdr, "%-16.16s", get_gdf1ch(ch)->label) < 0)
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-80.80s", get_gdf1ch(ch)->transducter)<0)
+		if (hprintf(hdr, "%-80.80s", get_gdf1ch(ch)->transducter)<0)
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-8.8s", get_gdf1ch(ch)->unit) < 0)
+		if (hprintf(hdr, "%-8.8s", get_gdf1ch(ch)->unit) < 0)
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (write64bval(file, 1, &(ch->physical_mm[0])))
+		if (hwrite64bval(hdr, 1, &(ch->physical_mm[0])))
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (write64bval(file, 1, &(ch->physical_mm[1])))
+		if (hwrite64bval(hdr, 1, &(ch->physical_mm[1])))
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		int64_t val = ch->digital_mm[0];
-		if (write64bval(file, 1, &val))
+		if (hwrite64bval(hdr, 1, &val))
 			return -1;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		int64_t val = ch->digital_mm[1];
-		if (write64bval(file, 1, &val))
+		if (hwrite64bval(hdr, 1, &val))
 			return -1;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-80.80s", get_gdf1ch(ch)->prefiltering) < 0)
+		if (hprintf(hdr, "%-80.80s", get_gdf1ch(ch)->prefiltering) < 0)
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		int32_t nsprec = gdf1->xdf.ns_per_rec;
-		if (write32bval(file, 1, &nsprec))
+		if (hwrite32bval(hdr, 1, &nsprec))
 			return -1;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		int32_t type = gdf1_types[ch->infiletype];
-		if (write32bval(file, 1, &type))
+		if (hwrite32bval(hdr, 1, &type))
 			return -1;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-32.32s", get_gdf1ch(ch)->reserved) < 0)
+		if (hprintf(hdr, "%-32.32s", get_gdf1ch(ch)->reserved) < 0)
 			return -1;
 
 	return 0;
@@ -480,26 +489,22 @@ static int gdf1_write_channels_header(struct gdf1_file* gdf1, FILE* file)
  *
  * GDF1 METHOD.
  * Write the general file header and channels fields
- * It creates from the file a stream that will be used to easily format
- * the header fields.
+ * The header is formatted in memory and then written in one go.
  */
 static int gdf1_write_header(struct xdf* xdf)
 {
 	int retval = 0;
 	struct gdf1_file* gdf1 = get_gdf1(xdf);
-	FILE* file = fdopen(mm_dup(xdf->fd), "wb");
-	if (!file)
-		return -1;
+	struct hdrbuff hdr = {.data = NULL};
 
 	// Write file header each field of all channels
-	if ( gdf1_write_file_header(gdf1, file)
-	    || gdf1_write_channels_header(gdf1, file) )
-		retval = -1;
-
-	if (fflush(file) || fclose(file))
+	if ( gdf1_write_file_header(gdf1, &hdr)
+	    || gdf1_write_channels_header(gdf1, &hdr)
+	    || hdrbuff_store(&hdr, &xdf->io, 0) )
 		retval = -1;
 
-	mm_seek(xdf->fd, (xdf->numch+1)*256, SEEK_SET);
+	hdrbuff_free(&hdr);
+	xdf->io.pos = (xdf->numch+1)*256;
 
 	return retval;
 }
@@ -510,43 +515,76 @@ int gdf1_setup_events(struct eventtable* table, double fs, uint8_t* mode,
                      uint32_t *pos, uint16_t* code,
 		     uint16_t *ch, uint32_t* dur)
 {
-	unsigned int i, nevent = table->nevent;
+	unsigned int i, start, len, nevent = table->nevent;
+	unsigned int nentry = table->nentry;
+	unsigned int types[EVT_BLOCK];
+	double onsets[EVT_BLOCK], durations[EVT_BLOCK];
 	int codeval, use_extevt = 0;
 	unsigned int chval;
 	const char* desc;
-	struct xdfevent* evt;
-
-	for (i=0; i<nevent; i++) {
-		evt = get_event(table, i);
-		pos[i] = fs * evt->onset;
-		if (evt->duration > 0) {
-			dur[i] = fs * evt->duration;
-			use_extevt = 1;
-		} else
-			dur[i] = 0;
-		get_event_entry(table, evt->evttype, &codeval, &desc);
-		code[i] = codeval;
-		ch[i] = 0;
-		if (desc != NULL && sscanf(desc, "ch:%u", &chval) >= 1) {
-			ch[i] = chval;
-			use_extevt = 1;
-		} else
-			ch[i] = 0;
+	uint16_t *entry_code, *entry_ch;
+
+	// Code and channel are the same for all events of a type: interpret
+	// the description once per event type
+	entry_code = malloc(nentry*sizeof(*entry_code));
+	entry_ch = malloc(nentry*sizeof(*entry_ch));
+	if (entry_code == NULL || entry_ch == NULL) {
+		free(entry_code);
+		free(entry_ch);
+		return -1;
+	}
+
+	for (i=0; i<nentry; i++) {
+		get_event_entry(table, i, &codeval, &desc);
+		entry_code[i] = codeval;
+		if (desc != NULL && sscanf(desc, "ch:%u", &chval) >= 1)
+			entry_ch[i] = chval;
+		else
+			entry_ch[i] = 0;
 	}
+
+	// Convert the events by blocks, each field in its own loop
+	for (start=0; start<nevent; start+=len) {
+		len = nevent - start;
+		if (len > EVT_BLOCK)
+			len = EVT_BLOCK;
+		get_events(table, start, len, types, onsets, durations);
+
+		for (i=0; i<len; i++)
+			pos[start+i] = fs * onsets[i];
+
+		for (i=0; i<len; i++) {
+			if (durations[i] > 0) {
+				dur[start+i] = fs * durations[i];
+				use_extevt = 1;
+			} else
+				dur[start+i] = 0;
+		}
+
+		for (i=0; i<len; i++) {
+			code[start+i] = entry_code[types[i]];
+			ch[start+i] = entry_ch[types[i]];
+			if (ch[start+i])
+				use_extevt = 1;
+		}
+	}
+
+	free(entry_code);
+	free(entry_ch);
 	*mode = use_extevt ? 3 : 1;
 	return 0;
 }
 
 
 static
-int gdf1_write_event_table(struct gdf1_file* gdf1, FILE* file)
+int gdf1_write_event_table(struct gdf1_file* gdf1, struct hdrbuff* hdr)
 {
 	struct eventtable* table = gdf1->xdf.table;
 	int retcode = 0;
 	uint8_t mode, fs24[3];
 	double fs = gdf1->xdf.ns_per_rec / gdf1->xdf.rec_duration;
-	uint32_t nevt = table->nevent, *onset = NULL, *dur = NULL;
-	uint16_t *code = NULL, *ch = NULL;
+	uint32_t i, nevt = table->nevent, *onset = NULL, *dur = NULL;
+	uint16_t *code = NULL, *ch = NULL, dur16;
 
 	if (nevt == 0)
 		return 0;
@@ -559,19 +597,25 @@ int gdf1_write_event_table(struct gdf1_file* gdf1, FILE* file)
 	code = malloc(nevt*sizeof(*code));
 	ch = malloc(nevt*sizeof(*ch));
 	dur = malloc(nevt*sizeof(*dur));
-	if (onset == NULL || code == NULL || ch == NULL || dur == NULL)
+	if (onset == NULL || code == NULL || ch == NULL || dur == NULL
+	  || gdf1_setup_events(table, fs, &mode, onset, code, ch, dur))
 		retcode = -1;
 
-	gdf1_setup_events(table, fs, &mode, onset, code, ch, dur);
+	// Durations are stored on 16 bits: pack them at the beginning of the
+	// array (the i-th packed value never overwrites a value not read yet)
+	for (i=0; !retcode && i<nevt; i++) {
+		dur16 = (dur[i] > UINT16_MAX) ? UINT16_MAX : dur[i];
+		memcpy((char*)dur + i*sizeof(dur16), &dur16, sizeof(dur16));
+	}
 
 	if (retcode
-	  || write8bval(file, 1, &mode)
-	  || write24bval(file, 1, fs24)
-	  || write32bval(file, 1, &nevt)
-	  || write32bval(file, nevt, onset)
-	  || write16bval(file, nevt, code)
-	  || (mode == 3 && write16bval(file, nevt, ch))
-	  || (mode == 3 && write16bval(file, nevt, dur)))
+	  || hwrite8bval(hdr, 1, &mode)
+	  || hwrite24bval(hdr, 1, fs24)
+	  || hwrite32bval(hdr, 1, &nevt)
+	  || hwrite32bval(hdr, nevt, onset)
+	  || hwrite16bval(hdr, nevt, code)
+	  || (mode == 3 && hwrite16bval(hdr, nevt, ch))
+	  || (mode == 3 && hwrite16bval(hdr, nevt, dur)))
 		retcode = -1;
 
 	free(onset);
@@ -583,31 +627,31 @@ int gdf1_write_event_table(struct gdf1_file* gdf1, FILE* file)
 
 
 /* \param bdf	pointer to a gdf1_file open for reading
- * \param file  stream associated to the file 
- *              (should be at the beginning of the file)
+ * \param hdr   header of the file loaded in memory
  *
  * Read the general GDF1 file header
  */
-static int gdf1_read_file_header(struct gdf1_file* gdf1, FILE* file)
+static int gdf1_read_file_header(struct gdf1_file* gdf1,
+                                 struct hdrbuff* hdr)
 {
 	char timestring[17];
 	uint32_t nch, recduration[2];
 	int64_t nrec, hdrsize;
 	struct tm ltm = {.tm_isdst = -1};
 
-	fseek(file, 8, SEEK_SET);
-
-	if (read_string_field(file, gdf1->subjstr, 80)
-	   || read_string_field(file, gdf1->recstr, 80)
-	   || read_string_field(file, timestring, 16)
-	   || read64bval(file, 1, &hdrsize)
-	   || read64bval(file, 1, &(gdf1->epid))
-	   || read64bval(file, 1, &(gdf1->lid))
-	   || read64bval(file, 1, &(gdf1->tid))
-	   || read_string_field(file, gdf1->sn, 20)
-	   || read64bval(file, 1, &nrec)
-	   || read32bval(file, 2, recduration)
-	   || read32bval(file, 1, &nch) )
+	hdr->pos = 8;
+
+	if (hread_string_field(hdr, gdf1->subjstr, 80)
+	   || hread_string_field(hdr, gdf1->recstr, 80)
+	   || hread_string_field(hdr, timestring, 16)
+	   || hread64bval(hdr, 1, &hdrsize)
+	   || hread64bval(hdr, 1, &(gdf1->epid))
+	   || hread64bval(hdr, 1, &(gdf1->lid))
+	   || hread64bval(hdr, 1, &(gdf1->tid))
+	   || hread_string_field(hdr, gdf1->sn, 20)
+	   || hread64bval(hdr, 1, &nrec)
+	   || hread32bval(hdr, 2, recduration)
+	   || hread32bval(hdr, 1, &nch) )
 		return -1;
 
 	gdf1->xdf.rec_duration = (double)recduration[0] 
@@ -647,62 +691,63 @@ static enum xdftype get_xdfch_type(uint32_t gdf1type)
 
 
 /* \param bdf	pointer to a gdf1_file open for reading
- * \param file  stream associated to the file 
- *              (should be at the correct file position)
+ * \param hdr   header of the file loaded in memory (positioned at the
+ *              beginning of channel fields)
  *
  * Read all channels related field in the header and setup the channels
  * accordingly. set the channels for no scaling and inmemtype = infiletype
  */
-static int gdf1_read_channels_header(struct gdf1_file* gdf1, FILE* file)
+static int gdf1_read_channels_header(struct gdf1_file* gdf1,
+                                     struct hdrbuff* hdr)
 {
 	struct xdfch* ch;
 	int i;
 	unsigned int offset = 0;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf1ch(ch)->label, 16))
+		if (hread_string_field(hdr, get_gdf1ch(ch)->label, 16))
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf1ch(ch)->transducter, 80))
+		if (hread_string_field(hdr, get_gdf1ch(ch)->transducter, 80))
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf1ch(ch)->unit, 8))
+		if (hread_string_field(hdr, get_gdf1ch(ch)->unit, 8))
 			return -1;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
-		if (read64bval(file, 1, &(ch->physical_mm[0])))
+		if (hread64bval(hdr, 1, &(ch->physical_mm[0])))
 			return -1;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
-		if (read64bval(file, 1, &(ch->physical_mm[1])))
+		if (hread64bval(hdr, 1, &(ch->physical_mm[1])))
 			return -1;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		int64_t val;
-		if (read64bval(file, 1, &val))
+		if (hread64bval(hdr, 1, &val))
 			return -1;
 		ch->digital_mm[0] = val;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		int64_t val;
-		if (read64bval(file, 1, &val))
+		if (hread64bval(hdr, 1, &val))
 			return -1;
 		ch->digital_mm[1] = val;
 	}
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf1ch(ch)->prefiltering, 80))
+		if (hread_string_field(hdr, get_gdf1ch(ch)->prefiltering, 80))
 			return -1;
 
 	i = 0;
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		uint32_t val;
-		if (read32bval(file, 1, &val))
+		if (hread32bval(hdr, 1, &val))
 			return -1;
 		if (i++ == 0)
 			ch->owner->ns_per_rec = val;
@@ -717,7 +762,7 @@ static int gdf1_read_channels_header(struct gdf1_file* gdf1, FILE* file)
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next) {
 		uint32_t type;
 		int xdftype;
-		if (read32bval(file, 1, &(type)))
+		if (hread32bval(hdr, 1, &(type)))
 			return -1;
 		if ((xdftype = get_xdfch_type(type)) == -1) {
 			errno = EILSEQ;
@@ -731,7 +776,7 @@ static int gdf1_read_channels_header(struct gdf1_file* gdf1, FILE* file)
 	gdf1->xdf.filerec_size = offset*gdf1->xdf.ns_per_rec;
 
 	for (ch = gdf1->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf1ch(ch)->reserved, 32))
+		if (hread_string_field(hdr, get_gdf1ch(ch)->reserved, 32))
 			return -1;
 
 	return 0;
@@ -739,32 +784,47 @@ static int gdf1_read_channels_header(struct gdf1_file* gdf1, FILE* file)
 
 
 static 
-int gdf1_read_event_hdr(struct gdf1_file* gdf1, FILE* file,
-                       uint32_t* nevent, uint8_t* mode, double* fs)
+int gdf1_read_event_hdr(struct gdf1_file* gdf1)
 {
-	long flen, evt_sect; 
-	uint8_t fs24[8];
+	mm_off_t flen, evt_sect; 
+	uint8_t evthdr[4];
+	struct xdfstream* stream = &gdf1->xdf.io;
 
 	// Find the filesize
-	if (fseek(file, 0L, SEEK_END) || (flen = ftell(file))<0)
+	if ((flen = xdfstream_size(stream)) < 0)
 		return -1;
 
 	// Check if there is an event table
 	evt_sect = gdf1->xdf.hdr_offset + gdf1->xdf.nrecord*
 	                                       gdf1->xdf.filerec_size;
 	if ((gdf1->xdf.nrecord < 0) || (flen <= evt_sect)) {
-		*nevent = 0;
+		gdf1->evt_num = 0;
 		return 0;
 	} 
+	if (flen < evt_sect + 8) {
+		errno = EILSEQ;
+		return -1;
+	}
 
-	// Read event header
-	if (fseek(file, evt_sect, SEEK_SET)
-	  || read8bval(file, 1, mode)
-	  || read24bval(file, 1, fs24)
-	  || read32bval(file, 1, nevent))
+	// Read event header: mode, 24 bits little endian sampling frequency
+	// and number of events
+	if (pread8bval(stream, evt_sect, 4, evthdr)
+	  || pread32bval(stream, evt_sect+4, 1, &gdf1->evt_num))
 		return -1;
-	*fs = fs24[LSB24] + 256*fs24[1] + 65536*fs24[MSB24];
+	gdf1->evt_mode = evthdr[0];
+	gdf1->evt_fs = evthdr[1] + 256*evthdr[2] + 65536*evthdr[3];
+	gdf1->evt_sect = evt_sect;
+
+	// The event table must be complete (position and code of each event,
+	// plus 16 bits channel and duration in mode 3)
+	if ((flen - evt_sect - 8) / (gdf1->evt_mode == 3 ? 10 : 6)
+	       < (mm_off_t)gdf1->evt_num) {
+		errno = EILSEQ;
+		return -1;
+	}
 
+	// Events are decoded later from the file by gdf1_load_events()
+	gdf1->xdf.nevent_pending = gdf1->evt_num;
 	return 0;
 }
 
@@ -774,100 +834,128 @@ int gdf1_interpret_events(struct gdf1_file* gdf1, uint32_t nevent,
                          double fs, uint32_t *pos, uint16_t* code,
 			 uint16_t *channel, uint32_t* dur)
 {
-	unsigned int i;
-	int evttype;
+	unsigned int i, start, len;
+	int types[EVT_BLOCK];
+	double onsets[EVT_BLOCK], durations[EVT_BLOCK];
 	char desc[32];
-	struct xdfevent evt;
 
-	for (i=0; i<nevent; i++) {
-		if (channel[i])
-			snprintf(desc, sizeof(desc),
-			         "ch:%u", (unsigned int)(channel[i]));
-		else
-			strcpy(desc, "ch:all");
-		evttype = add_event_entry(gdf1->xdf.table, code[i], desc);
-		if (evttype < 0)
-			return -1;
+	// Convert the events by blocks, each field in its own loop
+	for (start=0; start<nevent; start+=len) {
+		len = nevent - start;
+		if (len > EVT_BLOCK)
+			len = EVT_BLOCK;
+
+		for (i=0; i<len; i++) {
+			if (channel[start+i])
+				snprintf(desc, sizeof(desc), "ch:%u",
+				         (unsigned int)(channel[start+i]));
+			else
+				strcpy(desc, "ch:all");
+			types[i] = add_event_entry(gdf1->xdf.table,
+			                           code[start+i], desc);
+			if (types[i] < 0)
+				return -1;
+		}
 
-		evt.onset = pos[i]/fs;
-		evt.duration = (dur == NULL) ? -1 : dur[i]/fs;
-		evt.evttype = evttype;
-		if (add_event(gdf1->xdf.table, &evt))
+		for (i=0; i<len; i++)
+			onsets[i] = pos[start+i]/fs;
+
+		for (i=0; i<len; i++)
+			durations[i] = (dur == NULL) ? -1 : dur[start+i]/fs;
+
+		if (add_events(gdf1->xdf.table, len, types, onsets, durations))
 			return -1;
 	}
 	return 0;
 }
 
 
-static
-int gdf1_read_event_table(struct gdf1_file* gdf1, FILE* file)
+
+/* \param xdf	pointer to an xdf file with XDF_READ mode
+ * \param nevent	number of events to decode
+ *
+ * GDF1 METHOD.
+ * Decode the @nevent events of the event section following the ones already
+ * in the event table. The fields are read by blocks of EVT_BLOCK events,
+ * without moving the file pointer: this may occur during a transfer.
+ */
+static int gdf1_load_events(struct xdf* xdf, unsigned int nevent)
 {
-	int retcode = 0;
-	uint8_t mode;
-	double fs;
-	uint32_t nevt, *onset = NULL, *dur = NULL;
-	uint16_t *code = NULL, *ch = NULL;
+	struct gdf1_file* gdf1 = get_gdf1(xdf);
+	uint32_t pos[EVT_BLOCK], dur[EVT_BLOCK];
+	uint16_t code[EVT_BLOCK], ch[EVT_BLOCK], dur16[EVT_BLOCK];
+	unsigned int i, start, end, len;
+	mm_off_t num = gdf1->evt_num;
+	mm_off_t off = gdf1->evt_sect + 8;
+	struct xdfstream* stream = &xdf->io;
+
+	start = xdf->table->nevent;
+	end = start + nevent;
+	for (; start < end; start += len) {
+		len = end - start;
+		if (len > EVT_BLOCK)
+			len = EVT_BLOCK;
+
+		// The section holds the array of each field one after the other
+		if (pread32bval(stream, off + 4*start, len, pos)
+		  || pread16bval(stream, off + 4*num + 2*start, len, code))
+			return -1;
 
-	if (gdf1_read_event_hdr(gdf1, file, &nevt, &mode, &fs))
-		return -1;
-	if (nevt == 0)
-		return 0;
-	
-	onset = calloc(nevt,sizeof(*onset));
-	code = calloc(nevt,sizeof(*code));
-	ch = calloc(nevt,sizeof(*ch));
-	dur = calloc(nevt,sizeof(*dur));
+		if (gdf1->evt_mode == 3) {
+			if (pread16bval(stream, off + 6*num + 2*start, len, ch)
+			  || pread16bval(stream, off + 8*num + 2*start,
+			                 len, dur16))
+				return -1;
+			for (i=0; i<len; i++)
+				dur[i] = dur16[i];
+		} else {
+			memset(ch, 0, len*sizeof(*ch));
+			memset(dur, 0, len*sizeof(*dur));
+		}
 
-	if (onset == NULL || code == NULL || ch == NULL || dur == NULL
-	  || read32bval(file, nevt, onset)
-	  || read16bval(file, nevt, code)
-	  || (mode == 3 && read16bval(file, nevt, ch))
-	  || (mode == 3 && read16bval(file, nevt, dur))
-	  || gdf1_interpret_events(gdf1, nevt, fs, onset, code, ch, dur))
-		retcode = -1;
+		if (gdf1_interpret_events(gdf1, len, gdf1->evt_fs,
+		                          pos, code, ch, dur))
+			return -1;
+	}
 
-	free(onset);
-	free(code);
-	free(ch);
-	free(dur);
-	return retcode;
+	return 0;
 }
 
 /* \param xdf	pointer to an xdf file with XDF_READ mode
  *
  * GDF1 METHOD.
  * Read the header and allocate the channels
- * It creates from the file a stream that will be used to easily interpret
- * and parse the header.
+ * The header is loaded in memory in two reads, the fixed part giving the
+ * size of the channel part, and then parsed from there.
  */
 static int gdf1_read_header(struct xdf* xdf)
 {
 	int retval = -1;
 	unsigned int i;
-	struct xdfch** curr = &(xdf->channels);
 	struct gdf1_file* gdf1 = get_gdf1(xdf);
-	FILE* file = fdopen(mm_dup(xdf->fd), "rb");
-	if (!file)
-		return -1;
+	struct hdrbuff hdr = {.data = NULL};
 
-	if (gdf1_read_file_header(gdf1, file))
+	if (hdrbuff_load(&hdr, &xdf->io, 256)
+	   || gdf1_read_file_header(gdf1, &hdr)
+	   || hdrbuff_load(&hdr, &xdf->io, (xdf->numch+1)*256))
 		goto exit;
 
-	// Allocate all the channels
+	// Allocate all the channels (from a single block)
+	if (xdf_reserve_channels(xdf, xdf->numch))
+		goto exit;
 	for (i=0; i<xdf->numch; i++) {
-		if (!(*curr = xdf_alloc_channel(xdf)))
+		if (xdf_alloc_channel(xdf) == NULL)
 			goto exit;
-		curr = &((*curr)->next);
 	}
 
-	if (gdf1_read_channels_header(gdf1, file)
-	   || gdf1_read_event_table(gdf1, file))
+	if (gdf1_read_channels_header(gdf1, &hdr)
+	   || (!xdf->header_only && gdf1_read_event_hdr(gdf1)))
 	   	goto exit;
 		
 	retval = 0;
 exit:
-	fclose(file);
-	mm_seek(xdf->fd, (xdf->numch+1)*256, SEEK_SET);
+	hdrbuff_free(&hdr);
+	xdf->io.pos = (xdf->numch+1)*256;
 	return retval;
 }
 
@@ -881,18 +969,16 @@ static int gdf1_complete_file(struct xdf* xdf)
 {
 	int retval = 0;
 	int64_t numrec = xdf->nrecord;
-	FILE* file = fdopen(mm_dup(xdf->fd), "wb");
-	long evt_sect = xdf->hdr_offset + xdf->nrecord*xdf->filerec_size;
+	struct hdrbuff hdr = {.data = NULL};
+	mm_off_t evt_sect = xdf->hdr_offset + xdf->nrecord*xdf->filerec_size;
 
 	// Write the event block and the number of records in the header
-	if (file == NULL
-	    || fseek(file, evt_sect, SEEK_SET)
-	    || gdf1_write_event_table(get_gdf1(xdf), file)
-	    || fseek(file, NUMREC_FIELD_LOC, SEEK_SET)
-	    || write64bval(file, 1, &numrec) 
-	    || fclose(file))
+	if (gdf1_write_event_table(get_gdf1(xdf), &hdr)
+	    || hdrbuff_store(&hdr, &xdf->io, evt_sect)
+	    || pwrite64bval(&xdf->io, NUMREC_FIELD_LOC, 1, &numrec))
 		retval = -1;
 
+	hdrbuff_free(&hdr);
 	return retval;
 }
 
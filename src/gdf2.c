@@ -52,6 +52,8 @@ static int gdf2_get_conf(const struct xdf*, enum xdffield,
 static int gdf2_write_header(struct xdf*);
 static int gdf2_read_header(struct xdf*);
 static int gdf2_complete_file(struct xdf*);
+static int gdf2_load_events(struct xdf*, unsigned int);
+static int gdf2_checkpoint(struct xdf*);
 
 // GDF2 channel structure
 struct gdf2_channel {
@@ -86,10 +88,19 @@ struct gdf2_file {
 	float gndpos[3];
 	uint64_t epid;
 	unsigned int version;
+	mm_off_t evt_sect;
+	uint32_t evt_num;
+	uint8_t evt_mode;
+	float evt_fs;
+	int checkpointed;
 };
 
 #define NUMREC_FIELD_LOC 236
 
+// The last 2 reserved bytes of the fixed header (at offset 254) flag a
+// recording whose number of records is the one of the last checkpoint
+static const char checkpoint_mark[2] = {'C', 'K'};
+
 #define get_gdf2(xdf_p) \
 	((struct gdf2_file*)(((char*)(xdf_p))-offsetof(struct gdf2_file, xdf)))
 #define get_gdf2ch(xdfch_p) 				\
@@ -338,6 +349,8 @@ static const struct format_operations gdf2_ops = {
 	.write_header = gdf2_write_header,
 	.read_header = gdf2_read_header,
 	.complete_file = gdf2_complete_file,
+	.load_events = gdf2_load_events,
+	.checkpoint = gdf2_checkpoint,
 	.type = XDF_GDF2,
 	.supported_type = {
 		[XDFUINT8] = true,
@@ -553,7 +566,20 @@ static int gdf2_set_conf(struct xdf* xdf, enum xdffield field,
 		copy_3dpos(gdf2->refpos, val.pos);
 	else if (field == XDF_F_GND_POS)
 		copy_3dpos(gdf2->gndpos, val.pos);
-	else
+	else if (field == XDF_F_EVT_MEMLIMIT) {
+		// Spilled events are read back from the event journal
+		if (val.i < 0 || xdf->evtjournal.fd < 0) {
+			errno = (val.i < 0) ? EINVAL : EPERM;
+			return -1;
+		}
+		xdf->evt_memlimit = val.i;
+	} else if (field == XDF_F_CHECKPOINT) {
+		if (val.i < 0) {
+			errno = EINVAL;
+			return -1;
+		}
+		xdf->checkpoint = val.i;
+	} else
 		retval = prevretval;
 
 	return retval;
@@ -609,6 +635,10 @@ static int gdf2_get_conf(const struct xdf* xdf, enum xdffield field,
 		copy_3dpos(val->pos, gdf2->refpos);
 	else if (field == XDF_F_GND_POS)
 		copy_3dpos(val->pos, gdf2->gndpos);
+	else if (field == XDF_F_EVT_MEMLIMIT)
+		val->i = xdf->evt_memlimit;
+	else if (field == XDF_F_CHECKPOINT)
+		val->i = xdf->checkpoint;
 	else
 		retval = prevretval;
 
@@ -629,13 +659,14 @@ static void convert_recduration(double len, uint32_t ratio[2])
 
 
 /* \param gdf2	pointer to a gdf2_file opened for writing
- * \param file  stream associated to the file 
- *              (should be positioned at the beginning of the file)
+ * \param hdr   header buffer formatting the file (positioned at its
+ *              beginning)
  *
  * Write the general GDF2 file header. Write -1 in the number of records
  * field. The real value is written after the transfer is finished
  */
-static int gdf2_write_file_header(struct gdf2_file* gdf2, FILE* file)
+static int gdf2_write_file_header(struct gdf2_file* gdf2,
+                                  struct hdrbuff* hdr)
 {
  	uint32_t recduration[2];
 	int64_t nrec = -1;
@@ -649,31 +680,31 @@ static int gdf2_write_file_header(struct gdf2_file* gdf2, FILE* file)
 
 	// Write data format identifier
 	snprintf(key, sizeof(key), "GDF 2.%02u", gdf2->version);
-	if (fwrite(key, 8, 1, file) < 1)
+	if (hwrite8bval(hdr, 8, key))
 		return -1;
 
 	// Write all the general file header
-	if ((fprintf(file, "%-66.66s", gdf2->subjstr) < 0)
-	   || write8bval(file, 10, reserved)
-	   || write8bval(file, 1, &(gdf2->addiction))
-	   || write8bval(file, 1, &(gdf2->weight))
-	   || write8bval(file, 1, &(gdf2->height))
-	   || write8bval(file, 1, &(gdf2->ghv))
-	   || (fprintf(file, "%-64.64s", gdf2->recstr) < 0)
-	   || write32bval(file, 4, gdf2->location)
-	   || write64bval(file, 1, &(gdf2->rectime))
-	   || write64bval(file, 1, &(gdf2->birthday))
-	   || write16bval(file, 1, &nhdr_blk)
-	   || (fwrite(gdf2->pclass, 6, 1, file) < 1)
-	   || write64bval(file, 1, &(gdf2->epid))
-	   || write8bval(file, 6, reserved)
-	   || write16bval(file, 3, gdf2->headsize)
-	   || write32bval(file, 3, gdf2->refpos)
-	   || write32bval(file, 3, gdf2->gndpos)
-	   || write64bval(file, 1, &nrec)
-	   || write32bval(file, 2, recduration)
-	   || write16bval(file, 1, &nch)
-	   || write8bval(file, 2, reserved))
+	if (hprintf(hdr, "%-66.66s", gdf2->subjstr)
+	   || hwrite8bval(hdr, 10, reserved)
+	   || hwrite8bval(hdr, 1, &(gdf2->addiction))
+	   || hwrite8bval(hdr, 1, &(gdf2->weight))
+	   || hwrite8bval(hdr, 1, &(gdf2->height))
+	   || hwrite8bval(hdr, 1, &(gdf2->ghv))
+	   || hprintf(hdr, "%-64.64s", gdf2->recstr)
+	   || hwrite32bval(hdr, 4, gdf2->location)
+	   || hwrite64bval(hdr, 1, &(gdf2->rectime))
+	   || hwrite64bval(hdr, 1, &(gdf2->birthday))
+	   || hwrite16bval(hdr, 1, &nhdr_blk)
+	   || hwrite8bval(hdr, 6, gdf2->pclass)
+	   || hwrite64bval(hdr, 1, &(gdf2->epid))
+	   || hwrite8bval(hdr, 6, reserved)
+	   || hwrite16bval(hdr, 3, gdf2->headsize)
+	   || hwrite32bval(hdr, 3, gdf2->refpos)
+	   || hwrite32bval(hdr, 3, gdf2->gndpos)
+	   || hwrite64bval(hdr, 1, &nrec)
+	   || hwrite32bval(hdr, 2, recduration)
+	   || hwrite16bval(hdr, 1, &nch)
+	   || hwrite8bval(hdr, 2, reserved))
 		return -1;
 	
 	gdf2->xdf.hdr_offset = 256*nhdr_blk;
@@ -681,85 +712,86 @@ static int gdf2_write_file_header(struct gdf2_file* gdf2, FILE* file)
 }
 
 /* \param bdf	pointer to a gdf2_file opened for writing
- * \param file  stream associated to the file 
- *              (should be positioned at the beginning of channel fields)
+ * \param hdr   header buffer formatting the file (positioned at the
+ *              beginning of channel fields)
  *
  * Write the GDF2 channels related fields in the header.
  */
-static int gdf2_write_channels_header(struct gdf2_file* gdf2, FILE* file)
+static int gdf2_write_channels_header(struct gdf2_file* gdf2,
+                                      struct hdrbuff* hdr)
 {
 	struct xdfch* ch;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-16.16s", get_gdf2ch(ch)->label) < 0)
+		if (hprintf(hdr, "%-16.16s", get_gdf2ch(ch)->label) < 0)
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-80.80s", get_gdf2ch(ch)->transducter)<0)
+		if (hprintf(hdr, "%-80.80s", get_gdf2ch(ch)->transducter)<0)
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-6.6s", get_gdf2ch(ch)->unit) < 0)
+		if (hprintf(hdr, "%-6.6s", get_gdf2ch(ch)->unit) < 0)
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write16bval(file, 1, &(get_gdf2ch(ch)->dimcode)))
+		if (hwrite16bval(hdr, 1, &(get_gdf2ch(ch)->dimcode)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write64bval(file, 1, &(ch->physical_mm[0])))
+		if (hwrite64bval(hdr, 1, &(ch->physical_mm[0])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write64bval(file, 1, &(ch->physical_mm[1])))
+		if (hwrite64bval(hdr, 1, &(ch->physical_mm[1])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write64bval(file, 1, &(ch->digital_mm[0])))
+		if (hwrite64bval(hdr, 1, &(ch->digital_mm[0])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write64bval(file, 1, &(ch->digital_mm[1])))
+		if (hwrite64bval(hdr, 1, &(ch->digital_mm[1])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-68.68s", get_gdf2ch(ch)->filtering) < 0)
+		if (hprintf(hdr, "%-68.68s", get_gdf2ch(ch)->filtering) < 0)
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write32bval(file, 1, &(get_gdf2ch(ch)->lp)))
+		if (hwrite32bval(hdr, 1, &(get_gdf2ch(ch)->lp)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write32bval(file, 1, &(get_gdf2ch(ch)->hp)))
+		if (hwrite32bval(hdr, 1, &(get_gdf2ch(ch)->hp)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (write32bval(file, 1, &(get_gdf2ch(ch)->sp)))
+		if (hwrite32bval(hdr, 1, &(get_gdf2ch(ch)->sp)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) {
 		int32_t nsprec = gdf2->xdf.ns_per_rec;
-		if (write32bval(file, 1, &nsprec))
+		if (hwrite32bval(hdr, 1, &nsprec))
 			return -1;
 	}
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) {
 		int32_t type = gdf2_types[ch->infiletype];
-		if (write32bval(file, 1, &type))
+		if (hwrite32bval(hdr, 1, &type))
 			return -1;
 	}
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (write32bval(file, 3, get_gdf2ch(ch)->pos))
+		if (hwrite32bval(hdr, 3, get_gdf2ch(ch)->pos))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (write8bval(file, 1, &(get_gdf2ch(ch)->impedance)))
+		if (hwrite8bval(hdr, 1, &(get_gdf2ch(ch)->impedance)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (fprintf(file, "%-19.19s", get_gdf2ch(ch)->reserved) < 0)
+		if (hprintf(hdr, "%-19.19s", get_gdf2ch(ch)->reserved) < 0)
 			return -1;
 
 	return 0;
@@ -770,144 +802,262 @@ static int gdf2_write_channels_header(struct gdf2_file* gdf2, FILE* file)
  *
  * GDF2 METHOD.
  * Write the general file header and channels fields
- * It creates from the file a stream that will be used to easily format
- * the header fields.
+ * The header is formatted in memory and then written in one go.
  */
 static int gdf2_write_header(struct xdf* xdf)
 {
 	int retval = 0;
 	struct gdf2_file* gdf2 = get_gdf2(xdf);
-	FILE* file = fdopen(mm_dup(xdf->fd), "wb");
-	if (!file)
-		return -1;
+	struct hdrbuff hdr = {.data = NULL};
 
 	// Write file header each field of all channels
-	if ( gdf2_write_file_header(gdf2, file)
-	    || gdf2_write_channels_header(gdf2, file) )
-		retval = -1;
-
-	if (fflush(file) || fclose(file))
+	if ( gdf2_write_file_header(gdf2, &hdr)
+	    || gdf2_write_channels_header(gdf2, &hdr)
+	    || hdrbuff_store(&hdr, &xdf->io, 0) )
 		retval = -1;
 
-	mm_seek(xdf->fd, xdf->hdr_offset, SEEK_SET);
+	hdrbuff_free(&hdr);
+	xdf->io.pos = xdf->hdr_offset;
 
 	return retval;
 }
 
 
+/* \param table	table of events
+ * \param entry_code	array receiving the code of each event type
+ * \param entry_ch	array receiving the channel of each event type
+ *
+ * Code and channel are the same for all events of a type: interpret the
+ * description once per event type.
+ */
 static
-int gdf2_setup_events(struct eventtable* table, double fs, uint8_t* mode,
-                     uint32_t *pos, uint16_t* code,
-		     uint16_t *ch, uint32_t* dur)
+void gdf2_setup_entries(struct eventtable* table, uint16_t* entry_code,
+                        uint16_t* entry_ch)
 {
-	unsigned int i, nevent = table->nevent;
-	int codeval, use_extevt = 0;
-	unsigned int chval;
+	unsigned int i, chval;
+	int codeval;
 	const char* desc;
-	struct xdfevent* evt;
 
-	for (i=0; i<nevent; i++) {
-		evt = get_event(table, i);
-		pos[i] = fs * evt->onset;
-		if (evt->duration > 0) {
-			dur[i] = fs * evt->duration;
+	for (i=0; i<table->nentry; i++) {
+		get_event_entry(table, i, &codeval, &desc);
+		entry_code[i] = codeval;
+		if (desc != NULL && sscanf(desc, "ch:%u", &chval) >= 1)
+			entry_ch[i] = chval;
+		else
+			entry_ch[i] = 0;
+	}
+}
+
+
+/* \param gdf2	pointer to a gdf2_file opened for writing
+ * \param start	index of the first event to get
+ * \param len	number of events to get (at most EVT_BLOCK)
+ * \param types	array receiving the types of the events
+ * \param onsets	array receiving the onsets of the events
+ * \param durations	array receiving the durations of the events
+ *
+ * Get a block of events from the table of events or, if some events have
+ * been spilled, from the event journal which holds all of them.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int gdf2_fetch_events(struct gdf2_file* gdf2, unsigned int start,
+                      unsigned int len, unsigned int* types,
+                      double* onsets, double* durations)
+{
+	struct xdfevent evts[EVT_BLOCK];
+	unsigned int i;
+
+	if (gdf2->xdf.table->nspilled == 0) {
+		get_events(gdf2->xdf.table, start, len,
+		           types, onsets, durations);
+		return 0;
+	}
+
+	if (xdf_read_journal_events(&gdf2->xdf, start, len, evts))
+		return -1;
+
+	for (i=0; i<len; i++) {
+		types[i] = evts[i].evttype;
+		onsets[i] = evts[i].onset;
+		durations[i] = evts[i].duration;
+	}
+
+	return 0;
+}
+
+
+/* \param gdf2	pointer to a gdf2_file opened for writing
+ * \param start	index of the first event to convert
+ * \param len	number of events to convert (at most EVT_BLOCK)
+ * \param fs	sampling frequency
+ * \param entry_code	code of each event type
+ * \param entry_ch	channel of each event type
+ * \param pos, code, ch, dur	arrays receiving the fields of the events
+ *
+ * Convert a block of events into the fields of the GDF2 event table, each
+ * field in its own loop.
+ *
+ * Returns 1 if the events need the extended event table (mode 3), 0 if
+ * not, -1 in case of error.
+ */
+static
+int gdf2_setup_events(struct gdf2_file* gdf2, unsigned int start,
+                      unsigned int len, double fs,
+                      const uint16_t* entry_code, const uint16_t* entry_ch,
+                      uint32_t *pos, uint16_t* code,
+                      uint16_t *ch, uint32_t* dur)
+{
+	unsigned int i, types[EVT_BLOCK];
+	double onsets[EVT_BLOCK], durations[EVT_BLOCK];
+	int use_extevt = 0;
+
+	if (gdf2_fetch_events(gdf2, start, len, types, onsets, durations))
+		return -1;
+
+	for (i=0; i<len; i++)
+		pos[i] = fs * onsets[i];
+
+	for (i=0; i<len; i++) {
+		if (durations[i] > 0) {
+			dur[i] = fs * durations[i];
 			use_extevt = 1;
 		} else
 			dur[i] = 0;
-		get_event_entry(table, evt->evttype, &codeval, &desc);
-		code[i] = codeval;
-		ch[i] = 0;
-		if (desc != NULL && sscanf(desc, "ch:%u", &chval) >= 1) {
-			ch[i] = chval;
+	}
+
+	for (i=0; i<len; i++) {
+		code[i] = entry_code[types[i]];
+		ch[i] = entry_ch[types[i]];
+		if (ch[i])
 			use_extevt = 1;
-		} else
-			ch[i] = 0;
 	}
-	*mode = use_extevt ? 3 : 1;
-	return 0;
+
+	return use_extevt;
 }
 
 
+/* \param gdf2	pointer to a gdf2_file opened for writing
+ * \param evt_sect	offset of the event section in the file
+ *
+ * Write the event table by blocks of EVT_BLOCK events, so that the memory
+ * needed does not depend on the number of events: this allows to write
+ * events that have been spilled to the event journal. A first pass
+ * determines whether the extended event table is needed, then each block
+ * is written at its place in the array of each field.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
 static
-int gdf2_write_event_table(struct gdf2_file* gdf2, FILE* file)
+int gdf2_write_event_table(struct gdf2_file* gdf2, mm_off_t evt_sect)
 {
 	struct eventtable* table = gdf2->xdf.table;
-	int retcode = 0;
-	uint32_t nevt = table->nevent;
-	uint8_t mode, nevt24[3];
+	struct xdfstream* stream = &gdf2->xdf.io;
+	int retcode = 0, extevt;
+	uint32_t nevt = table->nspilled + table->nevent;
+	uint8_t mode = 1, evthdr[4];
 	float fs = (float)gdf2->xdf.ns_per_rec/(float)gdf2->xdf.rec_duration;
-	uint32_t *onset = NULL, *dur = NULL;
-	uint16_t *code = NULL, *ch = NULL;
+	uint32_t pos[EVT_BLOCK], dur[EVT_BLOCK];
+	uint16_t code[EVT_BLOCK], ch[EVT_BLOCK];
+	uint16_t *entry_code, *entry_ch;
+	unsigned int start, len;
+	mm_off_t off = evt_sect + 8;
 
 	if (nevt == 0)
 		return 0;
 
-	nevt24[LSB24] = nevt & 0x000000FF;
-	nevt24[    1] = (nevt & 0x0000FF00) / 256;
-	nevt24[MSB24] = (nevt & 0x00FF0000) / 65536;
-	
-	onset = malloc(nevt*sizeof(*onset));
-	code = malloc(nevt*sizeof(*code));
-	ch = malloc(nevt*sizeof(*ch));
-	dur = malloc(nevt*sizeof(*dur));
-	if (onset == NULL || code == NULL || ch == NULL || dur == NULL)
+	entry_code = malloc(table->nentry*sizeof(*entry_code));
+	entry_ch = malloc(table->nentry*sizeof(*entry_ch));
+	if (entry_code == NULL || entry_ch == NULL) {
 		retcode = -1;
+		goto exit;
+	}
+	gdf2_setup_entries(table, entry_code, entry_ch);
+
+	for (start=0; start<nevt && mode == 1; start+=len) {
+		len = (nevt-start > EVT_BLOCK) ? EVT_BLOCK : nevt-start;
+		extevt = gdf2_setup_events(gdf2, start, len, fs, entry_code,
+		                           entry_ch, pos, code, ch, dur);
+		if (extevt < 0) {
+			retcode = -1;
+			goto exit;
+		}
+		if (extevt)
+			mode = 3;
+	}
 
-	gdf2_setup_events(table, fs, &mode, onset, code, ch, dur);
-
-	if (retcode
-	  || write8bval(file, 1, &mode)
-	  || write24bval(file, 1, nevt24)
-	  || write32bval(file, 1, &fs)
-	  || write32bval(file, nevt, onset)
-	  || write16bval(file, nevt, code)
-	  || (mode == 3 && write16bval(file, nevt, ch))
-	  || (mode == 3 && write32bval(file, nevt, dur)))
+	// Event header: mode, 24 bits little endian number of events and
+	// sampling frequency
+	evthdr[0] = mode;
+	evthdr[1] = nevt & 0x000000FF;
+	evthdr[2] = (nevt & 0x0000FF00) / 256;
+	evthdr[3] = (nevt & 0x00FF0000) / 65536;
+	if (pwrite8bval(stream, evt_sect, 4, evthdr)
+	  || pwrite32bval(stream, evt_sect+4, 1, &fs)) {
 		retcode = -1;
+		goto exit;
+	}
+
+	for (start=0; start<nevt; start+=len) {
+		len = (nevt-start > EVT_BLOCK) ? EVT_BLOCK : nevt-start;
+		if (gdf2_setup_events(gdf2, start, len, fs, entry_code,
+		                      entry_ch, pos, code, ch, dur) < 0
+		  || pwrite32bval(stream, off + 4*start, len, pos)
+		  || pwrite16bval(stream, off + 4*nevt + 2*start, len, code)
+		  || (mode == 3
+		     && (pwrite16bval(stream, off + 6*nevt + 2*start,
+		                      len, ch)
+		        || pwrite32bval(stream, off + 8*nevt + 4*start,
+		                        len, dur)))) {
+			retcode = -1;
+			break;
+		}
+	}
 
-	free(onset);
-	free(code);
-	free(ch);
-	free(dur);
+exit:
+	free(entry_code);
+	free(entry_ch);
 	return retcode;
 }
 
 
 /* \param bdf	pointer to a gdf2_file open for reading
- * \param file  stream associated to the file 
- *              (should be at the beginning of the file)
+ * \param hdr   header of the file loaded in memory
  *
  * Read the general GDF2 file header
  */
-static int gdf2_read_file_header(struct gdf2_file* gdf2, FILE* file)
+static int gdf2_read_file_header(struct gdf2_file* gdf2,
+                                 struct hdrbuff* hdr)
 {
 	uint32_t recduration[2];
 	uint16_t nch, nhdr_blk;
 	int64_t nrec;
-
-	fseek(file, 8, SEEK_SET);
-
-	if (read_string_field(file, gdf2->subjstr, 66)
-	   || fseek(file, 10, SEEK_CUR)
-	   || read8bval(file, 1, &(gdf2->addiction))
-	   || read8bval(file, 1, &(gdf2->weight))
-	   || read8bval(file, 1, &(gdf2->height))
-	   || read8bval(file, 1, &(gdf2->ghv))
-	   || read_string_field(file, gdf2->recstr, 64)
-	   || read32bval(file, 4, gdf2->location)
-	   || read64bval(file, 1, &(gdf2->rectime))
-	   || read64bval(file, 1, &(gdf2->birthday))
-	   || read16bval(file, 1, &nhdr_blk)
-	   || (fread(gdf2->pclass, 6, 1, file) < 1)
-	   || read64bval(file, 1, &(gdf2->epid))
-	   || fseek(file, 6, SEEK_CUR)
-	   || read16bval(file, 3, gdf2->headsize)
-	   || read32bval(file, 3, gdf2->refpos)
-	   || read32bval(file, 3, gdf2->gndpos)
-	   || read64bval(file, 1, &nrec)
-	   || read32bval(file, 2, recduration)
-	   || read16bval(file, 1, &nch)
-	   || fseek(file, 2, SEEK_CUR))
+	char mark[2];
+
+	hdr->pos = 8;
+
+	if (hread_string_field(hdr, gdf2->subjstr, 66)
+	   || hskip(hdr, 10)
+	   || hread8bval(hdr, 1, &(gdf2->addiction))
+	   || hread8bval(hdr, 1, &(gdf2->weight))
+	   || hread8bval(hdr, 1, &(gdf2->height))
+	   || hread8bval(hdr, 1, &(gdf2->ghv))
+	   || hread_string_field(hdr, gdf2->recstr, 64)
+	   || hread32bval(hdr, 4, gdf2->location)
+	   || hread64bval(hdr, 1, &(gdf2->rectime))
+	   || hread64bval(hdr, 1, &(gdf2->birthday))
+	   || hread16bval(hdr, 1, &nhdr_blk)
+	   || hread8bval(hdr, 6, gdf2->pclass)
+	   || hread64bval(hdr, 1, &(gdf2->epid))
+	   || hskip(hdr, 6)
+	   || hread16bval(hdr, 3, gdf2->headsize)
+	   || hread32bval(hdr, 3, gdf2->refpos)
+	   || hread32bval(hdr, 3, gdf2->gndpos)
+	   || hread64bval(hdr, 1, &nrec)
+	   || hread32bval(hdr, 2, recduration)
+	   || hread16bval(hdr, 1, &nch)
+	   || hread8bval(hdr, 2, mark))
 		return -1;
 	   
 	gdf2->xdf.rec_duration = (double)recduration[0] 
@@ -915,6 +1065,7 @@ static int gdf2_read_file_header(struct gdf2_file* gdf2, FILE* file)
 	gdf2->xdf.hdr_offset = nhdr_blk*256;
 	gdf2->xdf.nrecord = nrec;
 	gdf2->xdf.numch = nch;
+	gdf2->checkpointed = !memcmp(mark, checkpoint_mark, sizeof(mark));
 
 
 	return 0;
@@ -939,70 +1090,71 @@ static enum xdftype get_xdfch_type(uint32_t gdf2type)
 
 
 /* \param bdf	pointer to a gdf2_file open for reading
- * \param file  stream associated to the file 
- *              (should be at the correct file position)
+ * \param hdr   header of the file loaded in memory
+ *              (positioned at the beginning of the channel fields)
  *
  * Read all channels related field in the header and setup the channels
  * accordingly. set the channels for no scaling and inmemtype = infiletype
  */
-static int gdf2_read_channels_header(struct gdf2_file* gdf2, FILE* file)
+static int gdf2_read_channels_header(struct gdf2_file* gdf2,
+                                     struct hdrbuff* hdr)
 {
 	struct xdfch* ch;
 	int i;
 	unsigned int offset = 0;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf2ch(ch)->label, 16))
+		if (hread_string_field(hdr, get_gdf2ch(ch)->label, 16))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf2ch(ch)->transducter,80))
+		if (hread_string_field(hdr, get_gdf2ch(ch)->transducter,80))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf2ch(ch)->unit, 6))
+		if (hread_string_field(hdr, get_gdf2ch(ch)->unit, 6))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read16bval(file, 1, &(get_gdf2ch(ch)->dimcode)))
+		if (hread16bval(hdr, 1, &(get_gdf2ch(ch)->dimcode)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (read64bval(file, 1, &(ch->physical_mm[0])))
+		if (hread64bval(hdr, 1, &(ch->physical_mm[0])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (read64bval(file, 1, &(ch->physical_mm[1])))
+		if (hread64bval(hdr, 1, &(ch->physical_mm[1])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (read64bval(file, 1, &(ch->digital_mm[0])))
+		if (hread64bval(hdr, 1, &(ch->digital_mm[0])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (read64bval(file, 1, &(ch->digital_mm[1])))
+		if (hread64bval(hdr, 1, &(ch->digital_mm[1])))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf2ch(ch)->filtering, 68))
+		if (hread_string_field(hdr, get_gdf2ch(ch)->filtering, 68))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read32bval(file, 1, &(get_gdf2ch(ch)->lp)))
+		if (hread32bval(hdr, 1, &(get_gdf2ch(ch)->lp)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read32bval(file, 1, &(get_gdf2ch(ch)->hp)))
+		if (hread32bval(hdr, 1, &(get_gdf2ch(ch)->hp)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read32bval(file, 1, &(get_gdf2ch(ch)->sp)))
+		if (hread32bval(hdr, 1, &(get_gdf2ch(ch)->sp)))
 			return -1;
 
 	i = 0;
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) {
 		uint32_t val;
-		if (read32bval(file, 1, &val))
+		if (hread32bval(hdr, 1, &val))
 			return -1;
 		if (i++ == 0)
 			ch->owner->ns_per_rec = val;
@@ -1017,7 +1169,7 @@ static int gdf2_read_channels_header(struct gdf2_file* gdf2, FILE* file)
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) {
 		uint32_t type;
 		int xdftype;
-		if (read32bval(file, 1, &(type)))
+		if (hread32bval(hdr, 1, &(type)))
 			return -1;
 		if ((xdftype = get_xdfch_type(type)) == -1) {
 			errno = EILSEQ;
@@ -1031,15 +1183,15 @@ static int gdf2_read_channels_header(struct gdf2_file* gdf2, FILE* file)
 	gdf2->xdf.filerec_size = offset*gdf2->xdf.ns_per_rec;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (read32bval(file, 3, get_gdf2ch(ch)->pos))
+		if (hread32bval(hdr, 3, get_gdf2ch(ch)->pos))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next) 
-		if (read8bval(file, 1, &(get_gdf2ch(ch)->impedance)))
+		if (hread8bval(hdr, 1, &(get_gdf2ch(ch)->impedance)))
 			return -1;
 
 	for (ch = gdf2->xdf.channels; ch != NULL; ch = ch->next)
-		if (read_string_field(file, get_gdf2ch(ch)->reserved, 19))
+		if (hread_string_field(hdr, get_gdf2ch(ch)->reserved, 19))
 			return -1;
 
 	return 0;
@@ -1047,32 +1199,49 @@ static int gdf2_read_channels_header(struct gdf2_file* gdf2, FILE* file)
 
 
 static 
-int gdf2_read_event_hdr(struct gdf2_file* gdf2, FILE* file,
-                       uint32_t* nevent, uint8_t* mode, float* fs)
+int gdf2_read_event_hdr(struct gdf2_file* gdf2)
 {
-	long flen, evt_sect; 
-	uint8_t nevt24[3];
+	mm_off_t flen, evt_sect; 
+	uint8_t evthdr[4];
+	struct xdfstream* stream = &gdf2->xdf.io;
 
 	// Find the filesize
-	if (fseek(file, 0L, SEEK_END) || (flen = ftell(file))<0)
+	if ((flen = xdfstream_size(stream)) < 0)
 		return -1;
 
-	// Check if there is an event table
+	// Check if there is an event table. If the recording has been
+	// interrupted after a checkpoint, records follow instead of it
 	evt_sect = gdf2->xdf.hdr_offset + gdf2->xdf.nrecord*
 	                                       gdf2->xdf.filerec_size;
-	if ((gdf2->xdf.nrecord < 0) || (flen <= evt_sect)) {
-		*nevent = 0;
+	if ((gdf2->xdf.nrecord < 0) || gdf2->checkpointed
+	   || (flen <= evt_sect)) {
+		gdf2->evt_num = 0;
 		return 0;
 	} 
+	if (flen < evt_sect + 8) {
+		errno = EILSEQ;
+		return -1;
+	}
 
-	// Read event header
-	if (fseek(file, evt_sect, SEEK_SET)
-	  || read8bval(file, 1, mode)
-	  || read24bval(file, 1, nevt24)
-	  || read32bval(file, 1, fs))
+	// Read event header: mode, 24 bits little endian number of events
+	// and sampling frequency
+	if (pread8bval(stream, evt_sect, 4, evthdr)
+	  || pread32bval(stream, evt_sect+4, 1, &gdf2->evt_fs))
 		return -1;
-	*nevent = nevt24[LSB24] + 256*nevt24[1] + 65536*nevt24[MSB24];
+	gdf2->evt_mode = evthdr[0];
+	gdf2->evt_num = evthdr[1] + 256*evthdr[2] + 65536*evthdr[3];
+	gdf2->evt_sect = evt_sect;
+
+	// The event table must be complete
+	if (((gdf2->evt_mode != 1) && (gdf2->evt_mode != 3))
+	   || ((flen - evt_sect - 8) / (gdf2->evt_mode == 3 ? 12 : 6)
+	       < (mm_off_t)gdf2->evt_num)) {
+		errno = EILSEQ;
+		return -1;
+	}
 
+	// Events are decoded later from the file by gdf2_load_events()
+	gdf2->xdf.nevent_pending = gdf2->evt_num;
 	return 0;
 }
 
@@ -1082,100 +1251,157 @@ int gdf2_interpret_events(struct gdf2_file* gdf2, uint32_t nevent,
                          double fs, uint32_t *pos, uint16_t* code,
 			 uint16_t *channel, uint32_t* dur)
 {
-	unsigned int i;
-	int evttype;
+	unsigned int i, start, len;
+	int types[EVT_BLOCK];
+	double onsets[EVT_BLOCK], durations[EVT_BLOCK];
 	char desc[32];
-	struct xdfevent evt;
 
-	for (i=0; i<nevent; i++) {
-		if (channel[i])
-			snprintf(desc, sizeof(desc),
-			         "ch:%u", (unsigned int)(channel[i]));
-		else
-			strcpy(desc, "ch:all");
-		evttype = add_event_entry(gdf2->xdf.table, code[i], desc);
-		if (evttype < 0)
-			return -1;
+	// Convert the events by blocks, each field in its own loop
+	for (start=0; start<nevent; start+=len) {
+		len = nevent - start;
+		if (len > EVT_BLOCK)
+			len = EVT_BLOCK;
+
+		for (i=0; i<len; i++) {
+			if (channel[start+i])
+				snprintf(desc, sizeof(desc), "ch:%u",
+				         (unsigned int)(channel[start+i]));
+			else
+				strcpy(desc, "ch:all");
+			types[i] = add_event_entry(gdf2->xdf.table,
+			                           code[start+i], desc);
+			if (types[i] < 0)
+				return -1;
+		}
+
+		for (i=0; i<len; i++)
+			onsets[i] = pos[start+i]/fs;
+
+		for (i=0; i<len; i++)
+			durations[i] = (dur == NULL) ? -1 : dur[start+i]/fs;
 
-		evt.onset = pos[i]/fs;
-		evt.duration = (dur == NULL) ? -1 : dur[i]/fs;
-		evt.evttype = evttype;
-		if (add_event(gdf2->xdf.table, &evt))
+		if (add_events(gdf2->xdf.table, len, types, onsets, durations))
 			return -1;
 	}
 	return 0;
 }
 
 
-static
-int gdf2_read_event_table(struct gdf2_file* gdf2, FILE* file)
+
+/* \param xdf	pointer to an xdf file with XDF_READ mode
+ * \param nevent	number of events to decode
+ *
+ * GDF2 METHOD.
+ * Decode the @nevent events of the event section following the ones already
+ * in the event table. The fields are read by blocks of EVT_BLOCK events,
+ * without moving the file pointer: this may occur during a transfer.
+ */
+static int gdf2_load_events(struct xdf* xdf, unsigned int nevent)
 {
-	int retcode = 0;
-	uint8_t mode;
-	float fs;
-	uint32_t nevt, *onset = NULL, *dur = NULL;
-	uint16_t *code = NULL, *ch = NULL;
+	struct gdf2_file* gdf2 = get_gdf2(xdf);
+	uint32_t pos[EVT_BLOCK], dur[EVT_BLOCK];
+	uint16_t code[EVT_BLOCK], ch[EVT_BLOCK];
+	unsigned int start, end, len;
+	mm_off_t num = gdf2->evt_num;
+	mm_off_t off = gdf2->evt_sect + 8;
+	struct xdfstream* stream = &xdf->io;
+
+	start = xdf->table->nevent;
+	end = start + nevent;
+	for (; start < end; start += len) {
+		len = end - start;
+		if (len > EVT_BLOCK)
+			len = EVT_BLOCK;
+
+		// The section holds the array of each field one after the other
+		if (pread32bval(stream, off + 4*start, len, pos)
+		  || pread16bval(stream, off + 4*num + 2*start, len, code))
+			return -1;
 
-	if (gdf2_read_event_hdr(gdf2, file, &nevt, &mode, &fs))
-		return -1;
-	if (nevt == 0)
-		return 0;
-	
-	onset = calloc(nevt, sizeof(*onset));
-	code = calloc(nevt, sizeof(*code));
-	ch = calloc(nevt, sizeof(*ch));
-	dur = calloc(nevt, sizeof(*dur));
-
-	if (onset == NULL || code == NULL || ch == NULL || dur == NULL
-	  || read32bval(file, nevt, onset)
-	  || read16bval(file, nevt, code)
-	  || (mode == 3 && read16bval(file, nevt, ch))
-	  || (mode == 3 && read16bval(file, nevt, dur))
-	  || gdf2_interpret_events(gdf2, nevt, fs, onset, code, ch, dur))
-		retcode = -1;
+		if (gdf2->evt_mode == 3) {
+			if (pread16bval(stream, off + 6*num + 2*start, len, ch)
+			  || pread32bval(stream, off + 8*num + 4*start,
+			                 len, dur))
+				return -1;
+		} else {
+			memset(ch, 0, len*sizeof(*ch));
+			memset(dur, 0, len*sizeof(*dur));
+		}
 
-	free(onset);
-	free(code);
-	free(ch);
-	free(dur);
-	return retcode;
+		if (gdf2_interpret_events(gdf2, len, gdf2->evt_fs,
+		                          pos, code, ch, dur))
+			return -1;
+	}
+
+	return 0;
 }
 
 /* \param xdf	pointer to an xdf file with XDF_READ mode
  *
  * GDF2 METHOD.
  * Read the header and allocate the channels
- * It creates from the file a stream that will be used to easily interpret
- * and parse the header.
+ * The header is loaded in memory in two reads, the fixed part giving the
+ * size of the channel part, and then parsed from there.
  */
 static int gdf2_read_header(struct xdf* xdf)
 {
 	int retval = -1;
 	unsigned int i;
-	struct xdfch** curr = &(xdf->channels);
 	struct gdf2_file* gdf2 = get_gdf2(xdf);
-	FILE* file = fdopen(mm_dup(xdf->fd), "rb");
-	if (!file)
-		return -1;
+	struct hdrbuff hdr = {.data = NULL};
 
-	if (gdf2_read_file_header(gdf2, file))
+	if (hdrbuff_load(&hdr, &xdf->io, 256)
+	   || gdf2_read_file_header(gdf2, &hdr)
+	   || hdrbuff_load(&hdr, &xdf->io, (xdf->numch+1)*256))
 		goto exit;
 
-	// Allocate all the channels
+	// Allocate all the channels (from a single block)
+	if (xdf_reserve_channels(xdf, xdf->numch))
+		goto exit;
 	for (i=0; i<xdf->numch; i++) {
-		if (!(*curr = xdf_alloc_channel(xdf)))
+		if (xdf_alloc_channel(xdf) == NULL)
 			goto exit;
-		curr = &((*curr)->next);
 	}
 
-	if (gdf2_read_channels_header(gdf2, file)
-	   || gdf2_read_event_table(gdf2, file))
+	if (gdf2_read_channels_header(gdf2, &hdr)
+	   || (!xdf->header_only && gdf2_read_event_hdr(gdf2)))
 	   	goto exit;
 		
 	retval = 0;
 exit:
-	fclose(file);
-	mm_seek(xdf->fd, (xdf->numch+1)*256, SEEK_SET);
+	hdrbuff_free(&hdr);
+	xdf->io.pos = (xdf->numch+1)*256;
+	return retval;
+}
+
+
+/* \param xdf	pointer to an xdf file with XDF_WRITE mode
+ * \param mark	content of the checkpoint field
+ *
+ * Write the number of records written so far in the header along with the
+ * checkpoint field, in a single write of the end of the fixed header: the
+ * number of records and the flag telling whether it is final are never
+ * seen out of sync.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static int gdf2_write_numrec(struct xdf* xdf, const char* mark)
+{
+	int retval = 0;
+	int64_t numrec = xdf->nrecord;
+	uint32_t recduration[2];
+	uint16_t nch = xdf->numch;
+	struct hdrbuff hdr = {.data = NULL};
+
+	convert_recduration(xdf->rec_duration, recduration);
+	if (hwrite64bval(&hdr, 1, &numrec)
+	    || hwrite32bval(&hdr, 2, recduration)
+	    || hwrite16bval(&hdr, 1, &nch)
+	    || hwrite8bval(&hdr, 2, mark)
+	    || hdrbuff_store(&hdr, &xdf->io, NUMREC_FIELD_LOC))
+		retval = -1;
+
+	hdrbuff_free(&hdr);
 	return retval;
 }
 
@@ -1188,19 +1414,27 @@ exit:
 static int gdf2_complete_file(struct xdf* xdf)
 {
 	int retval = 0;
-	int64_t numrec = xdf->nrecord;
-	FILE* file = fdopen(mm_dup(xdf->fd), "wb");
-	long evt_sect = xdf->hdr_offset + xdf->nrecord*xdf->filerec_size;
-
-	// Write the event block and the number of records in the header
-	if (file == NULL
-	    || fseek(file, evt_sect, SEEK_SET)
-	    || gdf2_write_event_table(get_gdf2(xdf), file)
-	    || fseek(file, NUMREC_FIELD_LOC, SEEK_SET)
-	    || write64bval(file, 1, &numrec)
-	    || fclose(file))
+	mm_off_t evt_sect = xdf->hdr_offset + xdf->nrecord*xdf->filerec_size;
+
+	// Write the event block and the final number of records in the
+	// header, which drops the checkpoint flag
+	if (gdf2_write_event_table(get_gdf2(xdf), evt_sect)
+	    || gdf2_write_numrec(xdf, (const char[2]){0, 0}))
 		retval = -1;
 
 	return retval;
 }
 
+
+/* \param xdf	pointer to an xdf file with XDF_WRITE mode
+ *
+ * GDF2 METHOD.
+ * Write the number of records written so far in the header, flagged as
+ * the one of a checkpoint, leaving the file pointer where the next record
+ * is written
+ */
+static int gdf2_checkpoint(struct xdf* xdf)
+{
+	return gdf2_write_numrec(xdf, checkpoint_mark);
+}
+
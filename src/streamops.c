@@ -20,30 +20,263 @@
 # include <config.h>
 #endif
 
+#include <errno.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <mmsysio.h>
 
+#include "xdfio.h"
 #include "streamops.h"
 #include "common.h"
 
+/**************************************************************************
+ *                       Default file descriptor backend                  *
+ **************************************************************************/
+#define CTX_TO_FD(ctx)	((int)(intptr_t)(ctx))
+
+static
+int64_t fd_pread(void* ctx, void* buf, size_t len, int64_t off)
+{
+	return mm_pread(CTX_TO_FD(ctx), buf, len, off);
+}
+
+
+static
+int64_t fd_pwrite(void* ctx, const void* buf, size_t len, int64_t off)
+{
+	return mm_pwrite(CTX_TO_FD(ctx), buf, len, off);
+}
+
+
+static
+int64_t fd_size(void* ctx)
+{
+	return mm_seek(CTX_TO_FD(ctx), 0, SEEK_END);
+}
+
+
+static
+int fd_sync(void* ctx)
+{
+	return mm_fsync(CTX_TO_FD(ctx));
+}
+
+
+static
+int fd_close(void* ctx)
+{
+	return mm_close(CTX_TO_FD(ctx));
+}
+
+
+static const struct xdf_io_ops fd_ops = {
+	.pread = fd_pread,
+	.pwrite = fd_pwrite,
+	.size = fd_size,
+	.sync = fd_sync,
+	.close = fd_close,
+};
+
+
+/**
+ * xdfstream_fd_ops() - get the backend accessing a file descriptor
+ *
+ * The context to use with the returned backend is the file descriptor
+ * casted into a pointer, ie (void*)(intptr_t)fd.
+ *
+ * Return: the operations of the file descriptor backend
+ */
+LOCAL_FN const struct xdf_io_ops* xdfstream_fd_ops(void)
+{
+	return &fd_ops;
+}
+
+
+/**************************************************************************
+ *                             Stream operations                          *
+ **************************************************************************/
+
+/**
+ * xdfstream_init() - initialize a stream over a backend
+ * @stream: stream to initialize
+ * @ops: operations of the backend
+ * @ctx: context passed to each operation of @ops
+ */
+LOCAL_FN void xdfstream_init(struct xdfstream* stream,
+                             const struct xdf_io_ops* ops, void* ctx)
+{
+	stream->ops = ops;
+	stream->ctx = ctx;
+	stream->pos = 0;
+}
+
+
+/**
+ * xdfstream_read() - read data at the position of a stream
+ * @stream: stream from which the data is read
+ * @buf: buffer receiving the data
+ * @len: maximal number of bytes to read
+ *
+ * Return: the number of bytes read and added to the position of @stream,
+ * 0 at the end of the file, -1 in case of error.
+ */
+LOCAL_FN ssize_t xdfstream_read(struct xdfstream* stream,
+                                void* buf, size_t len)
+{
+	int64_t rsize;
+
+	rsize = stream->ops->pread(stream->ctx, buf, len, stream->pos);
+	if (rsize > 0)
+		stream->pos += rsize;
+
+	return rsize;
+}
+
+
+/**
+ * xdfstream_write() - write data at the position of a stream
+ * @stream: stream to which the data is written
+ * @buf: buffer holding the data
+ * @len: maximal number of bytes to write
+ *
+ * Return: the number of bytes written and added to the position of
+ * @stream, -1 in case of error.
+ */
+LOCAL_FN ssize_t xdfstream_write(struct xdfstream* stream,
+                                 const void* buf, size_t len)
+{
+	int64_t wsize;
+
+	wsize = stream->ops->pwrite(stream->ctx, buf, len, stream->pos);
+	if (wsize > 0)
+		stream->pos += wsize;
+
+	return wsize;
+}
+
+
 /**
- * read16bval() - read a given number of 16 bits integers from a file
- * @file: file from which the integers are read
+ * xdfstream_size() - get the size of the file of a stream
+ * @stream: stream whose size is requested
+ *
+ * Return: the size in bytes, -1 in case of error
+ */
+LOCAL_FN mm_off_t xdfstream_size(struct xdfstream* stream)
+{
+	return stream->ops->size(stream->ctx);
+}
+
+
+/**
+ * xdfstream_sync() - make sure that written data reaches the storage
+ * @stream: stream to synchronize
+ *
+ * Nothing is done if the backend does not provide any sync operation.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int xdfstream_sync(struct xdfstream* stream)
+{
+	if (!stream->ops->sync)
+		return 0;
+
+	return stream->ops->sync(stream->ctx);
+}
+
+
+/**
+ * xdfstream_close() - release the backend of a stream
+ * @stream: stream to close
+ *
+ * Nothing is done if the backend does not provide any close operation.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int xdfstream_close(struct xdfstream* stream)
+{
+	if (!stream->ops->close)
+		return 0;
+
+	return stream->ops->close(stream->ctx);
+}
+
+
+/* \param stream stream from which the data is read
+ * \param off    offset in the file at which the data is read
+ * \param len    number of bytes to read
+ * \param buff   buffer receiving the data
+ *
+ * Read exactly @len bytes at the offset @off of @stream without moving the
+ * position of the stream.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int pread_full(struct xdfstream* stream, mm_off_t off, size_t len,
+               void* buff)
+{
+	int64_t rsize;
+	char* cbuff = buff;
+
+	while (len) {
+		rsize = stream->ops->pread(stream->ctx, cbuff, len, off);
+		if (rsize <= 0) {
+			if (rsize == 0)
+				errno = EIO;
+			return -1;
+		}
+
+		cbuff += rsize;
+		off += rsize;
+		len -= rsize;
+	}
+
+	return 0;
+}
+
+
+/**
+ * pread8bval() - read a given number of bytes at an offset
+ * @stream: stream from which the bytes are read
+ * @off: offset in the file of the first byte
+ * @num: number of bytes to read
+ * @value: buffer in which the reading is stored
+ *
+ * The position of @stream is not modified and no byte order conversion is
+ * applied: the data is returned as in the file.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int pread8bval(struct xdfstream* stream, mm_off_t off,
+                        unsigned int num, void* value)
+{
+	return pread_full(stream, off, num, value);
+}
+
+
+/**
+ * pread16bval() - read a given number of 16 bits integers at an offset
+ * @stream: stream from which the integers are read
+ * @off: offset in the file of the first integer
  * @num: number of 16 bits integer to read
  * @value: buffer in which the reading is stored
  *
+ * The position of @stream is not modified.
+ *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int read16bval(FILE* file, unsigned int num, void* value)
+LOCAL_FN int pread16bval(struct xdfstream* stream, mm_off_t off,
+                         unsigned int num, void* value)
 {
-	if (fread(value, sizeof(uint16_t), num, file)==0)
+	if (pread_full(stream, off, num*sizeof(uint16_t), value))
 		return -1;
 #if WORDS_BIGENDIAN
-	unsigned int i; 
+	unsigned int i;
 	int16_t* buff16 = value;
-	
+
 	for (i=0; i<num; i++)
 		buff16[i] = bswap_16(buff16[i]);
 #endif
@@ -52,152 +285,361 @@ LOCAL_FN int read16bval(FILE* file, unsigned int num, void* value)
 
 
 /**
- * write16bval() - write a given number of 16 bits integers in a file
- * @file: file in which the integers are written
+ * pread32bval() - read a given number of 32 bits integers at an offset
+ * @stream: stream from which the integers are read
+ * @off: offset in the file of the first integer
+ * @num: number of 32 bits integer to read
+ * @value: buffer in which the reading is stored
+ *
+ * The position of @stream is not modified.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int pread32bval(struct xdfstream* stream, mm_off_t off,
+                         unsigned int num, void* value)
+{
+	if (pread_full(stream, off, num*sizeof(uint32_t), value))
+		return -1;
+#if WORDS_BIGENDIAN
+	unsigned int i;
+	int32_t* buff32 = value;
+
+	for (i=0; i<num; i++)
+		buff32[i] = bswap_32(buff32[i]);
+#endif
+	return 0;
+}
+
+
+/* \param stream stream to which the data is written
+ * \param off    offset in the file at which the data is written
+ * \param len    number of bytes to write
+ * \param buff   buffer holding the data
+ *
+ * Write exactly @len bytes at the offset @off of @stream without moving
+ * the position of the stream.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int pwrite_full(struct xdfstream* stream, mm_off_t off, size_t len,
+                const void* buff)
+{
+	int64_t wsize;
+	const char* cbuff = buff;
+
+	while (len) {
+		wsize = stream->ops->pwrite(stream->ctx, cbuff, len, off);
+		if (wsize <= 0) {
+			if (wsize == 0)
+				errno = EIO;
+			return -1;
+		}
+
+		cbuff += wsize;
+		off += wsize;
+		len -= wsize;
+	}
+
+	return 0;
+}
+
+
+/**
+ * pwrite8bval() - write a given number of bytes at an offset
+ * @stream: stream to which the bytes are written
+ * @off: offset in the file of the first byte
+ * @num: number of bytes to write
+ * @value: buffer from which the bytes are read
+ *
+ * The position of @stream is not modified.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int pwrite8bval(struct xdfstream* stream, mm_off_t off,
+                         unsigned int num, const void* value)
+{
+	return pwrite_full(stream, off, num, value);
+}
+
+
+/**
+ * pwrite16bval() - write a given number of 16 bits integers at an offset
+ * @stream: stream to which the integers are written
+ * @off: offset in the file of the first integer
  * @num: number of 16 bits integers to write
  * @value: buffer from which the integers are read
  *
+ * The position of @stream is not modified.
+ *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int write16bval(FILE* file, unsigned int num, const void* value)
+LOCAL_FN int pwrite16bval(struct xdfstream* stream, mm_off_t off,
+                          unsigned int num, const void* value)
 {
 #if WORDS_BIGENDIAN
-	unsigned int i; 
+	unsigned int i;
 	const int16_t *ibuff16 = value;
 	int16_t obuff16[num];
-	
+
 	for (i=0; i<num; i++)
 		obuff16[i] = bswap_16(ibuff16[i]);
 
 	value = obuff16;
 #endif
-	if (fwrite(value, sizeof(uint16_t), num, file)==0)
-		return -1;
-	return 0;
+	return pwrite_full(stream, off, num*sizeof(uint16_t), value);
 }
 
 
 /**
- * read24bval() - read a given number of 24 bits integers from a file
- * @file: file from which the integers are read
- * @num: number of 24 bits integer to read
- * @value: buffer in which the reading is stored
+ * pwrite32bval() - write a given number of 32 bits integers at an offset
+ * @stream: stream to which the integers are written
+ * @off: offset in the file of the first integer
+ * @num: number of 32 bits integers to write
+ * @value: buffer from which the integers are read
+ *
+ * The position of @stream is not modified.
  *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int read24bval(FILE* file, unsigned int num, void* value)
+LOCAL_FN int pwrite32bval(struct xdfstream* stream, mm_off_t off,
+                          unsigned int num, const void* value)
 {
-	if (fread(value, 3, num, file)==0)
-		return -1;
 #if WORDS_BIGENDIAN
 	unsigned int i;
-	int8_t* buff8 = value;
-	char tmp;
-	
-	for (i=0; i<num*3; i+=3) {
-		tmp = buff8[i];
-		buff8[i] = buff8[i+2];
-		buff8[i+2] = tmp;
-	}
+	const int32_t *ibuff32 = value;
+	int32_t obuff32[num];
+
+	for (i=0; i<num; i++)
+		obuff32[i] = bswap_32(ibuff32[i]);
+
+	value = obuff32;
 #endif
-	return 0;
+	return pwrite_full(stream, off, num*sizeof(uint32_t), value);
 }
 
 
 /**
- * write24bval() - write a given number of 24 bits integers in a file
- * @file: file in which the integers are written
- * @num: number of 24 bits integers to write
+ * pwrite64bval() - write a given number of 64 bits integers at an offset
+ * @stream: stream to which the integers are written
+ * @off: offset in the file of the first integer
+ * @num: number of 64 bits integers to write
  * @value: buffer from which the integers are read
  *
+ * The position of @stream is not modified.
+ *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int write24bval(FILE* file, unsigned int num, const void* value)
+LOCAL_FN int pwrite64bval(struct xdfstream* stream, mm_off_t off,
+                          unsigned int num, const void* value)
 {
 #if WORDS_BIGENDIAN
 	unsigned int i;
-	const int8_t *ibuff8 = value;
-	int8_t obuff8[3*num];
-	
-	for (i=0; i<num*3; i+=3) {
-		obuff8[i+2] = ibuff8[i];
-		obuff8[i+1] = ibuff8[i+1];
-		obuff8[i] = ibuff8[i+2];
-	}
+	const int64_t *ibuff64 = value;
+	int64_t obuff64[num];
+
+	for (i=0; i<num; i++)
+		obuff64[i] = bswap_64(ibuff64[i]);
 
-	value = obuff8;
+	value = obuff64;
 #endif
-	if (fwrite(value, 3, num, file)==0)
+	return pwrite_full(stream, off, num*sizeof(uint64_t), value);
+}
+
+
+/**************************************************************************
+ *                           Header buffer operations                     *
+ **************************************************************************/
+
+/**
+ * hdrbuff_load() - load the beginning of a file in a header buffer
+ * @hdr: header buffer, zero-initialized before the first call
+ * @stream: stream from which the header is read
+ * @len: number of bytes from the beginning of the file to have in memory
+ *
+ * Extend the data of @hdr to the @len first bytes of @stream, reading only
+ * the bytes not loaded yet in one go and without moving the position of
+ * the stream. If the file is shorter, only the available bytes are loaded:
+ * the parsing functions check that the fields lie in the loaded data.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hdrbuff_load(struct hdrbuff* hdr, struct xdfstream* stream,
+                          size_t len)
+{
+	char* data;
+	int64_t rsize;
+
+	if (len <= hdr->len)
+		return 0;
+
+	if (len > hdr->maxlen) {
+		if (!(data = realloc(hdr->data, len)))
+			return -1;
+		hdr->data = data;
+		hdr->maxlen = len;
+	}
+
+	while (hdr->len < len) {
+		rsize = stream->ops->pread(stream->ctx, hdr->data + hdr->len,
+		                           len - hdr->len, hdr->len);
+		if (rsize < 0)
+			return -1;
+		if (rsize == 0)
+			break;
+		hdr->len += rsize;
+	}
+
+	return 0;
+}
+
+
+/**
+ * hdrbuff_store() - write the data of a header buffer in a file
+ * @hdr: header buffer holding the formatted data
+ * @stream: stream to which the data is written
+ * @off: offset in the file at which the data is written
+ *
+ * The whole data of @hdr is written in one go, without moving the position
+ * of @stream.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hdrbuff_store(struct hdrbuff* hdr, struct xdfstream* stream,
+                           mm_off_t off)
+{
+	return pwrite_full(stream, off, hdr->len, hdr->data);
+}
+
+
+/**
+ * hdrbuff_free() - free the data of a header buffer
+ * @hdr: header buffer to clean
+ */
+LOCAL_FN void hdrbuff_free(struct hdrbuff* hdr)
+{
+	free(hdr->data);
+	*hdr = (struct hdrbuff){.data = NULL};
+}
+
+
+/* \param hdr    header buffer
+ * \param len    number of bytes of the next field
+ *
+ * Returns a pointer to the next field of @hdr and moves after it, NULL if
+ * the field is beyond the loaded data (errno is set to EILSEQ).
+ */
+static
+const char* hdr_field(struct hdrbuff* hdr, size_t len)
+{
+	const char* field;
+
+	if ((hdr->pos > hdr->len) || (len > hdr->len - hdr->pos)) {
+		errno = EILSEQ;
+		return NULL;
+	}
+
+	field = hdr->data + hdr->pos;
+	hdr->pos += len;
+	return field;
+}
+
+
+/**
+ * hskip() - skip a given number of bytes of a header buffer
+ * @hdr: header buffer
+ * @len: number of bytes to skip
+ *
+ * Return: 0 in case of success, -1 if it goes beyond the loaded data
+ */
+LOCAL_FN int hskip(struct hdrbuff* hdr, size_t len)
+{
+	return hdr_field(hdr, len) ? 0 : -1;
+}
+
+
+/**
+ * hread8bval() - read a given number of bytes from a header buffer
+ * @hdr: header buffer from which the bytes are read
+ * @num: number of bytes to read
+ * @value: buffer in which the reading is stored
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hread8bval(struct hdrbuff* hdr, unsigned int num, void* value)
+{
+	const char* field = hdr_field(hdr, num);
+
+	if (!field)
 		return -1;
+
+	memcpy(value, field, num);
 	return 0;
 }
 
 
 /**
- * read32bval() - read a given number of 32 bits integers from a file
- * @file: file from which the integers are read
- * @num: number of 32 bits integer to read
+ * hread16bval() - read a given number of 16 bits integers from a header
+ * @hdr: header buffer from which the integers are read
+ * @num: number of 16 bits integer to read
  * @value: buffer in which the reading is stored
  *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int read32bval(FILE* file, unsigned int num, void* value)
+LOCAL_FN int hread16bval(struct hdrbuff* hdr, unsigned int num, void* value)
 {
-	if (fread(value, sizeof(uint32_t), num, file)==0)
+	if (hread8bval(hdr, num*sizeof(uint16_t), value))
 		return -1;
 #if WORDS_BIGENDIAN
-	unsigned int i; 
-	int32_t* buff32 = value;
-	
+	unsigned int i;
+	int16_t* buff16 = value;
+
 	for (i=0; i<num; i++)
-		buff32[i] = bswap_32(buff32[i]);
+		buff16[i] = bswap_16(buff16[i]);
 #endif
 	return 0;
 }
 
 
 /**
- * write32bval() - write a given number of 32 bits integers in a file
- * @file: file in which the integers are written
- * @num: number of 32 bits integers to write
- * @value: buffer from which the integers are read
+ * hread32bval() - read a given number of 32 bits integers from a header
+ * @hdr: header buffer from which the integers are read
+ * @num: number of 32 bits integer to read
+ * @value: buffer in which the reading is stored
  *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int write32bval(FILE* file, unsigned int num, const void* value)
+LOCAL_FN int hread32bval(struct hdrbuff* hdr, unsigned int num, void* value)
 {
+	if (hread8bval(hdr, num*sizeof(uint32_t), value))
+		return -1;
 #if WORDS_BIGENDIAN
-	unsigned int i; 
-	const int32_t *ibuff32 = value;
-	int32_t obuff32[num];
-	
-	for (i=0; i<num; i++)
-		obuff32[i] = bswap_32(ibuff32[i]);
+	unsigned int i;
+	int32_t* buff32 = value;
 
-	value = obuff32;
+	for (i=0; i<num; i++)
+		buff32[i] = bswap_32(buff32[i]);
 #endif
-	if (fwrite(value, sizeof(uint32_t), num, file)==0)
-		return -1;
 	return 0;
 }
 
 
 /**
- * read64bval() - read a given number of 64 bits integers from a file
- * @file: file from which the integers are read
+ * hread64bval() - read a given number of 64 bits integers from a header
+ * @hdr: header buffer from which the integers are read
  * @num: number of 64 bits integer to read
  * @value: buffer in which the reading is stored
  *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int read64bval(FILE* file, unsigned int num, void* value)
+LOCAL_FN int hread64bval(struct hdrbuff* hdr, unsigned int num, void* value)
 {
-	if (fread(value, sizeof(uint64_t), num, file)==0)
+	if (hread8bval(hdr, num*sizeof(uint64_t), value))
 		return -1;
 #if WORDS_BIGENDIAN
-	unsigned int i; 
+	unsigned int i;
 	int64_t* buff64 = value;
-	
+
 	for (i=0; i<num; i++)
 		buff64[i] = bswap_64(buff64[i]);
 #endif
@@ -206,80 +648,280 @@ LOCAL_FN int read64bval(FILE* file, unsigned int num, void* value)
 
 
 /**
- * write64bval() - write a given number of 64 bits integers in a file
- * @file: file in which the integers are written
- * @num: number of 64 bits integers to write
+ * hread_int_field() - read an integer written in characters in a header
+ * @hdr: header buffer from which the field is read
+ * @val: pointer fill with the value read
+ * @nch: number of characters of the field
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hread_int_field(struct hdrbuff* hdr, int* val, unsigned int nch)
+{
+	char str[32];
+	const char* field = hdr_field(hdr, nch);
+
+	if (!field)
+		return -1;
+
+	if (nch >= sizeof(str))
+		nch = sizeof(str)-1;
+	memcpy(str, field, nch);
+	str[nch] = '\0';
+
+	if (sscanf(str, "%i", val) <= 0) {
+		errno = EILSEQ;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * hread_string_field() - read a string field in a header
+ * @hdr: header buffer from which the field is read
+ * @val: pointer fill with the value read (must hold @nch+1 characters)
+ * @nch: number of characters of the field
+ *
+ * The value read does not contain trailing space.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hread_string_field(struct hdrbuff* hdr, char* val,
+                                unsigned int nch)
+{
+	int pos;
+	const char* field = hdr_field(hdr, nch);
+
+	if (!field)
+		return -1;
+
+	memcpy(val, field, nch);
+	val[nch] = '\0';
+
+	// Remove trailing spaces
+	pos = strlen(val);
+	while (pos && (val[pos-1]==' '))
+		pos--;
+	val[pos] = '\0';
+
+	return 0;
+}
+
+
+/* \param hdr    header buffer
+ * \param len    number of bytes of the next field
+ *
+ * Returns a pointer to the next field of @hdr to be written and moves after
+ * it, the data being extended if needed. NULL is returned if the memory
+ * cannot be allocated.
+ */
+static
+char* hdr_wfield(struct hdrbuff* hdr, size_t len)
+{
+	char* data;
+	char* field;
+	size_t maxlen = hdr->maxlen;
+
+	if (hdr->pos + len > maxlen) {
+		if (maxlen < 256)
+			maxlen = 256;
+		while (hdr->pos + len > maxlen)
+			maxlen *= 2;
+
+		if (!(data = realloc(hdr->data, maxlen)))
+			return NULL;
+		hdr->data = data;
+		hdr->maxlen = maxlen;
+	}
+
+	field = hdr->data + hdr->pos;
+	hdr->pos += len;
+	if (hdr->len < hdr->pos)
+		hdr->len = hdr->pos;
+
+	return field;
+}
+
+
+/**
+ * hwrite8bval() - write a given number of bytes in a header buffer
+ * @hdr: header buffer in which the bytes are written
+ * @num: number of bytes to write
+ * @value: buffer from which the bytes are read
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hwrite8bval(struct hdrbuff* hdr, unsigned int num,
+                         const void* value)
+{
+	char* field = hdr_wfield(hdr, num);
+
+	if (!field)
+		return -1;
+
+	memcpy(field, value, num);
+	return 0;
+}
+
+
+/**
+ * hwrite16bval() - write a given number of 16 bits integers in a header
+ * @hdr: header buffer in which the integers are written
+ * @num: number of 16 bits integers to write
  * @value: buffer from which the integers are read
  *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int write64bval(FILE* file, unsigned int num, const void* value)
+LOCAL_FN int hwrite16bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value)
 {
+	char* field = hdr_wfield(hdr, num*sizeof(uint16_t));
+
+	if (!field)
+		return -1;
+
+	memcpy(field, value, num*sizeof(uint16_t));
 #if WORDS_BIGENDIAN
-	unsigned int i; 
-	const int64_t *ibuff64 = value;
-	int64_t obuff64[num];
-	
-	for (i=0; i<num; i++)
-		obuff64[i] = bswap_64(ibuff64[i]);
+	unsigned int i;
+	int16_t val;
 
-	value = obuff64;
+	for (i=0; i<num; i++) {
+		memcpy(&val, field + i*sizeof(val), sizeof(val));
+		val = bswap_16(val);
+		memcpy(field + i*sizeof(val), &val, sizeof(val));
+	}
 #endif
-	if (fwrite(value, sizeof(uint64_t), num, file)==0)
-		return -1;
 	return 0;
 }
 
 
 /**
- * read_int_field() - read a given number of character in a file.
- * @file: file in which the integers are read
- * @val: pointer fill with the value read
- * @nch: number of characters read from the file
- *
- * The value read corresponds to an integer.
+ * hwrite24bval() - write a given number of 24 bits integers in a header
+ * @hdr: header buffer in which the integers are written
+ * @num: number of 24 bits integers to write
+ * @value: buffer from which the integers are read
  *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int read_int_field(FILE* file, int* val, unsigned int nch)
+LOCAL_FN int hwrite24bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value)
 {
-	char format[8];
-	long pos = ftell(file);
-	snprintf(format, sizeof(format), "%%%ui", nch);
-	
-	if ((fscanf(file, format, val) <= 0)
-	    || fseek(file, pos+nch, SEEK_SET)) 
+	char* field = hdr_wfield(hdr, 3*num);
+
+	if (!field)
 		return -1;
-	
+
+	memcpy(field, value, 3*num);
+#if WORDS_BIGENDIAN
+	unsigned int i;
+	char tmp;
+
+	for (i=0; i<num*3; i+=3) {
+		tmp = field[i];
+		field[i] = field[i+2];
+		field[i+2] = tmp;
+	}
+#endif
 	return 0;
 }
 
 
 /**
- * read_int_field() - read a given number of character in a file.
- * @file: file in which the integers are read
- * @val: pointer fill with the value read
- * @nch: number of characters read from the file
+ * hwrite32bval() - write a given number of 32 bits integers in a header
+ * @hdr: header buffer in which the integers are written
+ * @num: number of 32 bits integers to write
+ * @value: buffer from which the integers are read
  *
- * The value read corresponds to a string and does not contain trailing space.
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hwrite32bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value)
+{
+	char* field = hdr_wfield(hdr, num*sizeof(uint32_t));
+
+	if (!field)
+		return -1;
+
+	memcpy(field, value, num*sizeof(uint32_t));
+#if WORDS_BIGENDIAN
+	unsigned int i;
+	int32_t val;
+
+	for (i=0; i<num; i++) {
+		memcpy(&val, field + i*sizeof(val), sizeof(val));
+		val = bswap_32(val);
+		memcpy(field + i*sizeof(val), &val, sizeof(val));
+	}
+#endif
+	return 0;
+}
+
+
+/**
+ * hwrite64bval() - write a given number of 64 bits integers in a header
+ * @hdr: header buffer in which the integers are written
+ * @num: number of 64 bits integers to write
+ * @value: buffer from which the integers are read
  *
  * Return: 0 in case of success, -1 otherwise
  */
-LOCAL_FN int read_string_field(FILE* file, char* val, unsigned int nch)
+LOCAL_FN int hwrite64bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value)
 {
-	int pos;
+	char* field = hdr_wfield(hdr, num*sizeof(uint64_t));
 
-	val[nch] = '\0';
-	if (fread(val, nch, 1, file) < 1)
+	if (!field)
 		return -1;
 
-	// Remove trailing spaces
-	pos = strlen(val);
-	while (pos && (val[pos-1]==' '))
-		pos--;
-	val[pos] = '\0';
+	memcpy(field, value, num*sizeof(uint64_t));
+#if WORDS_BIGENDIAN
+	unsigned int i;
+	int64_t val;
 
+	for (i=0; i<num; i++) {
+		memcpy(&val, field + i*sizeof(val), sizeof(val));
+		val = bswap_64(val);
+		memcpy(field + i*sizeof(val), &val, sizeof(val));
+	}
+#endif
 	return 0;
 }
 
 
+/**
+ * hprintf() - write formatted characters in a header buffer
+ * @hdr: header buffer in which the characters are written
+ * @format: printf-like format of the characters
+ *
+ * The terminating null byte is not part of the written field.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int hprintf(struct hdrbuff* hdr, const char* format, ...)
+{
+	va_list ap;
+	int len;
+	size_t prevlen = hdr->len;
+	char *field, last;
+
+	va_start(ap, format);
+	len = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+	if (len < 0)
+		return -1;
+
+	// Room is made for the null byte, which is then dropped. It may
+	// overwrite the byte following the field: it is restored
+	if (!(field = hdr_wfield(hdr, len+1)))
+		return -1;
+	hdr->pos--;
+	hdr->len = (prevlen > hdr->pos) ? prevlen : hdr->pos;
+	last = (hdr->pos < prevlen) ? field[len] : '\0';
+
+	va_start(ap, format);
+	vsnprintf(field, len+1, format, ap);
+	field[len] = last;
+	va_end(ap);
+	return 0;
+}
@@ -19,21 +19,73 @@
 #ifndef STREAMOPS_H
 #define STREAMOPS_H
 
-#define read8bval(file, num, value) \
-   (fread((value), (num), 1, (file)) < 1 ? -1 : 0)
-#define write8bval(file, num, value) \
-   (fwrite((value), (num), 1, (file)) < 1 ? -1 : 0)
-LOCAL_FN int read16bval(FILE* file, unsigned int num, void* value);
-LOCAL_FN int write16bval(FILE* file, unsigned int num, const void* value);
-LOCAL_FN int read24bval(FILE* file, unsigned int num, void* value);
-LOCAL_FN int write24bval(FILE* file, unsigned int num, const void* value);
-LOCAL_FN int read32bval(FILE* file, unsigned int num, void* value);
-LOCAL_FN int write32bval(FILE* file, unsigned int num, const void* value);
-LOCAL_FN int read64bval(FILE* file, unsigned int num, void* value);
-LOCAL_FN int write64bval(FILE* file, unsigned int num, const void* value);
-LOCAL_FN int read_double_field(FILE* file, double* val, unsigned int len);
-LOCAL_FN int read_int_field(FILE* file, int* val, unsigned int len);
-LOCAL_FN int read_string_field(FILE* file, char* val, unsigned int len);
+struct xdf_io_ops;
+
+/* Storage of a xdf file: every access goes through the backend @ops at
+ * offsets given explicitly or, for record transfers, by @pos */
+struct xdfstream {
+	const struct xdf_io_ops* ops;
+	void* ctx;
+	mm_off_t pos;
+};
+
+LOCAL_FN void xdfstream_init(struct xdfstream* stream,
+                             const struct xdf_io_ops* ops, void* ctx);
+LOCAL_FN const struct xdf_io_ops* xdfstream_fd_ops(void);
+LOCAL_FN ssize_t xdfstream_read(struct xdfstream* stream,
+                                void* buf, size_t len);
+LOCAL_FN ssize_t xdfstream_write(struct xdfstream* stream,
+                                 const void* buf, size_t len);
+LOCAL_FN mm_off_t xdfstream_size(struct xdfstream* stream);
+LOCAL_FN int xdfstream_sync(struct xdfstream* stream);
+LOCAL_FN int xdfstream_close(struct xdfstream* stream);
+
+LOCAL_FN int pread8bval(struct xdfstream* stream, mm_off_t off,
+                        unsigned int num, void* value);
+LOCAL_FN int pread16bval(struct xdfstream* stream, mm_off_t off,
+                         unsigned int num, void* value);
+LOCAL_FN int pread32bval(struct xdfstream* stream, mm_off_t off,
+                         unsigned int num, void* value);
+LOCAL_FN int pwrite8bval(struct xdfstream* stream, mm_off_t off,
+                         unsigned int num, const void* value);
+LOCAL_FN int pwrite16bval(struct xdfstream* stream, mm_off_t off,
+                          unsigned int num, const void* value);
+LOCAL_FN int pwrite32bval(struct xdfstream* stream, mm_off_t off,
+                          unsigned int num, const void* value);
+LOCAL_FN int pwrite64bval(struct xdfstream* stream, mm_off_t off,
+                          unsigned int num, const void* value);
+
+/* Header loaded in memory and parsed sequentially from pos, or formatted
+ * in memory from pos before being stored in the file */
+struct hdrbuff {
+	char* data;
+	size_t len, pos, maxlen;
+};
+
+LOCAL_FN int hdrbuff_load(struct hdrbuff* hdr, struct xdfstream* stream,
+                          size_t len);
+LOCAL_FN int hdrbuff_store(struct hdrbuff* hdr, struct xdfstream* stream,
+                           mm_off_t off);
+LOCAL_FN void hdrbuff_free(struct hdrbuff* hdr);
+LOCAL_FN int hskip(struct hdrbuff* hdr, size_t len);
+LOCAL_FN int hread8bval(struct hdrbuff* hdr, unsigned int num, void* value);
+LOCAL_FN int hread16bval(struct hdrbuff* hdr, unsigned int num, void* value);
+LOCAL_FN int hread32bval(struct hdrbuff* hdr, unsigned int num, void* value);
+LOCAL_FN int hread64bval(struct hdrbuff* hdr, unsigned int num, void* value);
+LOCAL_FN int hread_int_field(struct hdrbuff* hdr, int* val, unsigned int len);
+LOCAL_FN int hread_string_field(struct hdrbuff* hdr, char* val,
+                                unsigned int len);
+LOCAL_FN int hwrite8bval(struct hdrbuff* hdr, unsigned int num,
+                         const void* value);
+LOCAL_FN int hwrite16bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value);
+LOCAL_FN int hwrite24bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value);
+LOCAL_FN int hwrite32bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value);
+LOCAL_FN int hwrite64bval(struct hdrbuff* hdr, unsigned int num,
+                          const void* value);
+LOCAL_FN int hprintf(struct hdrbuff* hdr, const char* format, ...);
 
 #if WORDS_BIGENDIAN
 # define LSB24	2
@@ -85,6 +85,8 @@ char const * get_stotype_str(enum xdftype type)
 		[XDFDOUBLE] = "double",
 		[XDFINT64] = "int64",
 		[XDFUINT64] = "uint64",
+		[XDFFLOAT16] = "float16",
+		[XDFBFLOAT16] = "bfloat16",
 	};
 
 	if (type  < 0 || type >= XDF_NUM_DATA_TYPES)
@@ -188,7 +190,7 @@ int main(int argc, char ** argv)
 		return 1;
 	}
 
-	f = xdf_open(argv[1], XDF_READ, XDF_ANY);
+	f = xdf_open(argv[1], XDF_READ|XDF_HEADER_ONLY, XDF_ANY);
 	if (f == NULL) {
 		fprintf(stderr, "Cannot load %s: %s\n", argv[1], strerror(errno));
 		return 1;
@@ -0,0 +1,593 @@
+/*
+ * Copyright © 2020 MindMaze
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Index the headers of the xDF files found in directory trees.
+ *
+ * The files are opened on a pool of threads, reading only their headers
+ * (and the header of the event section of GDF files to count the events).
+ * One row is written per file and one per channel, either as CSV or as
+ * JSON lines:
+ *   kind,path,format,fs,nrec,duration,nchannel,nevent,
+ *   index,label,unit,type,pmin,pmax,dmin,dmax
+ * where file rows leave the channel columns empty and conversely.
+ */
+#ifdef HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <errno.h>
+#include <mmargparse.h>
+#include <mmsysio.h>
+#include <mmthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xdfio.h"
+
+#define MAX_JOBS	256
+
+static const char csv_header[] = "kind,path,format,fs,nrec,duration,"
+                                 "nchannel,nevent,index,label,unit,type,"
+                                 "pmin,pmax,dmin,dmax\n";
+
+
+/**
+ * struct strbuf - growable string in which the rows of a file are written
+ * @data:       characters of the string (null terminated)
+ * @len:        length of the string
+ * @maxlen:     size of the allocated data
+ */
+struct strbuf {
+	char* data;
+	size_t len, maxlen;
+};
+
+
+/**
+ * struct indexer - state shared by the threads indexing the files
+ * @paths:      paths of the files to index
+ * @npath:      number of paths in @paths
+ * @maxpath:    allocated size of @paths
+ * @next:       index in @paths of the next file to index
+ * @mtx:        lock protecting @next, @nerror and the output
+ * @nerror:     number of files which could not be indexed
+ * @json:       if non zero, rows are written as JSON lines instead of CSV
+ * @mode:       mode passed to xdf_open()
+ */
+struct indexer {
+	char** paths;
+	size_t npath, maxpath;
+	size_t next;
+	mm_thr_mutex_t mtx;
+	int nerror;
+	int json;
+	int mode;
+};
+
+
+static
+char const * get_xdf_filetype_str(int type)
+{
+	static char const * filetype_names[] = {
+		[XDF_ANY] = "any",  // should not be asked
+		[XDF_EDF] = "edf",
+		[XDF_EDFP] = "edfp",
+		[XDF_BDF] = "bdf",
+		[XDF_GDF1] = "gdf1",
+		[XDF_GDF2] = "gdf2",
+	};
+
+	if (type <= 0 || type >= XDF_NUM_FILE_TYPES)
+		return "unknown";
+
+	return filetype_names[type];
+}
+
+
+static
+char const * get_stotype_str(enum xdftype type)
+{
+	static char const * type_names[] = {
+		[XDFINT8] = "int8",
+		[XDFUINT8] = "uint8",
+		[XDFINT16] = "int16",
+		[XDFUINT16] = "uint16",
+		[XDFINT24] = "int24",
+		[XDFUINT24] = "uint24",
+		[XDFINT32] = "int32",
+		[XDFUINT32] = "uint32",
+		[XDFFLOAT] = "float",
+		[XDFDOUBLE] = "double",
+		[XDFINT64] = "int64",
+		[XDFUINT64] = "uint64",
+		[XDFFLOAT16] = "float16",
+		[XDFBFLOAT16] = "bfloat16",
+	};
+
+	if (type  < 0 || type >= XDF_NUM_DATA_TYPES)
+		return "unknown";
+
+	return type_names[type];
+}
+
+
+static
+int strbuf_reserve(struct strbuf* sb, size_t len)
+{
+	size_t maxlen;
+	char* data;
+
+	if (sb->len + len < sb->maxlen)
+		return 0;
+
+	maxlen = sb->maxlen ? sb->maxlen : 1024;
+	while (maxlen <= sb->len + len)
+		maxlen *= 2;
+
+	data = realloc(sb->data, maxlen);
+	if (data == NULL)
+		return -1;
+
+	sb->data = data;
+	sb->maxlen = maxlen;
+	return 0;
+}
+
+
+static
+int strbuf_printf(struct strbuf* sb, const char* fmt, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, fmt);
+	len = vsnprintf(NULL, 0, fmt, args);
+	va_end(args);
+	if (len < 0 || strbuf_reserve(sb, len))
+		return -1;
+
+	va_start(args, fmt);
+	vsnprintf(sb->data + sb->len, len+1, fmt, args);
+	va_end(args);
+	sb->len += len;
+
+	return 0;
+}
+
+
+static
+int strbuf_putc(struct strbuf* sb, char c)
+{
+	if (strbuf_reserve(sb, 1))
+		return -1;
+
+	sb->data[sb->len++] = c;
+	sb->data[sb->len] = '\0';
+	return 0;
+}
+
+
+/* \param sb    string to which the value is appended
+ * \param str   string value to append
+ * \param json  non zero if written in a JSON object, CSV otherwise
+ *
+ * Append @str quoted and escaped as a JSON string or as a CSV field (only
+ * quoted if needed).
+ */
+static
+int strbuf_putstr(struct strbuf* sb, const char* str, int json)
+{
+	const char* c;
+	int rv = 0;
+
+	if (!json && !strpbrk(str, ",\"\n\r"))
+		return strbuf_printf(sb, "%s", str);
+
+	rv |= strbuf_putc(sb, '"');
+	for (c = str; *c; c++) {
+		if (*c == '"')
+			rv |= strbuf_printf(sb, json ? "\\\"" : "\"\"");
+		else if (json && *c == '\\')
+			rv |= strbuf_printf(sb, "\\\\");
+		else if (json && (unsigned char)*c < 0x20)
+			rv |= strbuf_printf(sb, "\\u%04x", (unsigned char)*c);
+		else
+			rv |= strbuf_putc(sb, *c);
+	}
+	rv |= strbuf_putc(sb, '"');
+
+	return rv ? -1 : 0;
+}
+
+
+static
+int format_file_row(struct strbuf* sb, const char* path, struct xdf* xdf,
+                    int json, int with_events)
+{
+	int type, fs, nrec, nch, nevent = 0;
+	double recdur;
+	int rv = 0;
+
+	if (xdf_get_conf(xdf, XDF_F_FILEFMT, &type,
+	                      XDF_F_SAMPLING_FREQ, &fs,
+	                      XDF_F_NREC, &nrec,
+	                      XDF_F_REC_DURATION, &recdur,
+	                      XDF_F_NCHANNEL, &nch,
+	                      XDF_NOF)
+	   || (with_events
+	       && xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF)))
+		return -1;
+
+	if (json) {
+		rv |= strbuf_printf(sb, "{\"kind\":\"file\",\"path\":");
+		rv |= strbuf_putstr(sb, path, 1);
+		rv |= strbuf_printf(sb, ",\"format\":\"%s\",\"fs\":%i,"
+		                        "\"nrec\":%i,",
+		                    get_xdf_filetype_str(type), fs, nrec);
+		if (nrec >= 0)
+			rv |= strbuf_printf(sb, "\"duration\":%g,", nrec*recdur);
+		rv |= strbuf_printf(sb, "\"nchannel\":%i", nch);
+		if (with_events)
+			rv |= strbuf_printf(sb, ",\"nevent\":%i", nevent);
+		rv |= strbuf_printf(sb, "}\n");
+	} else {
+		rv |= strbuf_printf(sb, "file,");
+		rv |= strbuf_putstr(sb, path, 0);
+		rv |= strbuf_printf(sb, ",%s,%i,%i,",
+		                    get_xdf_filetype_str(type), fs, nrec);
+		if (nrec >= 0)
+			rv |= strbuf_printf(sb, "%g", nrec*recdur);
+		rv |= strbuf_printf(sb, ",%i,", nch);
+		if (with_events)
+			rv |= strbuf_printf(sb, "%i", nevent);
+		rv |= strbuf_printf(sb, ",,,,,,,,\n");
+	}
+
+	return rv ? -1 : 0;
+}
+
+
+static
+int format_channel_row(struct strbuf* sb, const char* path,
+                       struct xdfch* ch, int index, int json)
+{
+	const char *label, *unit;
+	double pmin, pmax, dmin, dmax;
+	enum xdftype type;
+	int rv = 0;
+
+	if (xdf_get_chconf(ch, XDF_CF_LABEL, &label,
+	                       XDF_CF_UNIT, &unit,
+	                       XDF_CF_STOTYPE, &type,
+	                       XDF_CF_PMIN, &pmin,
+	                       XDF_CF_PMAX, &pmax,
+	                       XDF_CF_DMIN, &dmin,
+	                       XDF_CF_DMAX, &dmax,
+	                       XDF_NOF))
+		return -1;
+
+	if (json) {
+		rv |= strbuf_printf(sb, "{\"kind\":\"channel\",\"path\":");
+		rv |= strbuf_putstr(sb, path, 1);
+		rv |= strbuf_printf(sb, ",\"index\":%i,\"label\":", index);
+		rv |= strbuf_putstr(sb, label, 1);
+		rv |= strbuf_printf(sb, ",\"unit\":");
+		rv |= strbuf_putstr(sb, unit, 1);
+		rv |= strbuf_printf(sb, ",\"type\":\"%s\",\"pmin\":%.17g,"
+		                        "\"pmax\":%.17g,\"dmin\":%.17g,"
+		                        "\"dmax\":%.17g}\n",
+		                    get_stotype_str(type), pmin, pmax,
+		                    dmin, dmax);
+	} else {
+		rv |= strbuf_printf(sb, "channel,");
+		rv |= strbuf_putstr(sb, path, 0);
+		rv |= strbuf_printf(sb, ",,,,,,,%i,", index);
+		rv |= strbuf_putstr(sb, label, 0);
+		rv |= strbuf_putc(sb, ',');
+		rv |= strbuf_putstr(sb, unit, 0);
+		rv |= strbuf_printf(sb, ",%s,%.17g,%.17g,%.17g,%.17g\n",
+		                    get_stotype_str(type), pmin, pmax,
+		                    dmin, dmax);
+	}
+
+	return rv ? -1 : 0;
+}
+
+
+/* \param path  path of a file that xdf_open() failed to parse
+ *
+ * Tell whether the file at @path starts as one of the supported formats,
+ * ie, whether it is a broken xDF file rather than a file of another kind.
+ */
+static
+int has_xdf_magic(const char* path)
+{
+	char key[8];
+	int fd, has_magic;
+
+	fd = mm_open(path, O_RDONLY, 0);
+	if (fd < 0)
+		return 0;
+
+	has_magic = (mm_read(fd, key, sizeof(key)) == sizeof(key))
+	            && (!memcmp(key, "0       ", 8)
+	                || !memcmp(key, "\xff" "BIOSEMI", 8)
+	                || !memcmp(key, "GDF 1.", 6)
+	                || !memcmp(key, "GDF 2.", 6));
+
+	mm_close(fd);
+	return has_magic;
+}
+
+
+/* \param idx   indexer state
+ * \param path  path of the file to index
+ * \param sb    string receiving the rows of the file
+ *
+ * Returns 0 if the rows of the file have been written in @sb, 1 if the
+ * file is not a xDF file, -1 in case of error (errno is then EILSEQ if the
+ * file is a broken xDF file).
+ */
+static
+int index_file(struct indexer* idx, const char* path, struct strbuf* sb)
+{
+	struct xdf* xdf;
+	struct xdfch* ch;
+	int i, err, rv = 0;
+
+	xdf = xdf_open(path, idx->mode, XDF_ANY);
+	if (xdf == NULL) {
+		err = errno;
+		if ((err == EILSEQ) && !has_xdf_magic(path))
+			return 1;
+		errno = err;
+		return -1;
+	}
+
+	sb->len = 0;
+	rv = format_file_row(sb, path, xdf, idx->json,
+	                     !(idx->mode & XDF_HEADER_ONLY));
+	for (i = 0; !rv && (ch = xdf_get_channel(xdf, i)); i++)
+		rv = format_channel_row(sb, path, ch, i, idx->json);
+
+	xdf_close(xdf);
+	return rv;
+}
+
+
+static
+void* index_worker(void* arg)
+{
+	struct indexer* idx = arg;
+	struct strbuf sb = {.data = NULL};
+	size_t i;
+	int rv, err;
+
+	while (1) {
+		mm_thr_mutex_lock(&idx->mtx);
+		i = idx->next++;
+		mm_thr_mutex_unlock(&idx->mtx);
+		if (i >= idx->npath)
+			break;
+
+		rv = index_file(idx, idx->paths[i], &sb);
+		err = errno;
+		if (rv > 0)
+			continue;
+
+		// Each file is written at once so that rows do not interleave
+		mm_thr_mutex_lock(&idx->mtx);
+		if (rv == 0) {
+			fwrite(sb.data, 1, sb.len, stdout);
+		} else {
+			fprintf(stderr, "Cannot index %s: %s\n",
+			        idx->paths[i], (err == EILSEQ) ?
+			        "broken xDF file" : strerror(err));
+			idx->nerror++;
+		}
+		mm_thr_mutex_unlock(&idx->mtx);
+	}
+
+	free(sb.data);
+	return NULL;
+}
+
+
+static
+int add_path(struct indexer* idx, const char* dir, const char* name)
+{
+	size_t maxpath;
+	char** paths;
+	char* path;
+
+	if (idx->npath == idx->maxpath) {
+		maxpath = idx->maxpath ? 2*idx->maxpath : 256;
+		paths = realloc(idx->paths, maxpath*sizeof(*paths));
+		if (paths == NULL)
+			return -1;
+		idx->paths = paths;
+		idx->maxpath = maxpath;
+	}
+
+	path = malloc(strlen(dir) + strlen(name) + 2);
+	if (path == NULL)
+		return -1;
+
+	if (name[0])
+		sprintf(path, "%s/%s", dir, name);
+	else
+		strcpy(path, dir);
+
+	idx->paths[idx->npath++] = path;
+	return 0;
+}
+
+
+/* \param dir   path of the directory being walked
+ * \param entry entry of @dir
+ *
+ * Get the type of @entry, from the file itself if the directory does not
+ * provide it. Symbolic links are not followed.
+ *
+ * Returns MM_DT_REG, MM_DT_DIR or any other MM_DT_* type to be skipped.
+ */
+static
+int get_entry_type(const char* dir, const struct mm_dirent* entry)
+{
+	struct mm_stat st;
+	char* path;
+	int rv;
+
+	if (entry->type != MM_DT_UNKNOWN)
+		return entry->type;
+
+	path = malloc(strlen(dir) + strlen(entry->name) + 2);
+	if (path == NULL)
+		return MM_DT_UNKNOWN;
+
+	sprintf(path, "%s/%s", dir, entry->name);
+	rv = mm_stat(path, &st, MM_NOFOLLOW);
+	free(path);
+	if (rv)
+		return MM_DT_UNKNOWN;
+
+	if (S_ISREG(st.mode))
+		return MM_DT_REG;
+	if (S_ISDIR(st.mode))
+		return MM_DT_DIR;
+
+	return MM_DT_UNKNOWN;
+}
+
+
+/* \param idx   indexer state
+ * \param path  path of a directory or of a file
+ *
+ * Add @path to the files to index or, if it is a directory, the regular
+ * files of its tree. Symbolic links are not followed.
+ */
+static
+int walk_tree(struct indexer* idx, const char* path)
+{
+	MM_DIR* dir;
+	const struct mm_dirent* entry;
+	char* subdir;
+	int type, status, rv = 0;
+
+	dir = mm_opendir(path);
+	if (dir == NULL)
+		return (errno == ENOTDIR) ? add_path(idx, path, "") : -1;
+
+	while (!rv && (entry = mm_readdir(dir, &status))) {
+		if (!strcmp(entry->name, ".") || !strcmp(entry->name, ".."))
+			continue;
+
+		type = get_entry_type(path, entry);
+		if (type == MM_DT_REG) {
+			rv = add_path(idx, path, entry->name);
+		} else if (type == MM_DT_DIR) {
+			subdir = malloc(strlen(path) + strlen(entry->name) + 2);
+			if (subdir == NULL) {
+				rv = -1;
+				break;
+			}
+			sprintf(subdir, "%s/%s", path, entry->name);
+			if (walk_tree(idx, subdir))
+				fprintf(stderr, "Cannot walk %s: %s\n",
+				        subdir, strerror(errno));
+			free(subdir);
+		}
+	}
+
+	mm_closedir(dir);
+	return rv;
+}
+
+
+int main(int argc, char ** argv)
+{
+	struct indexer idx = {.paths = NULL};
+	mm_thread_t threads[MAX_JOBS];
+	const char* format;
+	int i, iarg, njob, nthread, noevent;
+	size_t ip;
+
+	struct mm_arg_opt cmdline_optv[] = {
+		{.name = "jobs", MM_OPT_INT, "4", {.iptr = &njob},
+		 .desc = "Number of files opened in parallel"},
+		{.name = "format", MM_OPT_STR, "csv", {.sptr = &format},
+		 .desc = "Output format: csv or json (JSON lines)"},
+		{.name = "no-events", MM_OPT_INT, "0", {.iptr = &noevent},
+		 .desc = "If not 0, do not count events (read headers only)"},
+	};
+
+	struct mm_arg_parser parser = {
+		.optv = cmdline_optv,
+		.num_opt = MM_NELEM(cmdline_optv),
+		.execname = argv[0],
+	};
+
+	iarg = mm_arg_parse(&parser, argc, argv);
+	if (iarg == MM_ARGPARSE_ERROR)
+		return EXIT_FAILURE;
+
+	if ((iarg >= argc) || (njob <= 0) || (njob > MAX_JOBS)
+	    || (strcmp(format, "csv") && strcmp(format, "json"))) {
+		fprintf(stderr, "usage: %s [--jobs=N] [--format=csv|json] "
+		                "[--no-events=1] <dir-or-file>...\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	idx.json = !strcmp(format, "json");
+	idx.mode = XDF_READ | (noevent ? XDF_HEADER_ONLY : XDF_LAZY_EVENTS);
+
+	for (; iarg < argc; iarg++) {
+		if (walk_tree(&idx, argv[iarg])) {
+			fprintf(stderr, "Cannot walk %s: %s\n",
+			        argv[iarg], strerror(errno));
+			idx.nerror++;
+		}
+	}
+
+	if (!idx.json)
+		fputs(csv_header, stdout);
+
+	if ((size_t)njob > idx.npath)
+		njob = idx.npath;
+
+	// The threads which could be started share the files. If none could,
+	// the files are indexed by the main thread.
+	mm_thr_mutex_init(&idx.mtx, 0);
+	for (nthread = 0; nthread < njob; nthread++)
+		if (mm_thr_create(&threads[nthread], index_worker, &idx))
+			break;
+	if (nthread == 0)
+		index_worker(&idx);
+	for (i = 0; i < nthread; i++)
+		mm_thr_join(threads[i], NULL);
+	mm_thr_mutex_deinit(&idx.mtx);
+
+	for (ip = 0; ip < idx.npath; ip++)
+		free(idx.paths[ip]);
+	free(idx.paths);
+
+	return idx.nerror ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -25,7 +25,9 @@
 
 #include <stdio.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <mmsysio.h>
@@ -37,6 +39,8 @@
 #include "xdfevent.h"
 #include "common.h"
 
+static int build_chlabel_index(struct xdf* xdf);
+
 /******************************************************
  *             options table definitions              *
  ******************************************************/
@@ -56,6 +60,7 @@ static const struct opt_detail field_table[] = {
 	{XDF_F_NEVTTYPE, TYPE_INT},
 	{XDF_F_NEVENT, TYPE_INT},
 	{XDF_F_NREC, TYPE_INT},
+	{XDF_F_CONV_LUT, TYPE_INT},
 	{XDF_F_SUBJ_DESC, TYPE_STRING},
 	{XDF_F_SESS_DESC, TYPE_STRING},
 	{XDF_F_RECTIME, TYPE_DOUBLE},
@@ -71,6 +76,8 @@ static const struct opt_detail field_table[] = {
 	{XDF_F_HEADSIZE, TYPE_3DPOS},
 	{XDF_F_REF_POS, TYPE_3DPOS},
 	{XDF_F_GND_POS, TYPE_3DPOS},
+	{XDF_F_EVT_MEMLIMIT, TYPE_INT},
+	{XDF_F_CHECKPOINT, TYPE_INT},
 	/* Channel field */
 	{XDF_CF_ARRINDEX, TYPE_INT},
 	{XDF_CF_ARROFFSET, TYPE_INT},
@@ -82,6 +89,9 @@ static const struct opt_detail field_table[] = {
 	{XDF_CF_PMAX, TYPE_DOUBLE}, 
 	{XDF_CF_DMIN, TYPE_DOUBLE},	
 	{XDF_CF_DMAX, TYPE_DOUBLE},
+	{XDF_CF_NCLIPPED, TYPE_UINT},
+	{XDF_CF_TRIGMASK, TYPE_INT},
+	{XDF_CF_TRIGEDGE, TYPE_INT},
 	{XDF_CF_UNIT, TYPE_STRING},
 	{XDF_CF_TRANSDUCTER, TYPE_STRING},
 	{XDF_CF_PREFILTERING, TYPE_STRING},
@@ -91,6 +101,9 @@ static const struct opt_detail field_table[] = {
 };
 #define num_opts	(sizeof(field_table)/sizeof(field_table[0]))
 
+// Flags of the opening mode selecting how the events are read
+#define READ_FLAGS	(XDF_LAZY_EVENTS|XDF_STATUS_EVENTS|XDF_HEADER_ONLY)
+
 static int get_field_type(int field)
 {
 	int i = num_opts-1;
@@ -151,18 +164,73 @@ static int set_val_to_arg(int field, union optval val, va_list* ap)
 	return 0;
 }
 
+
+/* \param argtype	type of the field (TYPE_*)
+ * \param values	array of values of type @argtype
+ * \param i		index of the element in @values
+ * \param val		union receiving the value
+ *
+ * Array counterpart of set_arg_to_val()
+ */
+static void get_array_val(int argtype, const void* values, unsigned int i,
+                          union optval* val)
+{
+	if (argtype == TYPE_INT)
+		val->i = ((const int*)values)[i];
+	else if (argtype == TYPE_DATATYPE)
+		val->type = ((const enum xdftype*)values)[i];
+	else if (argtype == TYPE_STRING)
+		val->str = ((const char* const*)values)[i];
+	else if (argtype == TYPE_DOUBLE)
+		val->d = ((const double*)values)[i];
+	else if (argtype == TYPE_UINT)
+		val->ui = ((const unsigned int*)values)[i];
+	else if (argtype == TYPE_3DPOS)
+		memcpy(val->pos, (const double*)values + 3*i, sizeof(val->pos));
+	else if (argtype == TYPE_ICD)
+		memcpy(val->icd, (const char*)values + 6*i, sizeof(val->icd));
+}
+
+
+/* \param argtype	type of the field (TYPE_*)
+ * \param val		union containing the value
+ * \param values	array of values of type @argtype
+ * \param i		index of the element in @values
+ *
+ * Array counterpart of set_val_to_arg()
+ */
+static void set_array_val(int argtype, const union optval* val,
+                          void* values, unsigned int i)
+{
+	if (argtype == TYPE_INT)
+		((int*)values)[i] = val->i;
+	else if (argtype == TYPE_DATATYPE)
+		((enum xdftype*)values)[i] = val->type;
+	else if (argtype == TYPE_STRING)
+		((const char**)values)[i] = val->str;
+	else if (argtype == TYPE_DOUBLE)
+		((double*)values)[i] = val->d;
+	else if (argtype == TYPE_UINT)
+		((unsigned int*)values)[i] = val->ui;
+	else if (argtype == TYPE_3DPOS)
+		memcpy((double*)values + 3*i, val->pos, sizeof(val->pos));
+	else if (argtype == TYPE_ICD)
+		memcpy((char*)values + 6*i, val->icd, sizeof(val->icd));
+}
+
 /******************************************************
  *            xDF structure initialization            *
  ******************************************************/
 
 /* \param xdf	pointer to a valid xdf structure
- * \param fd	file descriptor to be used with the xdf file
+ * \param stream	storage to be used with the xdf file
  * \param type	type of the xdf file
  * \param mode	mode of the file
  *
  * Initialize a xdf structure the provided and default values
  */
-static void init_xdf_struct(struct xdf* xdf, int fd, int mode)
+static void init_xdf_struct(struct xdf* xdf,
+                            const struct xdfstream* stream, int mode)
 {
 	struct xdfch* ch = xdf->defaultch;
 	const double* lim;
@@ -170,17 +238,38 @@ static void init_xdf_struct(struct xdf* xdf, int fd, int mode)
 	xdf->ready = 0;
 	xdf->reportval = 0;
 	xdf->mode = mode;
-	xdf->fd = fd;
-	xdf->tmp_event_fd = -1;
-	xdf->tmp_code_fd = -1;
+	xdf->io = *stream;
+	xdf->evtjournal = (struct journal){.fd = -1};
+	xdf->codejournal = (struct journal){.fd = -1};
+	xdf->journal_sync = 0;
 	xdf->buff = xdf->backbuff = NULL;
 	xdf->tmpbuff[0] = xdf->tmpbuff[1] = NULL;
 	xdf->channels = NULL;
+	xdf->chtab = NULL;
+	xdf->nchtab = xdf->maxchtab = 0;
+	xdf->chblocks = NULL;
+	xdf->chlabel = NULL;
+	xdf->chbucket = NULL;
+	xdf->nchbucket = 0;
 	xdf->convdata = NULL;
+	xdf->luts = (struct lutcache){.first = NULL};
+	xdf->conf_gen = xdf->transfer_gen = 0;
+	xdf->parked = 0;
 	xdf->batch = NULL;
 	xdf->array_stride = NULL;
+	xdf->array_ptr = NULL;
 	xdf->closefd_ondestroy = 0;
 	xdf->nrecord = -1;
+	xdf->use_lut = 1;
+	xdf->lazy_events = 0;
+	xdf->status_events = 0;
+	xdf->header_only = 0;
+	xdf->nevent_pending = 0;
+	xdf->evt_memlimit = 0;
+	xdf->checkpoint = 0;
+	xdf->trigbuff = NULL;
+	xdf->trigevt = NULL;
+	xdf->ntrigevt = xdf->maxtrigevt = 0;
 
 	// Set default values for the default channel 
 	ch->inmemtype = ch->infiletype;
@@ -190,11 +279,55 @@ static void init_xdf_struct(struct xdf* xdf, int fd, int mode)
 	ch->digital_inmem = 0;
 	ch->iarray = 0;
 	ch->offset = 0;
+	ch->nclipped = 0;
+	ch->trigmask = 0;
+	ch->trigedge = XDF_TRIG_RISING;
+}
+
+
+/* \param xdf	pointer to a valid xdf structure
+ * \param nevent	number of events needed in the event table
+ *
+ * Decode the events of the file that have not been loaded yet, until the
+ * event table holds at least @nevent events or all the events of the file.
+ * Events are decoded by whole blocks of EVT_BLOCK events, so that accessing
+ * them in sequence does not read the file for each event.
+ *
+ * Return 0 in case of success, -1 otherwise
+ */
+static int load_events(struct xdf* xdf, unsigned int nevent)
+{
+	unsigned int len, nloaded;
+	int retval;
+
+	if (xdf->nevent_pending == 0 || xdf->table->nevent >= nevent)
+		return 0;
+
+	len = nevent - xdf->table->nevent;
+	if (len < EVT_BLOCK)
+		len = EVT_BLOCK;
+	if (len > xdf->nevent_pending)
+		len = xdf->nevent_pending;
+
+	// Formats not storing the number of events decode them all at once
+	// (a failed decoding is not retried, so that no event is duplicated)
+	if (xdf->nevent_pending == NEVENT_UNKNOWN) {
+		xdf->nevent_pending = 0;
+		return xdf->ops->load_events(xdf, UINT_MAX);
+	}
+
+	nloaded = xdf->table->nevent;
+	retval = xdf->ops->load_events(xdf, len);
+	xdf->nevent_pending -= xdf->table->nevent - nloaded;
+
+	return retval;
 }
 
 
 /* \param xdf	pointer to an structure xdf initialized for reading
- * \param fd	file descriptor of the opened file for reading
+ * \param stream	storage of the opened file for reading
+ * \param rdflags	XDF_LAZY_EVENTS, XDF_STATUS_EVENTS and XDF_HEADER_ONLY
+ *		flags of the mode
  *
  * Initialize the metadata, i.e. it initializes the xdf structure, read the
  * file header and it sets the initial values of transfer to reasonable
@@ -202,13 +335,31 @@ static void init_xdf_struct(struct xdf* xdf, int fd, int mode)
  *
  * Return 0 in case of success, -1 otherwise
  */
-static int setup_read_xdf(struct xdf* xdf, int fd)
+static int setup_read_xdf(struct xdf* xdf, const struct xdfstream* stream,
+                          int rdflags)
 {
 	struct xdfch* ch;
 	int offset = 0;
 
-	init_xdf_struct(xdf, fd, XDF_READ);
-	if (xdf->ops->read_header(xdf))
+	init_xdf_struct(xdf, stream, XDF_READ);
+	xdf->lazy_events = rdflags & XDF_LAZY_EVENTS;
+	xdf->status_events = rdflags & XDF_STATUS_EVENTS;
+	xdf->header_only = rdflags & XDF_HEADER_ONLY;
+
+	// Without events, the file is handled as a format that has none
+	if (xdf->header_only) {
+		destroy_event_table(xdf->table);
+		xdf->table = NULL;
+		xdf->status_events = 0;
+	}
+
+	if (xdf->ops->read_header(xdf)
+	   || (xdf->table && !xdf->lazy_events && load_events(xdf, UINT_MAX)))
+		return -1;
+
+	// The labels have been parsed in place: index them now so that
+	// lookups never modify the structure
+	if (build_chlabel_index(xdf))
 		return -1;
 
 	// Set channel default values
@@ -225,22 +376,24 @@ static int setup_read_xdf(struct xdf* xdf, int fd)
 
 
 /* \param type		expected type for the file to be opened
- * \param fd		File descriptor of the storage
+ * \param stream	storage of the file
+ * \param rdflags	XDF_LAZY_EVENTS, XDF_STATUS_EVENTS and XDF_HEADER_ONLY
+ *		flags of the mode
  *
  * Create a xdf structure of a xDF file for reading. if type is not XDF_ANY
  * and file is not of the same type, the function will fail.
  */
 static
-struct xdf* create_read_xdf(enum xdffiletype type, int fd)
+struct xdf* create_read_xdf(enum xdffiletype type,
+                            const struct xdfstream* stream, int rdflags)
 {
-	unsigned char magickey[8];
+	unsigned char magickey[8] = {0};
 	enum xdffiletype gtype;
 	struct xdf* xdf = NULL;
 	int errnum = 0;
 
 	// Guess file type
-	if ( (mm_read(fd, magickey, sizeof(magickey)) == -1)
-	    || (mm_seek(fd, 0, SEEK_SET) == -1) )
+	if (stream->ops->pread(stream->ctx, magickey, sizeof(magickey), 0) < 0)
 		return NULL;
 
 	gtype = xdf_guess_filetype(magickey);
@@ -254,7 +407,7 @@ struct xdf* create_read_xdf(enum xdffiletype type, int fd)
 		return NULL;
 	
 	// Initialize by reading the file
-	if (setup_read_xdf(xdf, fd) == 0)
+	if (setup_read_xdf(xdf, stream, rdflags) == 0)
 		return xdf;
 	
 	// We have caught an error if we reach here
@@ -284,8 +437,9 @@ int create_tmp_writefile_with_suffix(struct xdf* xdf, char const * suffix,
 }
 
 /* \param type		requested type for the file to be created
- * \param fd		File descriptor of the storage
- * \param filename	filename used to create fd (NULL with xdf_fopen())
+ * \param stream	storage of the file
+ * \param filename	filename used to create the storage (NULL with
+ *			xdf_fdopen() and xdf_open_io())
  * \param oflag         flag used when opening event file descriptor
  *
  *
@@ -293,7 +447,8 @@ int create_tmp_writefile_with_suffix(struct xdf* xdf, char const * suffix,
  * the function will fail
  */
 static
-struct xdf* create_write_xdf(enum xdffiletype type, int fd,
+struct xdf* create_write_xdf(enum xdffiletype type,
+                             const struct xdfstream* stream,
                              const char * filename, int oflag)
 {
 	struct xdf* xdf = NULL;
@@ -302,7 +457,7 @@ struct xdf* create_write_xdf(enum xdffiletype type, int fd,
 	if (xdf == NULL)
 		return NULL;
 
-	init_xdf_struct(xdf, fd, XDF_WRITE);
+	init_xdf_struct(xdf, stream, XDF_WRITE);
 	if (filename != NULL) {
 		/* reserve more than needed to allow re-using this buffer in xdf_close()
 		 * without needing to alloc() */
@@ -311,9 +466,11 @@ struct xdf* create_write_xdf(enum xdffiletype type, int fd,
 			goto error;
 		strcpy(xdf->filename, filename);
 
-		xdf->tmp_event_fd = create_tmp_writefile_with_suffix(xdf, ".event", oflag);
-		xdf->tmp_code_fd = create_tmp_writefile_with_suffix(xdf, ".code", oflag);
-		if (xdf->tmp_event_fd < 0 || xdf->tmp_code_fd < 0)
+		// The event journal is read back if events are spilled
+		xdf->evtjournal.fd = create_tmp_writefile_with_suffix(xdf, ".event",
+		                                     (oflag & ~O_WRONLY)|O_RDWR);
+		xdf->codejournal.fd = create_tmp_writefile_with_suffix(xdf, ".code", oflag);
+		if (xdf->evtjournal.fd < 0 || xdf->codejournal.fd < 0)
 			goto error;
 	}
 
@@ -346,6 +503,31 @@ error:
  * @type should be also be set to the desired type of data format
  * (XDF_ANY will result in a error).
  *
+ * By default, the whole event table of a file opened for reading is loaded
+ * when it is opened. If the XDF_LAZY_EVENTS flag is added to XDF_READ, only
+ * the number of events is read at opening: the events are decoded by
+ * blocks from the file when they are first accessed. This saves time and
+ * memory when only the data or the header of a file is of interest. Since
+ * event types are numbered in order of appearance, retrieving the number of
+ * event types or an event type loads the whole event table. The flag is
+ * ignored in write mode.
+ *
+ * EDF and BDF files do not store events. If the XDF_STATUS_EVENTS flag is
+ * added to XDF_READ, the channel labelled "Status" of such a file is
+ * decoded into events: each run of samples whose 16 lower bits hold the
+ * same non zero value is an event whose code is this value. The decoded
+ * events are accessed as the events of a GDF file. Combined with
+ * XDF_LAZY_EVENTS, the status channel is decoded at the first access to the
+ * events or to their number. The flag is ignored for other formats and in
+ * write mode.
+ *
+ * If the XDF_HEADER_ONLY flag is added to XDF_READ, only the file header
+ * and the channel headers are read: the file is then opened with a
+ * minimal amount of I/O, which suits the scan of many files. The events are
+ * not accessible: xdf_get_event() and the queries of XDF_F_NEVENT and
+ * XDF_F_NEVTTYPE fail with EPERM. The data cannot be transferred either:
+ * xdf_prepare_transfer() fails. The flag is ignored in write mode.
+ *
  * The possible file type values are defined in the header file <xdfio.h>.
  *
  * Return: 
@@ -371,10 +553,12 @@ struct xdf* xdf_open(const char* filename, int mode, enum xdffiletype type)
 {
 	int fd, oflag;
 	struct xdf* xdf = NULL;
+	struct xdfstream stream;
 	mode_t perm = 0666;
 
 	// Argument validation
-	if ((mode & ~(XDF_WRITE|XDF_READ|XDF_TRUNC)) || !filename) {
+	if ((mode & ~(XDF_WRITE|XDF_READ|XDF_TRUNC|READ_FLAGS))
+	   || !filename) {
 		errno = EINVAL;
 		return NULL;
 	}
@@ -385,13 +569,14 @@ struct xdf* xdf_open(const char* filename, int mode, enum xdffiletype type)
 	fd = mm_open(filename, oflag, perm);
 	if (fd == -1)
 		return NULL;
+	xdfstream_init(&stream, xdfstream_fd_ops(), (void*)(intptr_t)fd);
 
 	// Structure creation
 	mode &= ~XDF_TRUNC;
-	if (mode == XDF_READ)
-		xdf = create_read_xdf(type, fd);
+	if ((mode & ~READ_FLAGS) == XDF_READ)
+		xdf = create_read_xdf(type, &stream, mode & READ_FLAGS);
 	else
-		xdf = create_write_xdf(type, fd, filename, oflag);
+		xdf = create_write_xdf(type, &stream, filename, oflag);
 
 	if (xdf == NULL)
 		mm_close(fd);
@@ -436,10 +621,12 @@ API_EXPORTED
 struct xdf* xdf_fdopen(int fd, int mode, enum xdffiletype type)
 {
 	struct xdf* xdf = NULL;
-	int closefd;
+	struct xdfstream stream;
+	int closefd, rdflags;
 
 	closefd = mode & XDF_CLOSEFD;
-	mode &= ~XDF_CLOSEFD;
+	rdflags = mode & READ_FLAGS;
+	mode &= ~(XDF_CLOSEFD|READ_FLAGS);
 
 	// Argument validation
 	if (((mode != XDF_WRITE) && (mode != XDF_READ))) {
@@ -467,10 +654,79 @@ struct xdf* xdf_fdopen(int fd, int mode, enum xdffiletype type)
 #endif
 
 	// Structure creation
+	xdfstream_init(&stream, xdfstream_fd_ops(), (void*)(intptr_t)fd);
 	if (mode == XDF_READ)
-		xdf = create_read_xdf(type, fd);
+		xdf = create_read_xdf(type, &stream, rdflags);
 	else
-		xdf = create_write_xdf(type, fd, NULL, 0);
+		xdf = create_write_xdf(type, &stream, NULL, 0);
+
+	if (xdf)
+		xdf->closefd_ondestroy = closefd;
+	return xdf;
+}
+
+
+/**
+ * xdf_open_io() - opens a XDF file stored by a custom backend
+ * @ops:        operations accessing the storage
+ * @ctx:        context passed to each operation of @ops
+ * @mode:       read or write
+ * @type:       expected/requested type
+ *
+ * xdf_open_io() is similar to xdf_fdopen() excepting that the file is
+ * accessed through the operations of @ops instead of a file descriptor.
+ * This allows to read or write a file held in memory, in an archive or on
+ * a remote storage. The same backend is used for the header and for the
+ * record transfers, which only access the storage through @ops->pread() and
+ * @ops->pwrite() at explicit offsets: no file pointer is maintained by the
+ * backend.
+ *
+ * @ops->pread(), @ops->pwrite() and @ops->size() are mandatory.
+ * @ops->sync() is called when data must reach the storage, if not NULL.
+ * @ops->close() is called when xdf_close() is called on the returned XDF
+ * structure only if @mode is combined with the XDF_CLOSEFD flag, as the file
+ * descriptor of xdf_fdopen(). The structure pointed by @ops must remain
+ * valid until then.
+ *
+ * Since the file has no name, no temporary file is created when writing:
+ * the events are kept in memory (XDF_F_EVT_MEMLIMIT cannot be set).
+ *
+ * Return:
+ * an handle to XDF file opened in case of success.
+ * Otherwise, NULL is returned and errno is set appropriately.
+ *
+ * Errors:
+ * When calling xdf_open_io(), all the possible error of xdf_open()
+ * can occur as well as the ones reported by the operations of @ops.
+ *
+ * EINVAL
+ *   @ops is NULL or one of its mandatory operations is NULL
+ */
+API_EXPORTED
+struct xdf* xdf_open_io(const struct xdf_io_ops* ops, void* ctx, int mode,
+                        enum xdffiletype type)
+{
+	struct xdf* xdf = NULL;
+	struct xdfstream stream;
+	int closefd, rdflags;
+
+	closefd = mode & XDF_CLOSEFD;
+	rdflags = mode & READ_FLAGS;
+	mode &= ~(XDF_CLOSEFD|READ_FLAGS);
+
+	// Argument validation
+	if (((mode != XDF_WRITE) && (mode != XDF_READ))
+	   || !ops || !ops->pread || !ops->pwrite || !ops->size) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	// Structure creation
+	xdfstream_init(&stream, ops, ctx);
+	if (mode == XDF_READ)
+		xdf = create_read_xdf(type, &stream, rdflags);
+	else
+		xdf = create_write_xdf(type, &stream, NULL, 0);
 
 	if (xdf)
 		xdf->closefd_ondestroy = closefd;
@@ -481,21 +737,278 @@ struct xdf* xdf_fdopen(int fd, int mode, enum xdffiletype type)
 /******************************************************
  *         Channel configuration functions            *
  ******************************************************/
+static int proceed_get_chconf(const struct xdfch* ch, enum xdffield field,
+                              union optval* val);
+
+#define MIN_CHBUCKET	64
+
+static
+unsigned int hash_label(const char* label)
+{
+	unsigned int hash = 2166136261u;
+
+	// FNV-1a hash
+	while (*label) {
+		hash ^= (unsigned char)(*label++);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+static
+const char* get_label(const struct xdfch* ch)
+{
+	union optval val = {.str = NULL};
+
+	if (proceed_get_chconf(ch, XDF_CF_LABEL, &val) || !val.str)
+		return "";
+
+	return val.str;
+}
+
+
+/* \param xdf	pointer to a xdf structure whose labels are indexed
+ * \param ich	index of the channel in the channel table
+ *
+ * Add the channel @ich to the label index, under its current label.
+ */
+static
+void link_chlabel(struct xdf* xdf, int ich)
+{
+	struct chlabel* entry = xdf->chlabel + ich;
+	unsigned int bucket;
+
+	entry->hash = hash_label(get_label(xdf->chtab[ich]));
+	bucket = entry->hash & (xdf->nchbucket-1);
+	entry->next = xdf->chbucket[bucket];
+	xdf->chbucket[bucket] = ich;
+}
+
+
+/* \param xdf	pointer to a xdf structure whose labels are indexed
+ * \param ch	channel to remove from the index
+ *
+ * Remove @ch from the label index. This must be called before its label
+ * changes since the bucket is found from it.
+ *
+ * Returns the index of @ch in the channel table, -1 if not indexed.
+ */
+static
+int unlink_chlabel(struct xdf* xdf, const struct xdfch* ch)
+{
+	int ich, *pich;
+	unsigned int bucket;
+
+	bucket = hash_label(get_label(ch)) & (xdf->nchbucket-1);
+	for (pich = xdf->chbucket + bucket; *pich >= 0;
+	     pich = &(xdf->chlabel[*pich].next)) {
+		ich = *pich;
+		if (xdf->chtab[ich] == ch) {
+			*pich = xdf->chlabel[ich].next;
+			return ich;
+		}
+	}
+
+	return -1;
+}
+
+
+static
+void drop_chlabel_index(struct xdf* xdf)
+{
+	free(xdf->chlabel);
+	free(xdf->chbucket);
+	xdf->chlabel = NULL;
+	xdf->chbucket = NULL;
+	xdf->nchbucket = 0;
+}
+
+
+/* \param xdf	pointer to a xdf structure
+ *
+ * (Re)build the index of the labels of the channels in the channel table.
+ * The index is then kept up to date when a channel is added or relabelled.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int build_chlabel_index(struct xdf* xdf)
+{
+	unsigned int i, nbucket = MIN_CHBUCKET;
+
+	drop_chlabel_index(xdf);
+	while (nbucket < 2*xdf->maxchtab)
+		nbucket *= 2;
+
+	xdf->chlabel = malloc(xdf->maxchtab*sizeof(*xdf->chlabel));
+	xdf->chbucket = malloc(nbucket*sizeof(*xdf->chbucket));
+	if ((xdf->maxchtab && !xdf->chlabel) || !xdf->chbucket) {
+		drop_chlabel_index(xdf);
+		return -1;
+	}
+
+	xdf->nchbucket = nbucket;
+	for (i = 0; i < nbucket; i++)
+		xdf->chbucket[i] = -1;
+
+	for (i = 0; i < xdf->nchtab; i++)
+		link_chlabel(xdf, i);
+
+	return 0;
+}
+
+/**
+ * struct chblock - block of the arena holding the channel descriptors
+ * @next:	block allocated before this one
+ * @nch:	number of descriptors that fit in the block
+ * @used:	number of descriptors already allocated from the block
+ * @data:	storage of the descriptors (aligned for any of them)
+ */
+struct chblock {
+	struct chblock* next;
+	unsigned int nch, used;
+	union {
+		long double ld;
+		int64_t i;
+		void* p;
+	} data[];
+};
+
+
+/* \param xdf		pointer to a xdf structure
+ * \param maxchtab	new size of the channel table
+ *
+ * Grow the channel table. The label index is sized after it: it is
+ * rebuilt, which the geometric growth of the table keeps amortized.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int grow_chtab(struct xdf* xdf, unsigned int maxchtab)
+{
+	struct xdfch** chtab;
+
+	chtab = realloc(xdf->chtab, maxchtab*sizeof(*chtab));
+	if (chtab == NULL)
+		return -1;
+
+	xdf->chtab = chtab;
+	xdf->maxchtab = maxchtab;
+	return build_chlabel_index(xdf);
+}
+
+
+/* \param xdf	pointer to a xdf structure
+ * \param nch	number of channel descriptors in the new block
+ *
+ * Add to the channel arena of @xdf a block of @nch descriptors from which
+ * the next channels are allocated.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int alloc_chblock(struct xdf* xdf, unsigned int nch)
+{
+	struct chblock* blk;
+
+	blk = malloc(sizeof(*blk) + (size_t)nch*xdf->ops->chlen);
+	if (blk == NULL)
+		return -1;
+
+	blk->nch = nch;
+	blk->used = 0;
+	blk->next = xdf->chblocks;
+	xdf->chblocks = blk;
+	return 0;
+}
+
+
+/**
+ * xdf_reserve_channels() - prepares the allocation of channels
+ * @xdf: pointer to a valid xdf structure
+ * @nch: number of channels that are going to be allocated
+ *
+ * Make room in the channel table and in the channel arena of @xdf so that
+ * the next @nch calls to xdf_alloc_channel() do not allocate memory. This
+ * is meant to be called when reading the header, once the number of
+ * channels is known, so that all descriptors end up in a single block.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN int xdf_reserve_channels(struct xdf* xdf, unsigned int nch)
+{
+	struct chblock* blk = xdf->chblocks;
+
+	if ((xdf->maxchtab - xdf->nchtab < nch)
+	    && grow_chtab(xdf, xdf->nchtab + nch))
+		return -1;
+
+	if (blk && (blk->nch - blk->used >= nch))
+		return 0;
+
+	return alloc_chblock(xdf, nch);
+}
+
+
+/**
+ * xdf_free_channels() - frees all the channels of a xdf structure
+ * @xdf: pointer to a valid xdf structure
+ *
+ * The channel descriptors are released block by block of the arena, along
+ * with the channel table and the label index.
+ */
+LOCAL_FN void xdf_free_channels(struct xdf* xdf)
+{
+	struct chblock *blk, *next;
+
+	for (blk = xdf->chblocks; blk != NULL; blk = next) {
+		next = blk->next;
+		free(blk);
+	}
+	xdf->chblocks = NULL;
+	xdf->channels = NULL;
+
+	drop_chlabel_index(xdf);
+	free(xdf->chtab);
+	xdf->chtab = NULL;
+	xdf->nchtab = xdf->maxchtab = 0;
+}
+
+
 /**
  * xdf_alloc_channel() - allocates a channel, initializes it with default
  *                       values and links it to the end of channel list
  * @xdf: pointer to a valid xdf structure
  *
+ * The channel is also appended to the channel table of @xdf which allows
+ * xdf_get_channel() to find it without walking the list. Its descriptor is
+ * taken from the channel arena of @xdf, whose blocks grow along with the
+ * table if xdf_reserve_channels() has not been called.
+ *
  * Return: the pointer to the new channel in case of success, NULL otherwise
  */
 LOCAL_FN struct xdfch* xdf_alloc_channel(struct xdf* xdf)
 {
 	const struct format_operations* ops = xdf->ops;
-	struct xdfch *ch, **plastch;
+	struct chblock* blk;
+	struct xdfch* ch;
 	char* data;
 
-	if ((data = malloc(ops->chlen)) == NULL)
+	// Grow the channel table geometrically
+	if ((xdf->nchtab == xdf->maxchtab)
+	    && grow_chtab(xdf, xdf->maxchtab ? 2*xdf->maxchtab : 16))
 		return NULL;
+
+	// The new block holds as many channels as the free room in the table
+	blk = xdf->chblocks;
+	if (!blk || (blk->used == blk->nch)) {
+		if (alloc_chblock(xdf, xdf->maxchtab - xdf->nchtab))
+			return NULL;
+		blk = xdf->chblocks;
+	}
+	data = (char*)blk->data + (size_t)(blk->used++)*ops->chlen;
 	
 	// Initialize the channel
 	memcpy(data, (char*)xdf->defaultch - ops->choff, ops->chlen);
@@ -504,12 +1017,16 @@ LOCAL_FN struct xdfch* xdf_alloc_channel(struct xdf* xdf)
 
 	// Link the channel to the end of the list
 	ch->next = NULL;
-	plastch = &(xdf->channels);
-	while (*plastch)
-		plastch = &((*plastch)->next);
-	*plastch = ch;
+	if (xdf->nchtab)
+		xdf->chtab[xdf->nchtab-1]->next = ch;
+	else
+		xdf->channels = ch;
+	xdf->chtab[xdf->nchtab++] = ch;
+	if (xdf->nchbucket)
+		link_chlabel(xdf, xdf->nchtab-1);
 
 	xdf->defaultch->offset += xdf_get_datasize(ch->inmemtype);
+	xdf->conf_gen++;
 
 	return ch;
 }
@@ -532,20 +1049,12 @@ LOCAL_FN struct xdfch* xdf_alloc_channel(struct xdf* xdf)
  */
 API_EXPORTED struct xdfch* xdf_get_channel(const struct xdf* xdf, unsigned int index)
 {
-	struct xdfch* ch = xdf->channels;
-	unsigned int ich = 0;
-
 	if ((xdf == NULL) || (index >= xdf->numch)) {
 		errno = EINVAL;
 		return NULL;
 	}
 
-	while (ch && (ich<index)) {
-		ich++;
-		ch = ch->next;
-	}
-
-	return ch;
+	return (index < xdf->nchtab) ? xdf->chtab[index] : NULL;
 }
 
 
@@ -605,6 +1114,69 @@ API_EXPORTED struct xdfch* xdf_add_channel(struct xdf* xdf, const char* label)
 }
 
 
+/**
+ * xdf_find_channel() - finds the channel descriptor handle of a label
+ * @xdf: pointer to a valid xdf structure
+ * @label: label of the requested channel
+ *
+ * xdf_find_channel() gets the channel descriptor of the first channel
+ * whose label is @label in the XDF file referenced by the handle @xdf.
+ * The labels are indexed as the channels are added or the header is read,
+ * so that finding a channel takes a constant time on average whatever the
+ * number of channels. Since the lookup does not modify @xdf, it can be
+ * called concurrently from several threads, as long as none of them
+ * modifies the channels at the same time.
+ *
+ * Return:
+ * the handle to requested channel descriptor in case of success,
+ * NULL otherwise, and errno is set
+ *
+ * Errors:
+ * EINVAL
+ *   @xdf or @label is NULL
+ *
+ * ENOENT
+ *   no channel is labelled @label
+ */
+API_EXPORTED
+struct xdfch* xdf_find_channel(const struct xdf* xdf, const char* label)
+{
+	unsigned int hash;
+	int ich, found = -1;
+
+	if ((xdf == NULL) || (label == NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	// The index is missing only if it could not be allocated
+	if (!xdf->nchbucket) {
+		for (ich = 0; (unsigned int)ich < xdf->numch; ich++)
+			if (!strcmp(get_label(xdf->chtab[ich]), label))
+				return xdf->chtab[ich];
+		errno = ENOENT;
+		return NULL;
+	}
+
+	// Channels in a bucket are not sorted: keep the first matching
+	hash = hash_label(label);
+	for (ich = xdf->chbucket[hash & (xdf->nchbucket-1)]; ich >= 0;
+	     ich = xdf->chlabel[ich].next) {
+		if ((xdf->chlabel[ich].hash == hash)
+		    && ((found < 0) || (ich < found))
+		    && !strcmp(get_label(xdf->chtab[ich]), label))
+			found = ich;
+	}
+
+	if ((found < 0) || ((unsigned int)found >= xdf->numch)) {
+		errno = ENOENT;
+		return NULL;
+	}
+
+	return xdf->chtab[found];
+}
+
+
 /* \param ch	pointer to a channel of a xdf file
  * \param field	identifier of the field to be changed
  * \param val	union containing the value
@@ -617,7 +1189,15 @@ API_EXPORTED struct xdfch* xdf_add_channel(struct xdf* xdf, const char* label)
 static int proceed_set_chconf(struct xdfch* ch, enum xdffield field,
                               union optval val)
 {
-	int retval = 0;
+	struct xdf* xdf = ch->owner;
+	int retval = 0, ich = -1;
+
+	// Invalidate the transfer objects kept from a previous transfer
+	xdf->conf_gen++;
+
+	// The label index is kept in sync with the labels
+	if ((field == XDF_CF_LABEL) && xdf->nchbucket && (ch != xdf->defaultch))
+		ich = unlink_chlabel(xdf, ch);
 
 	// Default handler
 	if (field == XDF_CF_DMIN) {
@@ -666,6 +1246,15 @@ static int proceed_set_chconf(struct xdfch* ch, enum xdffield field,
 		} else
 			retval = xdf_set_error(EPERM);
 	}
+	else if ((field == XDF_CF_TRIGMASK) || (field == XDF_CF_TRIGEDGE)) {
+		// Trigger detection emits events while writing
+		if ((ch->owner->mode != XDF_WRITE) || !ch->owner->table)
+			retval = xdf_set_error(EPERM);
+		else if (field == XDF_CF_TRIGMASK)
+			ch->trigmask = val.i;
+		else
+			ch->trigedge = val.i;
+	}
 	else
 		retval = 1;
 
@@ -675,6 +1264,9 @@ static int proceed_set_chconf(struct xdfch* ch, enum xdffield field,
 		errno = EINVAL;
 	    	retval = -1;
 	}
+
+	if (ich >= 0)
+		link_chlabel(xdf, ich);
 	
 	return retval;
 }
@@ -725,6 +1317,8 @@ static int proceed_set_chconf(struct xdfch* ch, enum xdffield field,
  * XDF_CF_ARRTYPE (enum xdftype) [same as XDF_CF_STOTYPE]
  *   specifies the type
  *   in the channel should casted to/from when accessed in the array.
+ *   XDFFLOAT16 (IEEE 754 half precision) and XDFBFLOAT16 can be used only
+ *   as array type: they are passed as uint16_t bit patterns.
  *
  * XDF_CF_PMIN (double) [min of XDF_CF_ARRTYPE]
  *   sets the minimal value
@@ -749,6 +1343,23 @@ static int proceed_set_chconf(struct xdfch* ch, enum xdffield field,
  *   sets the maximal value that a digital value can get. Cannot be set if
  *   XDF_READ. This is also automatically set by XDF_CF_STOTYPE.
  *
+ * XDF_CF_TRIGMASK (int) [0] {GDF}
+ *   designates the channel as a trigger channel if non zero. While the
+ *   data is written, the digital values of the channel are masked by this
+ *   value and an event of null duration is added (as with xdf_add_event())
+ *   at the onset of each sample where the masked value changes as selected
+ *   by XDF_CF_TRIGEDGE. The events of a record are added to the file when
+ *   the next record is transferred or when the transfer ends. Cannot be set
+ *   if XDF_READ.
+ *
+ * XDF_CF_TRIGEDGE (int) [XDF_TRIG_RISING] {GDF}
+ *   selects the changes of the masked value of a trigger channel that add
+ *   an event. If XDF_TRIG_RISING is set, an event whose code is the new
+ *   value is added when the masked value changes to a non zero value. If
+ *   XDF_TRIG_FALLING is set, an event whose code is the previous value ORed
+ *   with 0x8000 (end of event in GDF) is added when the masked value
+ *   changes from a non zero value. Cannot be set if XDF_READ.
+ *
  * XDF_CF_LABEL (const char*) [""]
  *   sets the label of the channel. Cannot be set if XDF_READ.
  *
@@ -865,6 +1476,12 @@ field, union optval* val)
 		val->type = ch->inmemtype;
 	else if (field == XDF_CF_STOTYPE)
 		val->type = ch->infiletype;
+	else if (field == XDF_CF_NCLIPPED)
+		val->ui = ch->nclipped;
+	else if (field == XDF_CF_TRIGMASK)
+		val->i = ch->trigmask;
+	else if (field == XDF_CF_TRIGEDGE)
+		val->i = ch->trigedge;
 	else
 		retval = 1;
 
@@ -940,6 +1557,20 @@ field, union optval* val)
  * XDF_CF_DMAX (double) [min of XDF_CF_STOTYPE]
  *   gets the maximal value that a digital value can get.
  *
+ * XDF_CF_NCLIPPED (unsigned int) [0]
+ *   gets the number of samples of the channel that were out of the
+ *   destination range when converted to an integer type (digital range when
+ *   writing, physical range when reading into integer arrays) and have been
+ *   clamped to it. The counter accumulates over transfers and is updated
+ *   when a transfer ends (see xdf_end_transfer()).
+ *
+ * XDF_CF_TRIGMASK (int) [0] {GDF}
+ *   gets the mask applied to the values of the channel to detect triggers
+ *   while writing, 0 if the channel is not a trigger channel.
+ *
+ * XDF_CF_TRIGEDGE (int) [XDF_TRIG_RISING] {GDF}
+ *   gets the changes of a trigger channel that add an event while writing.
+ *
  * XDF_CF_LABEL (const char*) [""]
  *   gets the label of the channel.
  *
@@ -1040,11 +1671,22 @@ int xdf_copy_chconf(struct xdfch* dst, const struct xdfch* src)
 	if (src->owner->ops->type == dst->owner->ops->type) {
 		struct xdfch* next = dst->next;
 		struct xdf* owner = dst->owner;
+		unsigned int nclipped = dst->nclipped;
+		int ich = -1;
+
+		owner->conf_gen++;
+		if (owner->nchbucket && (dst != owner->defaultch))
+			ich = unlink_chlabel(owner, dst);
+
 		memcpy(((char*)dst) - ops->choff, 
 		       ((const char*)src) - ops->choff,
 		       ops->chlen);
 		dst->owner = owner;
 		dst->next = next;
+		dst->nclipped = nclipped;
+
+		if (ich >= 0)
+			link_chlabel(owner, ich);
 
 		return 0;
 	}
@@ -1065,6 +1707,114 @@ int xdf_copy_chconf(struct xdfch* dst, const struct xdfch* src)
 }
 
 
+/**
+ * xdf_set_chconf_bulk() - sets one field of the first channels of a file
+ * @xdf:	pointer to a xdf structure
+ * @field:	identifier of the channel field to be set
+ * @nch:	number of channels to configure
+ * @values:	array of @nch values
+ *
+ * xdf_set_chconf_bulk() sets @field of the channels 0 to @nch-1 of @xdf
+ * to the successive elements of @values, as if xdf_set_chconf() had been
+ * called on each channel with @field and its value, but without parsing
+ * a variable list of arguments per channel. The type of the elements of
+ * @values is the one expected by xdf_set_chconf() for @field (for example
+ * double for XDF_CF_PMIN, const char* for XDF_CF_LABEL or double[3] for
+ * XDF_CF_ELECPOS).
+ *
+ * The channels are processed in order: if setting the value of a channel
+ * fails, the channels before it keep their new value and the ones after
+ * it are left unchanged.
+ *
+ * Return:
+ * 0 in case of success. Otherwise -1 is returned and errno is set
+ * appropriately.
+ *
+ * Errors:
+ * EINVAL
+ *   @xdf or @values is NULL, @field is not a channel field or @nch is
+ *   bigger than the number of channels
+ *
+ * EPERM, EDOM
+ *   see xdf_set_chconf()
+ */
+API_EXPORTED
+int xdf_set_chconf_bulk(struct xdf* xdf, enum xdffield field,
+                        unsigned int nch, const void* values)
+{
+	union optval val;
+	unsigned int i;
+	int argtype, retval = 0;
+
+	if (!xdf || (!values && nch) || (nch > xdf->numch)
+	    || (field < XDF_CF_FIRST)
+	    || ((argtype = get_field_type(field)) < 0))
+		return xdf_set_error(EINVAL);
+
+	// Rebuilding the label index once is cheaper than moving each
+	// channel to the bucket of its new label
+	if (field == XDF_CF_LABEL)
+		drop_chlabel_index(xdf);
+
+	for (i = 0; (i < nch) && !retval; i++) {
+		get_array_val(argtype, values, i, &val);
+		retval = proceed_set_chconf(xdf->chtab[i], field, val);
+	}
+
+	if ((field == XDF_CF_LABEL) && build_chlabel_index(xdf))
+		retval = -1;
+
+	return retval;
+}
+
+
+/**
+ * xdf_get_chconf_bulk() - gets one field of the first channels of a file
+ * @xdf:	pointer to a xdf structure
+ * @field:	identifier of the channel field to be get
+ * @nch:	number of channels to query
+ * @values:	array receiving the @nch values
+ *
+ * xdf_get_chconf_bulk() writes in the successive elements of @values the
+ * value of @field of the channels 0 to @nch-1 of @xdf, as if
+ * xdf_get_chconf() had been called on each channel. The type of the
+ * elements of @values is the one of the value pointed by the argument
+ * passed to xdf_get_chconf() for @field. For XDF_CF_LABEL and the other
+ * string fields, the returned pointers remain valid as long as the
+ * channels are not modified.
+ *
+ * Return:
+ * 0 in case of success. Otherwise -1 is returned and errno is set
+ * appropriately.
+ *
+ * Errors:
+ * EINVAL
+ *   @xdf or @values is NULL, @field is not a channel field or @nch is
+ *   bigger than the number of channels
+ */
+API_EXPORTED
+int xdf_get_chconf_bulk(const struct xdf* xdf, enum xdffield field,
+                        unsigned int nch, void* values)
+{
+	union optval val;
+	unsigned int i;
+	int argtype;
+
+	if (!xdf || (!values && nch) || (nch > xdf->numch)
+	    || (field < XDF_CF_FIRST)
+	    || ((argtype = get_field_type(field)) < 0))
+		return xdf_set_error(EINVAL);
+
+	for (i = 0; i < nch; i++) {
+		if (proceed_get_chconf(xdf->chtab[i], field, &val))
+			return -1;
+		set_array_val(argtype, &val, values, i);
+	}
+
+	return 0;
+}
+
+
 /******************************************************
  *         xDF general configuration functions        *
  ******************************************************/
@@ -1082,6 +1832,15 @@ static int proceed_set_conf(struct xdf* xdf, enum xdffield field, union optval v
 {
 	int retval = 0;
 
+	// Invalidate the transfer objects kept from a previous transfer
+	xdf->conf_gen++;
+
+	// Transfer settings are not part of the file and can always be set
+	if (field == XDF_F_CONV_LUT) {
+		xdf->use_lut = val.i;
+		return 0;
+	}
+
 	if (xdf->mode != XDF_WRITE)
 		return xdf_set_error(EPERM);
 
@@ -1156,6 +1915,15 @@ static int proceed_set_conf(struct xdf* xdf, enum xdffield field, union optval v
  *   Setting the sampling frequency modifies the number of sample per record
  *   (field XDF_F_REC_NSAMPLE).
  *
+ * XDF_F_CONV_LUT (int) [1]
+ *   enables (non zero) or disables (0) the use of lookup tables to convert
+ *   8 and 16 bits integer data into scaled floating point values. When
+ *   enabled, a table is shared by the channels with the same types and
+ *   scaling, and it is built only once as many samples as its entries
+ *   have been converted by arithmetic. Unlike other fields, this one can
+ *   be set on files opened for reading and takes effect at the next call
+ *   to xdf_prepare_transfer().
+ *
  * XDF_F_RECTIME (double) [current time] {EDF BDF GDF}
  *   sets date and time of
  *   recording. It is expressed as number of seconds elapsed since the Epoch,
@@ -1220,6 +1988,26 @@ static int proceed_set_conf(struct xdf* xdf, enum xdffield field, union optval v
  * XDF_F_GND_POS (double[3]) [0,0,0] {GDF}
  *   sets X, Y, Z coordinates of the ground electrode.
  *
+ * XDF_F_EVT_MEMLIMIT (int) [0] {GDF2}
+ *   sets the maximal number of events kept in memory while writing, 0
+ *   meaning no limit. When the limit is reached, the events are dropped
+ *   from memory: they are read back from the temporary event file when the
+ *   event table is written at xdf_close(). This bounds the memory used by
+ *   long recordings with many events, but the dropped events cannot be
+ *   retrieved anymore with xdf_get_event(), xdf_get_events() or
+ *   xdf_find_events(). Available only for files opened with xdf_open().
+ *
+ * XDF_F_CHECKPOINT (int) [0] {GDF2}
+ *   sets the number of records after which the number of records written
+ *   so far is stored in the header, 0 disabling it. Otherwise the header
+ *   is completed only by xdf_close(): if the recording is interrupted, a
+ *   checkpointed file remains readable up to the last checkpoint, and
+ *   along with the temporary event files, gdf-repair can fix it in place
+ *   (option -i) instead of copying all its data. Until xdf_close(), the
+ *   header is flagged as checkpointed in its last reserved bytes, so that
+ *   the records following the last checkpoint are not mistaken for an
+ *   event table.
+ *
  * Return: 
  * 0 in case of success. Otherwise -1 is returned and errno is set
  * appropriately.
@@ -1303,12 +2091,28 @@ static int proceed_get_conf(const struct xdf* xdf, enum xdffield field, union op
 		val->i = xdf->numch;
 	else if (field == XDF_F_FILEFMT)
 		val->i = xdf->ops->type;
-	else if (field == XDF_F_NEVTTYPE)
+	else if (((field == XDF_F_NEVTTYPE) || (field == XDF_F_NEVENT))
+	         && xdf->header_only)
+		// The events have not been read, which is not the same as none
+		retval = xdf_set_error(EPERM);
+	else if (field == XDF_F_NEVTTYPE) {
+		// All event types are known only when all events are decoded.
+		// The event table is a cache in that respect, hence the cast.
+		if (xdf->table && load_events((struct xdf*)xdf, UINT_MAX))
+			retval = -1;
 		val->i = (xdf->table != NULL) ? xdf->table->nentry : 0;
-	else if (field == XDF_F_NEVENT)
-		val->i = (xdf->table != NULL) ? xdf->table->nevent : 0;
+	} else if (field == XDF_F_NEVENT) {
+		// Some formats know the number of events only once decoded
+		if (xdf->table && (xdf->nevent_pending == NEVENT_UNKNOWN)
+		   && load_events((struct xdf*)xdf, UINT_MAX))
+			retval = -1;
+		val->i = (xdf->table != NULL) ? xdf->table->nspilled
+		         + xdf->table->nevent + xdf->nevent_pending : 0;
+	}
 	else if (field == XDF_F_NREC)
 		val->i = xdf->nrecord;
+	else if (field == XDF_F_CONV_LUT)
+		val->i = xdf->use_lut;
 	else
 		retval = 1;
 
@@ -1369,10 +2173,12 @@ static int proceed_get_conf(const struct xdf* xdf, enum xdffield field, union op
  *   gets the number of channel in the file.
  *
  * XDF_F_NEVTTYPE (int)
- *   gets the number of different event types.
+ *   gets the number of different event types. This fails with EPERM if
+ *   the file has been opened with the XDF_HEADER_ONLY flag.
  *
  * XDF_F_NEVENT (int)
- *   gets the number of events.
+ *   gets the number of events. This fails with EPERM if the file has been
+ *   opened with the XDF_HEADER_ONLY flag.
  *
  * XDF_F_NREC (int)
  *   gets the number of record in the file.
@@ -1381,6 +2187,9 @@ static int proceed_get_conf(const struct xdf* xdf, enum xdffield field, union op
  *   gets the file format type (one of the value defined
  *   by the enumeration xdffiletype other than XDF_ANY).
  *
+ * XDF_F_CONV_LUT (int) [1]
+ *   gets whether lookup tables may be used to convert data.
+ *
  * XDF_F_RECTIME (double) [current time] {EDF BDF GDF}
  *   gets date and time of
  *   recording. It is expressed as number of seconds elapsed since the Epoch,
@@ -1444,6 +2253,13 @@ static int proceed_get_conf(const struct xdf* xdf, enum xdffield field, union op
  * XDF_F_GND_POS (double[3]) [0,0,0] {GDF}
  *   gets X, Y, Z coordinates of the ground electrode.
  *
+ * XDF_F_EVT_MEMLIMIT (int) [0] {GDF2}
+ *   gets the maximal number of events kept in memory while writing.
+ *
+ * XDF_F_CHECKPOINT (int) [0] {GDF2}
+ *   gets the number of records after which the number of records written
+ *   so far is stored in the header.
+ *
  * Return: 
  * 0 in case of success. Otherwise -1 is returned and errno is set
  * appropriately.
@@ -1454,7 +2270,8 @@ static int proceed_get_conf(const struct xdf* xdf, enum xdffield field, union op
  *   accepted by the function
  *
  * EPERM
- *   the request submitted is not supported with the mode XDF_READ
+ *   the request submitted is not supported with the mode XDF_READ, or
+ *   the events are requested from a file opened with XDF_HEADER_ONLY
  *
  *
  * Example:
@@ -1595,24 +2412,69 @@ int write_event(struct xdf* xdf, struct xdfevent* evt)
 	evt = &be_evt;
 #endif
 
-	return (mm_write(xdf->tmp_event_fd, evt, sizeof(*evt)) == -1);
+	return xdf_journal_append(xdf, &xdf->evtjournal,
+	                          evt, sizeof(*evt), NULL, 0);
+}
+
+/* \param xdf	pointer to a xdf structure opened for writing
+ *
+ * Drop the events from memory if their number has reached the limit set by
+ * XDF_F_EVT_MEMLIMIT. They remain in the event journal.
+ */
+static
+void bound_event_table(struct xdf* xdf)
+{
+	if (xdf->evt_memlimit && xdf->table->nevent >= xdf->evt_memlimit)
+		spill_events(xdf->table);
+}
+
+
+static
+int write_events(struct xdf* xdf, unsigned int n, const int* types,
+                 const double* onsets, const double* durations)
+{
+	struct xdfevent evts[64];
+	unsigned int i, len;
+
+	memset(evts, 0, sizeof(evts));
+	for (; n; n -= len) {
+		len = (n > 64) ? 64 : n;
+		for (i = 0; i < len; i++) {
+			evts[i].evttype = types[i];
+			evts[i].onset = onsets[i];
+			evts[i].duration = durations ? durations[i] : 0;
+#if WORDS_BIGENDIAN
+			evts[i].evttype = bswap_32(evts[i].evttype);
+			evts[i].onset = bswap_64(evts[i].onset);
+			evts[i].duration = bswap_64(evts[i].duration);
+#endif
+		}
+
+		if (xdf_journal_append(xdf, &xdf->evtjournal, evts,
+		                       len*sizeof(evts[0]), NULL, 0))
+			return -1;
+
+		types += len;
+		onsets += len;
+		durations = durations ? durations + len : NULL;
+	}
+
+	return 0;
 }
 
 static
 int write_code(struct xdf* xdf, int code, const char* desc, int evttype)
 {
 	size_t host_desc_len = desc ? strlen(desc) : 0;
-	uint32_t desc_len = host_desc_len;
+	uint32_t hdr[3] = {evttype, code, host_desc_len};
 
 #if WORDS_BIGENDIAN
-	evttype = bswap_32(evttype);
-	code = bswap_32(code);
-	desc_len = bswap_32(desc_len);
+	hdr[0] = bswap_32(hdr[0]);
+	hdr[1] = bswap_32(hdr[1]);
+	hdr[2] = bswap_32(hdr[2]);
 #endif
-	return (mm_write(xdf->tmp_code_fd, &evttype, sizeof(evttype)) == -1
-	        || mm_write(xdf->tmp_code_fd, &code, sizeof(code)) == -1
-	        || mm_write(xdf->tmp_code_fd, &desc_len, sizeof(desc_len)) == 1
-	        || mm_write(xdf->tmp_code_fd, desc, host_desc_len) == -1);
+	return xdf_journal_append(xdf, &xdf->codejournal, hdr, sizeof(hdr),
+	                          desc, host_desc_len);
 }
 
 
@@ -1655,11 +2517,15 @@ int xdf_add_evttype(struct xdf* xdf, int code, const char* desc)
 		return -1;
 	}
 
+	// New types must be numbered after the ones of the file
+	if (load_events(xdf, UINT_MAX))
+		return -1;
+
 	evttype = add_event_entry(xdf->table, code, desc);
 	if (evttype < 0)
 		errno = ENOMEM;
 
-	if (xdf->tmp_code_fd >= 0)
+	if (xdf->codejournal.fd >= 0)
 		write_code(xdf, code, desc, evttype);
 
 	return evttype;
@@ -1700,6 +2566,9 @@ int xdf_get_evttype(struct xdf* xdf, unsigned int evttype,
 		return -1;
 	}
 
+	if (xdf->table && load_events(xdf, UINT_MAX))
+		return -1;
+
 	if ((xdf->table == NULL) || (evttype >= xdf->table->nentry)) {
 		errno = (xdf->table == NULL) ? EPERM : ERANGE;
 		return -1;
@@ -1707,7 +2576,7 @@ int xdf_get_evttype(struct xdf* xdf, unsigned int evttype,
 
 	entry = xdf->table->entry + evttype;
 	*code = entry->code;
-	*desc = strlen(entry->label) ? entry->label : NULL;
+	*desc = (entry->label && strlen(entry->label)) ? entry->label : NULL;
 
 	return 0;
 }
@@ -1726,6 +2595,9 @@ int xdf_get_evttype(struct xdf* xdf, unsigned int evttype,
  * notion of duration, @dur should be set to 0. @evttype should be a
  * value returned by a successful call to xdf_add_evttype().
  *
+ * The event is not written immediately: it is saved along with the next
+ * record of data, hence no system call is made by xdf_add_event().
+ *
  * Return: 
  * 0 in case of success. Otherwise -1 is returned and errno is set
  * appropriately.
@@ -1757,15 +2629,24 @@ int xdf_add_event(struct xdf* xdf, int evttype,
 		return -1;
 	}
 
-	if ((xdf->table == NULL) || (evttype >= (int)xdf->table->nentry)) {
-		errno = (xdf->table == NULL) ? EPERM : EINVAL;
+	if ((xdf->table == NULL) || load_events(xdf, UINT_MAX))
+		return (xdf->table == NULL) ? xdf_set_error(EPERM) : -1;
+
+	if (evttype >= (int)xdf->table->nentry) {
+		errno = EINVAL;
 		return -1;
 	}
 
-	if (xdf->tmp_event_fd >= 0)
-		write_event(xdf, &evt);
+	// Once events are spilled, the journal is their only storage
+	if (xdf->evtjournal.fd >= 0
+	   && write_event(xdf, &evt) && xdf->evt_memlimit)
+		return -1;
 
-	return add_event(xdf->table, &evt);
+	if (add_event(xdf->table, &evt))
+		return -1;
+
+	bound_event_table(xdf);
+	return 0;
 }
 
 
@@ -1791,7 +2672,8 @@ int xdf_add_event(struct xdf* xdf, int evttype,
  *   @xdf, @evttype, @start or @dur is NULL
  *
  * ERANGE
- *   @index is bigger than the number event in the file
+ *   @index is bigger than the number event in the file, or the event has
+ *   been dropped from memory (see XDF_F_EVT_MEMLIMIT)
  */
 API_EXPORTED 
 int xdf_get_event(struct xdf* xdf, unsigned int index, 
@@ -1804,15 +2686,217 @@ int xdf_get_event(struct xdf* xdf, unsigned int index,
 		return -1;
 	}
 
-	if ((xdf->table == NULL) || (index >= xdf->table->nevent)) {
+	if (xdf->table && load_events(xdf, index+1))
+		return -1;
+
+	if ((xdf->table == NULL)
+	   || (index < xdf->table->nspilled)
+	   || (index - xdf->table->nspilled >= xdf->table->nevent)) {
 		errno = (xdf->table == NULL) ? EPERM : ERANGE;
 		return -1;
 	}
 
-	evt = get_event(xdf->table, index);
+	evt = get_event(xdf->table, index - xdf->table->nspilled);
 	*evttype = evt->evttype;
 	*start = evt->onset;
 	*dur = evt->duration;
 	return 0;
 }
 
+
+/**
+ * xdf_add_events() - appends several events to the data file
+ * @xdf: pointer to a xdf structure
+ * @n: number of events to add
+ * @types: array of the @n event types
+ * @onsets: array of the @n start of the events
+ * @durations: array of the @n durations of the events (can be NULL)
+ *
+ * xdf_add_events() does the same as calling @n times xdf_add_event() with
+ * the elements of @types, @onsets and @durations, but validates and stores
+ * the events at once. If @durations is NULL, all events are added with a
+ * duration of 0.
+ *
+ * Return:
+ * 0 in case of success. Otherwise -1 is returned and errno is set
+ * appropriately. If one of the event types is invalid, no event is added.
+ *
+ * Errors:
+ * EINVAL
+ *   @xdf is NULL, @types or @onsets is NULL while @n is not 0 or one of the
+ *   event types has not been previously created by xdf_add_evttype()
+ *
+ * ENOMEM
+ *   the system is unable to allocate resources
+ *
+ * EPERM
+ *   the file referenced by @xdf has not been opened for writing or
+ *   its file format does not support events
+ */
+API_EXPORTED
+int xdf_add_events(struct xdf* xdf, unsigned int n, const int* types,
+                   const double* onsets, const double* durations)
+{
+	unsigned int i;
+	int nentry;
+
+	if (xdf == NULL || (n && (types == NULL || onsets == NULL))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((xdf->table == NULL) || load_events(xdf, UINT_MAX))
+		return (xdf->table == NULL) ? xdf_set_error(EPERM) : -1;
+
+	nentry = xdf->table->nentry;
+	for (i = 0; i < n; i++) {
+		if (types[i] < 0 || types[i] >= nentry) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	if (xdf->evtjournal.fd >= 0
+	   && write_events(xdf, n, types, onsets, durations)
+	   && xdf->evt_memlimit)
+		return -1;
+
+	if (add_events(xdf->table, n, types, onsets, durations)) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	bound_event_table(xdf);
+	return 0;
+}
+
+
+/**
+ * xdf_get_events() - gets details of several consecutive events
+ * @xdf: pointer to a xdf structure
+ * @start: index of the first event to retrieve
+ * @n: maximum number of events to retrieve
+ * @types: array receiving the event types (can be NULL)
+ * @onsets: array receiving the start of the events (can be NULL)
+ * @durations: array receiving the durations of the events (can be NULL)
+ *
+ * xdf_get_events() returns the information of the events of the file
+ * referenced by @xdf from the index @start, as would do successive calls to
+ * xdf_get_event(). At most @n events are retrieved: less are retrieved if the
+ * end of the event table is reached. The arrays that are not NULL must be
+ * large enough to hold @n values. Passing NULL skips the corresponding
+ * field.
+ *
+ * Return:
+ * the number of events retrieved in case of success. Otherwise -1 is
+ * returned and errno is set appropriately.
+ *
+ * Errors:
+ * EINVAL
+ *   @xdf is NULL
+ *
+ * EPERM
+ *   the file format of @xdf does not support events
+ *
+ * ERANGE
+ *   @start is bigger than the number event in the file, or the event has
+ *   been dropped from memory (see XDF_F_EVT_MEMLIMIT)
+ */
+API_EXPORTED
+int xdf_get_events(struct xdf* xdf, unsigned int start, unsigned int n,
+                   unsigned int* types, double* onsets, double* durations)
+{
+	unsigned int nevent;
+
+	if (xdf == NULL) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (xdf->table
+	   && load_events(xdf, (n > UINT_MAX - start) ? UINT_MAX : start+n))
+		return -1;
+
+	if ((xdf->table == NULL)
+	   || (start < xdf->table->nspilled)
+	   || (start - xdf->table->nspilled > xdf->table->nevent)) {
+		errno = (xdf->table == NULL) ? EPERM : ERANGE;
+		return -1;
+	}
+
+	start -= xdf->table->nspilled;
+	nevent = xdf->table->nevent - start;
+	if (n > nevent)
+		n = nevent;
+
+	get_events(xdf->table, start, n, types, onsets, durations);
+	return n;
+}
+
+
+/**
+ * xdf_find_events() - finds the events whose onset is in a time range
+ * @xdf: pointer to a xdf structure
+ * @t0: beginning of the time range in seconds
+ * @t1: end of the time range in seconds (excluded)
+ * @evttype: event type of the events to find. If negative, events of any
+ *           type are found.
+ * @indices: array receiving the indices of the events found (can be NULL if
+ *           @n is 0)
+ * @n: maximum number of indices to store in @indices
+ *
+ * xdf_find_events() looks for the events of the file referenced by @xdf
+ * whose onset is in [@t0, @t1) and whose type is @evttype, and stores their
+ * indices, usable with xdf_get_event(), in @indices by increasing onset. At
+ * most @n indices are stored. The events are found through an index sorted
+ * by onset, built at the first call and updated with the events added
+ * since. Hence the cost of a query grows with the logarithm of the total
+ * number of events, plus the number of events in the range. Once events
+ * have been dropped from memory (see XDF_F_EVT_MEMLIMIT), the search
+ * cannot be complete anymore and fails.
+ *
+ * Return:
+ * the number of events found in case of success, which may be bigger than
+ * @n. Otherwise -1 is returned and errno is set appropriately.
+ *
+ * Errors:
+ * EINVAL
+ *   @xdf is NULL, or @indices is NULL while @n is not 0
+ *
+ * EPERM
+ *   the file format of @xdf does not support events
+ *
+ * ENOMEM
+ *   the system is unable to allocate the index
+ *
+ * ERANGE
+ *   some events have been dropped from memory (see XDF_F_EVT_MEMLIMIT)
+ */
+API_EXPORTED
+int xdf_find_events(struct xdf* xdf, double t0, double t1, int evttype,
+                    unsigned int* indices, unsigned int n)
+{
+	int nfound;
+
+	if (xdf == NULL || (n && indices == NULL)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((xdf->table == NULL) || load_events(xdf, UINT_MAX))
+		return (xdf->table == NULL) ? xdf_set_error(EPERM) : -1;
+
+	if (xdf->table->nspilled) {
+		errno = ERANGE;
+		return -1;
+	}
+
+	nfound = find_events(xdf->table, t0, t1, evttype, indices, n);
+	if (nfound < 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	return nfound;
+}
+
@@ -20,6 +20,7 @@
 # include <config.h>
 #endif
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -27,18 +28,110 @@
 
 
 
+/* \param code   code of the event entry
+ * \param label  label of the event entry (can be NULL)
+ *
+ * Returns the hash of the combination of @code and @label (FNV-1a)
+ */
+static
+uint32_t hash_entry(int code, const char* label)
+{
+	uint32_t h = 2166136261u;
+	const unsigned char* s = (const unsigned char*)label;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		h ^= ((uint32_t)code >> (8*i)) & 0xFF;
+		h *= 16777619u;
+	}
+
+	// Distinguish a NULL label from an empty one
+	if (s == NULL)
+		return h;
+
+	h ^= 0xFF;
+	h *= 16777619u;
+	while (*s) {
+		h ^= *s++;
+		h *= 16777619u;
+	}
+
+	return h;
+}
+
+
+/* \param table  table of events
+ * \param code   code of the event entry to find
+ * \param s      label of the event entry to find (can be NULL)
+ * \param slot   pointer to the slot of the hash index where the entry is
+ *               or should be inserted (can be NULL)
+ *
+ * Returns the index of the event entry matching @code and @s, -1 if not
+ * found.
+ */
 static
-int find_entry(struct eventtable* table, int code, const char* s)
+int find_entry(struct eventtable* table, int code, const char* s,
+               unsigned int* slot)
 {
-	unsigned int i;
+	unsigned int i, mask = table->hsize - 1;
+	struct evententry* entry;
+	int ind;
+
+	if (table->hsize == 0)
+		return -1;
+
+	// Open addressing with linear probing: the index is never full
+	i = hash_entry(code, s) & mask;
+	while ((ind = table->hindex[i]) >= 0) {
+		entry = table->entry + ind;
+		if ( (entry->code == code)
+		  && ((s == NULL) == (entry->label == NULL))
+		  && (s == NULL || strcmp(entry->label, s) == 0))
+			break;
+
+		i = (i+1) & mask;
+	}
+
+	if (slot)
+		*slot = i;
+
+	return ind;
+}
 
-	for (i=0; i<table->nentry; i++) {
-		if ( (table->entry[i].code == code)
-		  && ((s == NULL) == (table->entry[i].label == NULL))
-		  && (s != NULL && strcmp(table->entry[i].label, s) == 0)) 
-			return i;
+
+/* \param table  table of events
+ * \param hsize  new size of the hash index (power of 2)
+ *
+ * Reallocate the hash index of @table and reinsert all event entries.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int resize_hindex(struct eventtable* table, unsigned int hsize)
+{
+	struct evententry* entry;
+	unsigned int i, j;
+	int* hindex;
+
+	hindex = malloc(hsize*sizeof(*hindex));
+	if (hindex == NULL)
+		return -1;
+
+	for (i=0; i<hsize; i++)
+		hindex[i] = -1;
+
+	for (j=0; j<table->nentry; j++) {
+		entry = table->entry + j;
+		i = hash_entry(entry->code, entry->label) & (hsize-1);
+		while (hindex[i] >= 0)
+			i = (i+1) & (hsize-1);
+		hindex[i] = j;
 	}
-	return -1;
+
+	free(table->hindex);
+	table->hindex = hindex;
+	table->hsize = hsize;
+	return 0;
 }
 
 
@@ -56,13 +149,20 @@ int add_event_entry(struct eventtable* table,
                           int code, const char* label)
 {
 	struct evententry *entry;
-	unsigned int roundup, nentry = table->nentry;
+	unsigned int slot, roundup, nentry = table->nentry;
 	int evttype;
 	char* elabel = NULL;
 
-	evttype = find_entry(table, code, label);
+	evttype = find_entry(table, code, label, &slot);
 	
 	if (evttype < 0) {
+		// Keep the load of the hash index below 1/2
+		if (2*(nentry+1) > table->hsize) {
+			if (resize_hindex(table, table->hsize ? 2*table->hsize : 64))
+				return -1;
+			find_entry(table, code, label, &slot);
+		}
+
 		// Resize the event type table
 		roundup = (((table->nentry+1)/64)+1)*64;
 		entry = realloc(table->entry, roundup*sizeof(*entry));
@@ -81,6 +181,7 @@ int add_event_entry(struct eventtable* table,
 		evttype = nentry;
 		entry[evttype].code = code;
 		entry[evttype].label = elabel;
+		table->hindex[slot] = evttype;
 		table->nentry++;
 	}
 
@@ -117,30 +218,292 @@ int get_event_entry(struct eventtable* table, unsigned int ind,
 LOCAL_FN
 int add_event(struct eventtable* table, struct xdfevent* evt)
 {
-	struct eventbatch* batch = table->last;
+	struct eventbatch** dir;
+	unsigned int nbatch_max, ibatch = table->nevent / N_EVT_BATCH;
 	int index = table->nevent % N_EVT_BATCH;
 
 	// Happens a batch if full
 	if (index == 0) {
-		batch = malloc(sizeof(*batch));
-		if (batch == NULL)
-			return -1;
+		// Grow the batch directory if needed. Only the directory is
+		// reallocated: the events themselves never move.
+		if (ibatch == table->nbatch_max) {
+			nbatch_max = table->nbatch_max ? 2*table->nbatch_max : 16;
+			dir = realloc(table->batch, nbatch_max*sizeof(*dir));
+			if (dir == NULL)
+				return -1;
 
-		batch->next = NULL;
-		if (table->last)
-			table->last->next = batch;
-		else
-			table->first = batch;
-		table->last = batch;
+			table->batch = dir;
+			table->nbatch_max = nbatch_max;
+		}
+
+		table->batch[ibatch] = malloc(sizeof(struct eventbatch));
+		if (table->batch[ibatch] == NULL)
+			return -1;
 	}
 
-	memcpy(batch->evt + index, evt, sizeof(*evt));
+	memcpy(table->batch[ibatch]->evt + index, evt, sizeof(*evt));
 	table->nevent++;
 
 	return 0;
 }
 
 
+/**
+ * spill_events() - drop the events of the table of events from memory
+ * @table: table of events
+ *
+ * The events are counted in @table->nspilled, so that events added later
+ * can still be numbered in the whole sequence of events. The event types
+ * are kept.
+ */
+LOCAL_FN
+void spill_events(struct eventtable* table)
+{
+	unsigned int i, nbatch;
+
+	nbatch = (table->nevent + N_EVT_BATCH - 1) / N_EVT_BATCH;
+	for (i=0; i<nbatch; i++)
+		free(table->batch[i]);
+
+	free(table->sorted);
+	table->sorted = NULL;
+	table->nsorted = 0;
+	table->nspilled += table->nevent;
+	table->nevent = 0;
+}
+
+
+/**
+ * add_events() - add several events in the table of events
+ * @table: table of events
+ * @n: number of events to add
+ * @types: array of @n event types
+ * @onsets: array of @n onsets
+ * @durations: array of @n durations (NULL means 0 for all events)
+ *
+ * Return: 0 in case of success, -1 otherwise. In case of failure, the
+ * events preceding the one that could not be stored have been added.
+ */
+LOCAL_FN
+int add_events(struct eventtable* table, unsigned int n, const int* types,
+               const double* onsets, const double* durations)
+{
+	struct xdfevent* evt;
+	unsigned int i, len, index;
+
+	while (n) {
+		// Let add_event() allocate a new batch if needed
+		index = table->nevent % N_EVT_BATCH;
+		if (index == 0) {
+			struct xdfevent first = {
+				.onset = onsets[0],
+				.duration = durations ? durations[0] : 0,
+				.evttype = types[0],
+			};
+			if (add_event(table, &first))
+				return -1;
+
+			types++;
+			onsets++;
+			durations = durations ? durations+1 : NULL;
+			n--;
+			continue;
+		}
+
+		// Fill the remaining of the last batch in one loop
+		len = N_EVT_BATCH - index;
+		if (len > n)
+			len = n;
+
+		evt = table->batch[table->nevent / N_EVT_BATCH]->evt + index;
+		for (i = 0; i < len; i++) {
+			evt[i].onset = onsets[i];
+			evt[i].duration = durations ? durations[i] : 0;
+			evt[i].evttype = types[i];
+		}
+
+		table->nevent += len;
+		types += len;
+		onsets += len;
+		durations = durations ? durations+len : NULL;
+		n -= len;
+	}
+
+	return 0;
+}
+
+
+/**
+ * get_events() - gets several consecutive events of the table of events
+ * @table: table of events
+ * @start: index of the first event to retrieve
+ * @n: number of events to retrieve (must be valid)
+ * @types: array receiving the @n event types (can be NULL)
+ * @onsets: array receiving the @n onsets (can be NULL)
+ * @durations: array receiving the @n durations (can be NULL)
+ */
+LOCAL_FN
+void get_events(struct eventtable* table, unsigned int start, unsigned int n,
+                unsigned int* types, double* onsets, double* durations)
+{
+	const struct xdfevent* evt;
+	unsigned int i, len, index;
+
+	while (n) {
+		index = start % N_EVT_BATCH;
+		len = N_EVT_BATCH - index;
+		if (len > n)
+			len = n;
+
+		evt = table->batch[start / N_EVT_BATCH]->evt + index;
+		if (types)
+			for (i = 0; i < len; i++)
+				types[i] = evt[i].evttype;
+		if (onsets)
+			for (i = 0; i < len; i++)
+				onsets[i] = evt[i].onset;
+		if (durations)
+			for (i = 0; i < len; i++)
+				durations[i] = evt[i].duration;
+
+		types = types ? types+len : NULL;
+		onsets = onsets ? onsets+len : NULL;
+		durations = durations ? durations+len : NULL;
+		start += len;
+		n -= len;
+	}
+}
+
+
+static
+int cmp_evtkey(const void* a, const void* b)
+{
+	const struct evtkey* ka = a;
+	const struct evtkey* kb = b;
+
+	if (ka->onset != kb->onset)
+		return (ka->onset < kb->onset) ? -1 : 1;
+
+	return (ka->ind < kb->ind) ? -1 : (ka->ind > kb->ind);
+}
+
+
+/* \param table  table of events
+ *
+ * Bring the index of events sorted by onset up to date with the events of
+ * @table. Only the events added since the last update are sorted, then
+ * merged into the index. Events are usually added in chronological order,
+ * in which case they are simply appended.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int update_sorted_index(struct eventtable* table)
+{
+	struct evtkey *sorted, *tail;
+	unsigned int i, j, k, ntail, nsorted = table->nsorted;
+	int in_order = 1;
+
+	if (nsorted == table->nevent)
+		return 0;
+
+	sorted = realloc(table->sorted, table->nevent*sizeof(*sorted));
+	if (sorted == NULL)
+		return -1;
+	table->sorted = sorted;
+
+	// Append the keys of the new events
+	for (i = nsorted; i < table->nevent; i++) {
+		sorted[i].onset = get_event(table, i)->onset;
+		sorted[i].ind = i;
+		if (i > 0 && sorted[i].onset < sorted[i-1].onset)
+			in_order = 0;
+	}
+	table->nsorted = table->nevent;
+	if (in_order)
+		return 0;
+
+	// Sort the new keys apart, then merge them from the end with the
+	// previous ones
+	ntail = table->nevent - nsorted;
+	tail = malloc(ntail*sizeof(*tail));
+	if (tail == NULL) {
+		table->nsorted = nsorted;
+		return -1;
+	}
+	memcpy(tail, sorted + nsorted, ntail*sizeof(*tail));
+	qsort(tail, ntail, sizeof(*tail), cmp_evtkey);
+
+	i = nsorted;
+	j = ntail;
+	k = table->nevent;
+	while (j > 0) {
+		if (i > 0 && cmp_evtkey(&sorted[i-1], &tail[j-1]) > 0)
+			sorted[--k] = sorted[--i];
+		else
+			sorted[--k] = tail[--j];
+	}
+
+	free(tail);
+	return 0;
+}
+
+
+/**
+ * find_events() - find the events whose onset is in a time range
+ * @table: table of events
+ * @t0: beginning of the time range
+ * @t1: end of the time range (excluded)
+ * @evttype: type of the events to find, any type if negative
+ * @indices: array receiving the indices of the events found (can be NULL if
+ *           @n is 0)
+ * @n: maximum number of indices to store in @indices
+ *
+ * The index sorted by onset is updated if events have been added since the
+ * last call, then searched by bisection: the cost of a query is logarithmic
+ * in the number of events plus linear in the number of events in the range.
+ * The indices are stored by increasing onset.
+ *
+ * Return: the number of events found (which may be bigger than @n) in case
+ * of success, -1 otherwise.
+ */
+LOCAL_FN
+int find_events(struct eventtable* table, double t0, double t1,
+                int evttype, unsigned int* indices, unsigned int n)
+{
+	const struct evtkey* sorted;
+	unsigned int lo, hi, mid, i;
+	int count = 0;
+
+	if (update_sorted_index(table))
+		return -1;
+
+	// Find the first event whose onset is not before t0
+	sorted = table->sorted;
+	lo = 0;
+	hi = table->nsorted;
+	while (lo < hi) {
+		mid = lo + (hi - lo)/2;
+		if (sorted[mid].onset < t0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (i = lo; i < table->nsorted && sorted[i].onset < t1; i++) {
+		if (evttype >= 0
+		   && get_event(table, sorted[i].ind)->evttype != evttype)
+			continue;
+
+		if ((unsigned int)count < n)
+			indices[count] = sorted[i].ind;
+		count++;
+	}
+
+	return count;
+}
+
+
 /**
  * create_event_table() - creates a table of events
  *
@@ -157,8 +520,14 @@ struct eventtable* create_event_table(void)
 	
 	table->nentry = 0;
 	table->entry = NULL;
+	table->hsize = 0;
+	table->hindex = NULL;
 	table->nevent = 0;
-	table->first = table->last = NULL;
+	table->nspilled = 0;
+	table->nbatch_max = 0;
+	table->batch = NULL;
+	table->nsorted = 0;
+	table->sorted = NULL;
 
 	return table;
 }
@@ -171,22 +540,21 @@ struct eventtable* create_event_table(void)
 LOCAL_FN 
 void destroy_event_table(struct eventtable* table)
 {
-	struct eventbatch *curr_batch, *next_batch;
-	unsigned int i;
+	unsigned int i, nbatch;
 
 	if (table == NULL)
 		return;
-	
-	next_batch = table->first;
-	while (next_batch) {
-		curr_batch = next_batch;
-		next_batch = next_batch->next;
-		free(curr_batch);
-	}
+
+	nbatch = (table->nevent + N_EVT_BATCH - 1) / N_EVT_BATCH;
+	for (i=0; i<nbatch; i++)
+		free(table->batch[i]);
+	free(table->batch);
+	free(table->sorted);
 
 	for (i=0; i<table->nentry; i++)
 		free(table->entry[i].label);
 	free(table->entry);
+	free(table->hindex);
 
 	free(table);
 }
@@ -202,12 +570,5 @@ void destroy_event_table(struct eventtable* table)
 LOCAL_FN
 struct xdfevent* get_event(struct eventtable* table, unsigned int index)
 {
-	struct eventbatch* batch = table->first;
-	
-	while (index >= N_EVT_BATCH) {
-		batch = batch->next;
-		index -= N_EVT_BATCH;
-	}
-
-	return batch->evt + index;
+	return table->batch[index / N_EVT_BATCH]->evt + index % N_EVT_BATCH;
 }
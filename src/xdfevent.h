@@ -19,7 +19,12 @@
 #ifndef XDFEVENT_H
 #define XDFEVENT_H
 
-#define N_EVT_BATCH	50
+// Events are stored in batches whose addresses never change. The batches
+// are referenced by a directory giving constant time access to any event.
+#define N_EVT_BATCH	64
+
+// Number of events converted at once when reading or writing event tables
+#define EVT_BLOCK	256
 
 struct xdfevent {
 	double onset, duration;
@@ -28,7 +33,12 @@ struct xdfevent {
 
 struct eventbatch {
 	struct xdfevent evt[N_EVT_BATCH];
-	struct eventbatch* next;
+};
+
+// Entry of the index of events sorted by onset
+struct evtkey {
+	double onset;
+	unsigned int ind;
 };
 
 struct evententry {
@@ -39,16 +49,30 @@ struct evententry {
 struct eventtable {
 	unsigned int nentry;
 	struct evententry *entry;
+	unsigned int hsize;
+	int* hindex;
 	unsigned int nevent;
-	struct eventbatch* first;
-	struct eventbatch* last;
+	unsigned int nspilled;
+	unsigned int nbatch_max;
+	struct eventbatch** batch;
+	unsigned int nsorted;
+	struct evtkey* sorted;
 };
 
 LOCAL_FN struct eventtable* create_event_table(void);
 LOCAL_FN void destroy_event_table(struct eventtable* table);
 LOCAL_FN int add_event(struct eventtable* table, struct xdfevent* evt);
+LOCAL_FN void spill_events(struct eventtable* table);
 LOCAL_FN struct xdfevent* get_event(struct eventtable* table,
                                      unsigned int index);
+LOCAL_FN int add_events(struct eventtable* table, unsigned int n,
+                        const int* types, const double* onsets,
+                        const double* durations);
+LOCAL_FN void get_events(struct eventtable* table, unsigned int start,
+                         unsigned int n, unsigned int* types, double* onsets,
+                         double* durations);
+LOCAL_FN int find_events(struct eventtable* table, double t0, double t1,
+                         int evttype, unsigned int* indices, unsigned int n);
 LOCAL_FN int add_event_entry(struct eventtable* table, int code,
                                                    const char* label);
 LOCAL_FN int get_event_entry(struct eventtable* table, unsigned int ind,
@@ -38,6 +38,7 @@
 #include "xdftypes.h"
 #include "xdffile.h"
 #include "xdfevent.h"
+#include "common.h"
 
 /***************************************************
  *                Local declarations               *
@@ -93,6 +94,17 @@ struct convertion_data {
 	unsigned int filetypesize, memtypesize;
 	int skip;
 	int buff_offset;
+	unsigned int nclipped;
+	unsigned int trigmask;
+	int trigedge;
+	int32_t trigprev;
+	struct convprm trigprm;
+};
+
+// Event detected on a trigger channel by the transfer thread
+struct trigevent {
+	double onset;
+	int code;
 };
 
 struct ch_array_map {
@@ -120,10 +132,246 @@ LOCAL_FN int xdf_set_error(int error)
 	return 0;
 }
 
+/***************************************************
+ *           Event and code journals               *
+ ***************************************************/
+
+/**
+ * xdf_journal_append() - appends data to the journal of a temporary file
+ * @xdf:        xdf file owning the journal
+ * @j:          journal to which the data is appended
+ * @data:       pointer to the data to append
+ * @len:        size of @data
+ * @data2:      data to append after @data (can be NULL if @len2 is 0)
+ * @len2:       size of @data2
+ *
+ * The data is only buffered: it is written to the file when the next
+ * record is written by the transfer thread (or at the end of the transfer).
+ * This avoids one system call per event in the acquisition thread while
+ * keeping the temporary files at most one record late.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN
+int xdf_journal_append(struct xdf* xdf, struct journal* j,
+                       const void* data, size_t len,
+                       const void* data2, size_t len2)
+{
+	size_t maxlen;
+	char* buff;
+	int retval = 0;
+
+	if (xdf->journal_sync)
+		mm_thr_mutex_lock(&xdf->journal_mtx);
+
+	if (j->len + len + len2 > j->maxlen) {
+		maxlen = j->maxlen ? 2*j->maxlen : 4096;
+		while (maxlen < j->len + len + len2)
+			maxlen *= 2;
+
+		buff = realloc(j->buff, maxlen);
+		if (buff == NULL) {
+			retval = -1;
+			goto exit;
+		}
+		j->buff = buff;
+		j->maxlen = maxlen;
+	}
+
+	memcpy(j->buff + j->len, data, len);
+	if (len2)
+		memcpy(j->buff + j->len + len, data2, len2);
+	j->len += len + len2;
+
+exit:
+	if (xdf->journal_sync)
+		mm_thr_mutex_unlock(&xdf->journal_mtx);
+
+	return retval;
+}
+
+
+/* \param xdf	pointer to a valid xdffile with mode XDF_WRITE
+ * \param j	journal to flush
+ *
+ * Write the data buffered in @j to its file. Only the swap of the buffers
+ * is done with the journal lock held, so that the main thread is not
+ * blocked by the write. There must be a single flushing thread at a time.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static
+int flush_journal(struct xdf* xdf, struct journal* j)
+{
+	char* buff;
+	size_t len, maxlen;
+	ssize_t wsize;
+
+	if (j->fd < 0)
+		return 0;
+
+	if (xdf->journal_sync)
+		mm_thr_mutex_lock(&xdf->journal_mtx);
+
+	buff = j->buff;
+	len = j->len;
+	maxlen = j->maxlen;
+	j->buff = j->backbuff;
+	j->maxlen = j->backmaxlen;
+	j->len = 0;
+	j->backbuff = buff;
+	j->backmaxlen = maxlen;
+
+	if (xdf->journal_sync)
+		mm_thr_mutex_unlock(&xdf->journal_mtx);
+
+	while (len) {
+		wsize = mm_write(j->fd, buff, len);
+		if (wsize == -1)
+			return -1;
+
+		len -= wsize;
+		buff += wsize;
+	}
+
+	return 0;
+}
+
+
+/**
+ * xdf_free_journal() - free the buffers of a journal
+ * @j:          journal to clean
+ */
+LOCAL_FN
+void xdf_free_journal(struct journal* j)
+{
+	free(j->buff);
+	free(j->backbuff);
+	j->buff = j->backbuff = NULL;
+	j->len = j->maxlen = j->backmaxlen = 0;
+}
+
+
+/**
+ * xdf_read_journal_events() - read back events from the event journal
+ * @xdf: pointer to a xdf structure opened for writing
+ * @start: index of the first event to read
+ * @n: number of events to read
+ * @evts: array receiving the @n events
+ *
+ * The journal is flushed before being read, hence this must not be called
+ * while the transfer thread is running.
+ *
+ * Return: 0 in case of success, -1 otherwise
+ */
+LOCAL_FN
+int xdf_read_journal_events(struct xdf* xdf, unsigned int start,
+                            unsigned int n, struct xdfevent* evts)
+{
+	char* buff = (char*)evts;
+	size_t len = n*sizeof(*evts);
+	mm_off_t off = (mm_off_t)start*sizeof(*evts);
+	ssize_t rsize;
+
+	if (flush_journal(xdf, &xdf->evtjournal))
+		return -1;
+
+	while (len) {
+		rsize = mm_pread(xdf->evtjournal.fd, buff, len, off);
+		if (rsize <= 0) {
+			if (rsize == 0)
+				errno = EIO;
+			return -1;
+		}
+
+		len -= rsize;
+		buff += rsize;
+		off += rsize;
+	}
+
+#if WORDS_BIGENDIAN
+	unsigned int i;
+
+	for (i=0; i<n; i++) {
+		evts[i].evttype = bswap_32(evts[i].evttype);
+		evts[i].onset = bswap_64(evts[i].onset);
+		evts[i].duration = bswap_64(evts[i].duration);
+	}
+#endif
+	return 0;
+}
+
+
 /***************************************************
  *        Transfer thread related functions        *
  ***************************************************/
 
+/* \param xdf	pointer to a valid xdffile with mode XDF_WRITE
+ * \param code	code of the event
+ * \param is	index of the sample of the event in the current record
+ *
+ * Queue an event detected on a trigger channel. The queue is emptied in the
+ * event table by the main thread in add_trigger_events(). As for the
+ * journals, failing to queue the event is not reported: it is dropped.
+ */
+static
+void queue_trigger_event(struct xdf* xdf, int code, unsigned int is)
+{
+	struct trigevent* evt;
+	unsigned int maxlen;
+
+	if (xdf->ntrigevt == xdf->maxtrigevt) {
+		maxlen = xdf->maxtrigevt ? 2*xdf->maxtrigevt : 64;
+		evt = realloc(xdf->trigevt, maxlen*sizeof(*evt));
+		if (!evt)
+			return;
+
+		xdf->trigevt = evt;
+		xdf->maxtrigevt = maxlen;
+	}
+
+	evt = &xdf->trigevt[xdf->ntrigevt++];
+	evt->code = code;
+	evt->onset = xdf->nrecord * xdf->rec_duration
+	             + is * xdf->rec_duration / xdf->ns_per_rec;
+}
+
+
+/* \param xdf	pointer to a valid xdffile with mode XDF_WRITE
+ * \param ch	conversion data of a trigger channel
+ * \param data	record of the channel in file type (modified)
+ *
+ * Detect the changes of the masked value of a trigger channel in a record
+ * and queue the corresponding events.
+ */
+static
+void detect_trigger_edges(struct xdf* xdf, struct convertion_data* ch,
+                          void* data)
+{
+	const int32_t* val = xdf->trigbuff;
+	uint32_t mask = ch->trigmask;
+	int32_t v, prev = ch->trigprev;
+	unsigned int i, ns = xdf->ns_per_rec;
+
+	xdf_transconv_data(ns, xdf->trigbuff, data, &ch->trigprm,
+	                   xdf->tmpbuff[1]);
+
+	i = xdf_find_change(ns, val, prev, mask);
+	while (i < ns) {
+		v = val[i] & mask;
+		if (prev && (ch->trigedge & XDF_TRIG_FALLING))
+			queue_trigger_event(xdf, prev | 0x8000, i);
+		if (v && (ch->trigedge & XDF_TRIG_RISING))
+			queue_trigger_event(xdf, v, i);
+
+		prev = v;
+		i += 1 + xdf_find_change(ns-i-1, val+i+1, prev, mask);
+	}
+
+	ch->trigprev = prev;
+}
+
+
 /* \param xdf	pointer to a valid xdffile with mode XDF_WRITE
  * 
  * Transpose recorded data from (channel,sample) to a (sample,channel)
@@ -149,14 +397,15 @@ static int write_diskrec(struct xdf* xdf)
 
 		// Convert data
 		src = srcbase + ch->buff_offset;
-		xdf_transconv_data(xdf->ns_per_rec, dst, src, &(ch->prm), buff);
+		ch->nclipped += xdf_transconv_data(xdf->ns_per_rec, dst, src,
+		                                   &(ch->prm), buff);
 
 		// Write the converted data to the file. Continue writing
 		// as long as not all data has been written
 		reqsize = xdf->ns_per_rec * ch->filetypesize;
 		fbuff = dst;
 		do {
-			wsize = mm_write(xdf->fd, fbuff, reqsize);
+			wsize = xdfstream_write(&xdf->io, fbuff, reqsize);
 			if (wsize == -1) { 
 				xdf->reportval = -errno;
 				return -1;
@@ -164,15 +413,34 @@ static int write_diskrec(struct xdf* xdf)
 			reqsize -= wsize;
 			fbuff += wsize;
 		} while (reqsize);
+
+		// The written data can now be converted in place
+		if (ch->trigmask)
+			detect_trigger_edges(xdf, ch, dst);
 	}
 
+	// Events added so far follow the record in the temporary files.
+	// Failing to write them does not affect the data file, so as
+	// xdf_add_event() the error is not reported.
+	flush_journal(xdf, &xdf->codejournal);
+	flush_journal(xdf, &xdf->evtjournal);
+
 	// Make sure that the whole record has been sent to hardware
-	if (mm_fsync(xdf->fd)) {
+	if (xdfstream_sync(&xdf->io)) {
 		xdf->reportval = -errno;
 		return -1;
 	}
 	xdf->nrecord++;
 
+	// Store the number of records in the header from time to time. It
+	// reaches the disk with the next record
+	if (xdf->checkpoint && xdf->ops->checkpoint
+	    && (xdf->nrecord % xdf->checkpoint == 0)
+	    && xdf->ops->checkpoint(xdf)) {
+		xdf->reportval = -errno;
+		return -1;
+	}
+
 	return 0;
 }
 
@@ -206,7 +474,7 @@ static int read_diskrec(struct xdf* xdf)
 		reqsize = xdf->ns_per_rec * ch->filetypesize;
 		fbuff = src;
 		do {
-			rsize = mm_read(xdf->fd, fbuff, reqsize);
+			rsize = xdfstream_read(&xdf->io, fbuff, reqsize);
 			if ((rsize == 0) || (rsize == -1)) {
 				xdf->reportval = (rsize == 0) ? 1 : -errno;
 				return -1;
@@ -219,8 +487,8 @@ static int read_diskrec(struct xdf* xdf)
 			continue;
 		// Convert data if the it will be sent to one of the arrays
 		dst = dstbase + ch->buff_offset;
-		xdf_transconv_data(xdf->ns_per_rec, dst,
-		                   src, &(ch->prm), buff);
+		ch->nclipped += xdf_transconv_data(xdf->ns_per_rec, dst,
+		                                   src, &(ch->prm), buff);
 	}
 
 	return 0;
@@ -275,6 +543,43 @@ static void* transfer_thread_fn(void* ptr)
 }
 
 
+/* \param xdf	pointer to a valid xdffile with mode XDF_WRITE
+ *
+ * Add to the event table the events queued by the transfer thread while
+ * detecting the edges of trigger channels. This must be called while the
+ * transfer thread is idle since the event table is not thread-safe.
+ */
+static
+void add_trigger_events(struct xdf* xdf)
+{
+	int types[64];
+	double onsets[64];
+	unsigned int i, n = 0;
+	int code = 0, type = -1;
+	const struct trigevent* evt;
+
+	for (i = 0; i < xdf->ntrigevt; i++) {
+		evt = &xdf->trigevt[i];
+		if ((type < 0) || (evt->code != code)) {
+			code = evt->code;
+			type = xdf_add_evttype(xdf, code, NULL);
+			if (type < 0)
+				continue;
+		}
+
+		types[n] = type;
+		onsets[n] = evt->onset;
+		if (++n == sizeof(types)/sizeof(types[0])) {
+			xdf_add_events(xdf, n, types, onsets, NULL);
+			n = 0;
+		}
+	}
+
+	xdf_add_events(xdf, n, types, onsets, NULL);
+	xdf->ntrigevt = 0;
+}
+
+
 /* \param xdf	pointer to a valid xdffile structure
  *
  * Notify the background thread that a record has to be written or read,
@@ -299,6 +604,9 @@ static int disk_transfer(struct xdf* xdf)
 	while (xdf->order && !xdf->reportval)
 		mm_thr_cond_wait(&(xdf->cond), &(xdf->mtx));
 
+	if (xdf->ntrigevt)
+		add_trigger_events(xdf);
+
 	if (xdf->reportval) {
 		if (xdf->reportval < 0) {
 			errno = -xdf->reportval;
@@ -457,7 +765,8 @@ int link_batches(int nch, struct ch_array_map* map)
  * \param nbatch        computer number of batches
  * \param sample_size   size in byte of a sample in transfer buffer
  *
- * Allocate all the buffers and temporary objects needed for the transfer
+ * Allocate the buffers and temporary objects needed for the transfer (the
+ * conversion data is allocated beforehand by setup_transfer_objects())
  */
 static
 int alloc_transfer_objects(struct xdf* xdf, int nbatch, size_t sample_size)
@@ -465,8 +774,7 @@ int alloc_transfer_objects(struct xdf* xdf, int nbatch, size_t sample_size)
 	xdf->sample_size = sample_size;
 	xdf->nbatch = nbatch;
 
-	if ( !(xdf->convdata = malloc(xdf->numch*sizeof(*(xdf->convdata))))
-	    || !(xdf->batch = malloc(xdf->nbatch*sizeof(*(xdf->batch))))
+	if ( !(xdf->batch = malloc(xdf->nbatch*sizeof(*(xdf->batch))))
 	    || !(xdf->buff = malloc(sample_size * xdf->ns_per_rec))
 	    || !(xdf->backbuff = malloc(sample_size * xdf->ns_per_rec))
 	    || !(xdf->tmpbuff[0] = malloc(xdf->ns_per_rec * 8))
@@ -478,23 +786,56 @@ int alloc_transfer_objects(struct xdf* xdf, int nbatch, size_t sample_size)
 }
 
 
+/* \param xdf	pointer of a valid xdf file
+ *
+ * Accumulate the clip counters of the transfer in the channels and reset
+ * them, so that the function can be recalled safely.
+ */
+static void collect_clip_counts(struct xdf* xdf)
+{
+	unsigned int i;
+	struct xdfch* ch = xdf->channels;
+
+	if (!xdf->convdata)
+		return;
+
+	for (i = 0; i < xdf->numch; i++, ch = ch->next) {
+		ch->nclipped += xdf->convdata[i].nclipped;
+		xdf->convdata[i].nclipped = 0;
+	}
+}
+
+
 /* \param xdf	pointer of a valid xdf file
  *
  * Free the buffers and temporary objects needed for the transfer. It will
  * reset all value to NULL so that the function can be recalled safely.
+ * The clip counters of the transfer are accumulated in the channels.
  */
 static void free_transfer_objects(struct xdf* xdf)
 {
+	unsigned int i;
+
+	collect_clip_counts(xdf);
+	if (xdf->convdata) {
+		for (i = 0; i < xdf->numch; i++) {
+			xdf_free_transform(&xdf->convdata[i].prm);
+			xdf_free_transform(&xdf->convdata[i].trigprm);
+		}
+	}
+	xdf_free_luts(&xdf->luts);
 	free(xdf->convdata);
 	free(xdf->batch);
 	free(xdf->buff);
 	free(xdf->backbuff);
 	free(xdf->tmpbuff[0]);
 	free(xdf->tmpbuff[1]);
+	free(xdf->trigbuff);
 	xdf->convdata = NULL;
 	xdf->batch = NULL;
 	xdf->buff = xdf->backbuff = NULL;
 	xdf->tmpbuff[0] = xdf->tmpbuff[1] = NULL;
+	xdf->trigbuff = NULL;
 
 	xdf->nbatch = 0;
 }
@@ -504,14 +845,18 @@ static void free_transfer_objects(struct xdf* xdf)
  * \param sample_size   size in byte the a sample in a transfer buffer
  * \param mode  XDF_READ or XDF_WRITE
  * \param map   array of channel array mapping (length: nch)
+ * \param luts  cache of the lookup tables shared by the conversions (NULL
+ *               disables them)
  * \param convdata_array  array of convertion_data to initialize
  *
  * Setup the parameters of conversion of each channels in the xDF file.
+ *
+ * Returns 0 in case of success, -1 otherwise
  */
 static
-void setup_convdata(int nch, size_t sample_size, int mode,
-                    const struct ch_array_map* map,
-                    struct convertion_data* convdata_array)
+int setup_convdata(int nch, size_t sample_size, int mode,
+                   const struct ch_array_map* map, struct lutcache* luts,
+                   struct convertion_data* convdata_array)
 {
 	int i, idx, in_str, out_str;
 	enum xdftype in_tp, out_tp;
@@ -557,10 +902,35 @@ void setup_convdata(int nch, size_t sample_size, int mode,
 			.filetypesize = xdf_get_datasize(ch->infiletype),
 			.memtypesize = xdf_get_datasize(ch->inmemtype),
 		};
-		xdf_setup_transform(&convdata->prm, swaptype,
-		                in_str, in_tp, in_mm,
-		                out_str, out_tp, out_mm);
+		if (xdf_setup_transform(&convdata->prm, swaptype,
+		                        in_str, in_tp, in_mm,
+		                        out_str, out_tp, out_mm,
+		                        convdata->skip ? NULL : luts))
+			goto error;
+
+		// Trigger channels are read back from the converted record
+		if ((mode != XDF_WRITE) || !ch->trigmask)
+			continue;
+
+		convdata->trigmask = ch->trigmask;
+		convdata->trigedge = ch->trigedge;
+		if (xdf_setup_transform(&convdata->trigprm, SWAP_IN,
+		                        out_str, out_tp, NULL,
+		                        sizeof(int32_t), XDFINT32, NULL, NULL)) {
+			xdf_free_transform(&convdata->prm);
+			goto error;
+		}
+	}
+
+	return 0;
+
+error:
+	while (--i >= 0) {
+		convdata = &convdata_array[map[i].index];
+		xdf_free_transform(&convdata->prm);
+		xdf_free_transform(&convdata->trigprm);
 	}
+	return -1;
 }
 
 
@@ -585,31 +955,54 @@ size_t compute_filerec_size(struct xdf* xdf)
 }
 
 
+/* \param xdf	pointer of a valid xdf file
+ *
+ * Setup the conversion data and the batches of the transfer and allocate
+ * its buffers. The per channel objects are allocated on the heap since the
+ * number of channels is not bounded. In case of failure, the objects
+ * already set up must be released with free_transfer_objects().
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
 static
 int setup_transfer_objects(struct xdf* xdf)
 {
 	int nch = xdf->numch;
-	struct ch_array_map mapping[nch];
-	struct convertion_data convdata[nch];
+	struct ch_array_map* mapping;
 	size_t sample_size;
-	int i, nbatch;
+	int i, nbatch, ntrig = 0, retval = -1;
+
+	mapping = malloc(nch*sizeof(*mapping));
+	xdf->convdata = calloc(nch, sizeof(*(xdf->convdata)));
+	if (!mapping || !xdf->convdata)
+		goto exit;
 
 	sample_size = init_ch_array_mapping(xdf, mapping);
-	setup_convdata(nch, sample_size, xdf->mode, mapping, convdata);
+	if (setup_convdata(nch, sample_size, xdf->mode, mapping,
+	                   xdf->use_lut ? &xdf->luts : NULL, xdf->convdata))
+		goto exit;
 	nbatch = link_batches(nch, mapping);
 
 	// Alloc of entities needed for conversion
 	if (alloc_transfer_objects(xdf, nbatch, sample_size))
-		return -1;
+		goto exit;
 
 	for (i = 0; i < nbatch; i++)
 		xdf->batch[i] = mapping[i].batch;
 
 	for (i = 0; i < nch; i++)
-		xdf->convdata[i] = convdata[i];
+		ntrig += (xdf->convdata[i].trigmask != 0);
+
+	// Values of trigger channels are checked as int32
+	if (ntrig && !(xdf->trigbuff = malloc(xdf->ns_per_rec * 4)))
+		goto exit;
 
 	xdf->filerec_size = compute_filerec_size(xdf);
-	return 0;
+	retval = 0;
+
+exit:
+	free(mapping);
+	return retval;
 }
 
 
@@ -630,6 +1023,11 @@ static int init_transfer_thread(struct xdf* xdf)
 		goto error;
 	done++;
 
+	if ((ret = mm_thr_mutex_init(&(xdf->journal_mtx), 0)))
+		goto error;
+	done++;
+	xdf->journal_sync = 1;
+
 	xdf->reportval = 0;
 	xdf->order = ORDER_INIT;
 	if ((ret = mm_thr_create(&(xdf->thid), transfer_thread_fn, xdf)))
@@ -638,15 +1036,35 @@ static int init_transfer_thread(struct xdf* xdf)
 	return 0;
 
 error:
-	if (done-- > 0)
+	xdf->journal_sync = 0;
+	if (done > 2)
+		mm_thr_mutex_deinit(&(xdf->journal_mtx));
+	if (done > 1)
 		mm_thr_cond_deinit(&(xdf->cond));
-	if (done-- > 0)
+	if (done > 0)
 		mm_thr_mutex_deinit(&(xdf->mtx));
 	errno = ret;
 	return -1;
 }
 
 
+/* \param xdf	pointer of a valid xdf file
+ *
+ * Wait for the transfer thread to complete its current operation. It is
+ * then left idle, waiting for the next order, so that a later transfer can
+ * reuse it.
+ */
+static void park_transfer_thread(struct xdf* xdf)
+{
+	mm_thr_mutex_lock(&(xdf->mtx));
+	while (xdf->order)
+		mm_thr_cond_wait(&(xdf->cond), &(xdf->mtx));
+	mm_thr_mutex_unlock(&(xdf->mtx));
+
+	xdf->parked = 1;
+}
+
+
 /* \param xdf	pointer of a valid xdf file
  *
  * Order the thread to finish, wait for it and free the synchronization
@@ -667,9 +1085,18 @@ static int finish_transfer_thread(struct xdf* xdf)
 	// Wait for the transfer thread to complete
 	mm_thr_join(xdf->thid, NULL);
 
+	if (xdf->ntrigevt)
+		add_trigger_events(xdf);
+
 	// Destroy synchronization primitives
 	mm_thr_mutex_deinit(&(xdf->mtx));
 	mm_thr_cond_deinit(&(xdf->cond));
+	xdf->journal_sync = 0;
+	mm_thr_mutex_deinit(&(xdf->journal_mtx));
+
+	// Write the events added after the last record
+	flush_journal(xdf, &xdf->codejournal);
+	flush_journal(xdf, &xdf->evtjournal);
 
 	return 0;
 }
@@ -708,7 +1135,7 @@ static int init_file_content(struct xdf* xdf)
 	sigset_t oldmask;
 	
 	block_signals(&oldmask);
-	if (xdf->ops->write_header(xdf) || mm_fsync(xdf->fd))
+	if (xdf->ops->write_header(xdf) || xdfstream_sync(&xdf->io))
 		retval = -1;
 	else
 		xdf->nrecord = 0;
@@ -728,7 +1155,7 @@ static int complete_file_content(struct xdf* xdf)
 	sigset_t oldmask;
 
 	block_signals(&oldmask);
-	if (xdf->ops->complete_file(xdf) || mm_fsync(xdf->fd))
+	if (xdf->ops->complete_file(xdf) || xdfstream_sync(&xdf->io))
 		retval = -1;
 
 	unblock_signals(&oldmask);
@@ -836,12 +1263,12 @@ void remove_tmp_event_files(struct xdf* xdf)
 
 	/* room for the suffix has been ensured during opening */
 	strcat(xdf->filename, ".event");
-	mm_close(xdf->tmp_event_fd);
+	mm_close(xdf->evtjournal.fd);
 	remove(xdf->filename);
 
 	xdf->filename[len] = '\0';
 	strcat(xdf->filename, ".code");
-	mm_close(xdf->tmp_code_fd);
+	mm_close(xdf->codejournal.fd);
 	remove(xdf->filename);
 }
 
@@ -886,7 +1313,6 @@ void remove_tmp_event_files(struct xdf* xdf)
 API_EXPORTED int xdf_close(struct xdf* xdf)
 {
 	int retval = 0;
-	struct xdfch *ch, *prev;
 
 	if (!xdf)
 		return xdf_set_error(EINVAL);
@@ -900,27 +1326,34 @@ API_EXPORTED int xdf_close(struct xdf* xdf)
 
 		if ((xdf->mode == XDF_WRITE) && complete_file_content(xdf))
 			retval = -1;
+	} else if (xdf->parked) {
+		finish_transfer_thread(xdf);
+		free_transfer_objects(xdf);
 	}
 
-	if ((xdf->fd >= 0) && xdf->closefd_ondestroy && mm_close(xdf->fd))
+	if (xdf->closefd_ondestroy && xdfstream_close(&xdf->io))
 		retval = -1;
 
 	// Free channels and file
 	free(xdf->array_stride);
+	free(xdf->array_ptr);
 	destroy_event_table(xdf->table);
 
-	/* destroy temporary event and code files */
-	if (retval == 0)
+	/* destroy temporary event and code files. If the file could not be
+	 * completed, keep them complete for recovery */
+	if (retval == 0) {
 		remove_tmp_event_files(xdf);
+	} else {
+		flush_journal(xdf, &xdf->codejournal);
+		flush_journal(xdf, &xdf->evtjournal);
+	}
+	xdf_free_journal(&xdf->evtjournal);
+	xdf_free_journal(&xdf->codejournal);
 
 	free(xdf->filename);
+	free(xdf->trigevt);
 
-	ch=xdf->channels;
-	while (ch) {
-		prev = ch;
-		ch = ch->next;
-		free((char*)prev - xdf->ops->choff);
-	}
+	xdf_free_channels(xdf);
 	free((char*)xdf - xdf->ops->fileoff);
 
 	return retval;
@@ -960,11 +1393,22 @@ API_EXPORTED int xdf_close(struct xdf* xdf)
 API_EXPORTED int xdf_define_arrays(struct xdf* xdf, unsigned int numarrays, const size_t* strides)
 {
 	size_t* newstrides;
-	if (!(newstrides = malloc(numarrays*sizeof(*(xdf->array_stride))))) 
+	char** newptrs;
+
+	// The array pointers of xdf_write() and xdf_read() are stored in the
+	// handle rather than on the stack: their number is not bounded
+	newstrides = malloc(numarrays*sizeof(*(xdf->array_stride)));
+	newptrs = malloc(numarrays*sizeof(*(xdf->array_ptr)));
+	if (!newstrides || !newptrs) {
+		free(newstrides);
+		free(newptrs);
 		return -1;
+	}
 
 	free(xdf->array_stride);
+	free(xdf->array_ptr);
 	xdf->array_stride = newstrides;
+	xdf->array_ptr = newptrs;
 	xdf->narrays = numarrays;
 	memcpy(xdf->array_stride, strides, numarrays*sizeof(*(xdf->array_stride)));
 
@@ -997,11 +1441,15 @@ API_EXPORTED int xdf_define_arrays(struct xdf* xdf, unsigned int numarrays, cons
  *
  * Errors:
  * EINVAL
- *   @xdf is NULL
+ *   @xdf is NULL, or the array type of a channel cannot be converted to
+ *   or from its storage type
  *
  * ENOMEM
  *   the system is unable to allocate memory resources
  *
+ * EPERM
+ *   the file has been opened with the XDF_HEADER_ONLY flag
+ *
  * EFBIG
  *   an attempt was made to write a file that exceeds the
  *   implementation-defined maximum file size or the process's file size
@@ -1026,15 +1474,27 @@ API_EXPORTED int xdf_prepare_transfer(struct xdf* xdf)
 	if (xdf->ready)
 		return -1;
 
-	if (setup_transfer_objects(xdf))
-		goto error;
+	if (xdf->header_only)
+		return xdf_set_error(EPERM);
+
+	// The objects kept from the previous transfer are reused if neither
+	// the channels nor the file configuration have changed since
+	if (!xdf->convdata || (xdf->transfer_gen != xdf->conf_gen)) {
+		free_transfer_objects(xdf);
+		if (setup_transfer_objects(xdf))
+			goto error;
+		xdf->transfer_gen = xdf->conf_gen;
+	}
 
 	if (xdf->mode == XDF_WRITE) {
 		if (init_file_content(xdf))
 			goto error;
 	}
 
-	if (init_transfer_thread(xdf))
+	if (xdf->parked) {
+		xdf->parked = 0;
+		xdf->reportval = 0;
+	} else if (init_transfer_thread(xdf))
 		goto error;
 
 	if (xdf->mode == XDF_READ) {
@@ -1059,6 +1519,11 @@ error:
  * xdf_end_transfer() is the opposite of xdf_prepare_transfer(): it
  * resets the xdf file to the state where it can be reconfigured for reading.
  *
+ * If the file is opened for reading, the transfer thread and buffers are
+ * kept so that a following xdf_prepare_transfer() is cheap: they are set up
+ * again only if the configuration of the file or of its channels has been
+ * changed in between.
+ *
  * Return:
  * 0 in case of success. Otherwise -1 is returned and errno is set
  * appropriately.
@@ -1090,8 +1555,6 @@ error:
  */
 API_EXPORTED int xdf_end_transfer(struct xdf* xdf)
 {
-	mm_off_t pos;
-
 	if (xdf == NULL) {
 		errno = EINVAL;
 		return -1;
@@ -1099,13 +1562,19 @@ API_EXPORTED int xdf_end_transfer(struct xdf* xdf)
 	if (xdf->ready == 0)
 		return 0;
 
-	finish_transfer_thread(xdf);
-	free_transfer_objects(xdf);
-	xdf->nbatch = 0;
+	// When reading, the transfer thread and objects are kept for the next
+	// transfer: xdf_prepare_transfer() is often called for each read
+	if (xdf->mode == XDF_READ) {
+		park_transfer_thread(xdf);
+		collect_clip_counts(xdf);
+	} else {
+		finish_transfer_thread(xdf);
+		free_transfer_objects(xdf);
+	}
 	xdf->ready = 0;
 
-	pos = mm_seek(xdf->fd, xdf->hdr_offset, SEEK_SET);
-	return (pos < 0) ? -1 : 0;
+	xdf->io.pos = xdf->hdr_offset;
+	return 0;
 }
 
 /**
@@ -1224,7 +1693,7 @@ API_EXPORTED int xdf_write(struct xdf* xdf, size_t ns, ...)
 	}
 
 	unsigned int i;
-	const char* restrict in[xdf->narrays];
+	const char* restrict * in = (const char* restrict *)xdf->array_ptr;
 	va_list ap;
 
 	// Initialization of the input buffers
@@ -1342,7 +1811,7 @@ API_EXPORTED int xdf_read(struct xdf* xdf, size_t ns, ...)
 	}
 
 	unsigned int i;
-	char* restrict out[xdf->narrays];
+	char* restrict * out = (char* restrict *)xdf->array_ptr;
 	va_list ap;
 
 	// Initialization of the output buffers
@@ -1462,8 +1931,8 @@ API_EXPORTED int xdf_seek(struct xdf* xdf, int offset, int whence)
 				xdf->reportval = 0;
 
 			fileoff = irec*xdf->filerec_size + xdf->hdr_offset;
-			if ( (mm_seek(xdf->fd, fileoff, SEEK_SET) < 0)
-			     || (read_diskrec(xdf)) )
+			xdf->io.pos = fileoff;
+			if (read_diskrec(xdf))
 				errnum = errno;
 
  			mm_thr_mutex_unlock(&(xdf->mtx));
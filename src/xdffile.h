@@ -24,12 +24,15 @@
 
 
 
+#include <limits.h>
 #include <stdbool.h>
 #include <time.h>
 
 #include "xdfio.h"
 #include <mmthread.h>
 #include <mmsysio.h>
+#include "streamops.h"
+#include "xdftypes.h"
 
 #define TYPE_INT		0
 #define TYPE_UINT		1
@@ -39,6 +42,9 @@
 #define TYPE_3DPOS		5
 #define TYPE_ICD		6
 
+// Value of nevent_pending if the events are counted only when decoded
+#define NEVENT_UNKNOWN		UINT_MAX
+
 
 union optval {
 	int i;
@@ -61,6 +67,8 @@ struct format_operations {
 	int (*write_header)(struct xdf*);
 	int (*read_header)(struct xdf*);
 	int (*complete_file)(struct xdf*);
+	int (*load_events)(struct xdf*, unsigned int);
+	int (*checkpoint)(struct xdf*);
 	enum xdffiletype type;
 	bool supported_type[XDF_NUM_DATA_TYPES];
 	int choff, fileoff;
@@ -73,15 +81,35 @@ struct xdfch {
 	int iarray, offset, digital_inmem;
 	enum xdftype inmemtype, infiletype;
 	double physical_mm[2], digital_mm[2];
+	unsigned int nclipped;
+	unsigned int trigmask;
+	int trigedge;
 	struct xdfch* next;
 	struct xdf* owner;
 };
 
+/* Entry of the label index of a channel: channels whose label hashes to
+ * the same bucket are chained by their index in the channel table */
+struct chlabel {
+	unsigned int hash;
+	int next;
+};
+
+/* Data waiting to be appended to a temporary file. Filled by the main
+ * thread in buff, flushed from backbuff by the transfer thread */
+struct journal {
+	int fd;
+	char *buff, *backbuff;
+	size_t len, maxlen, backmaxlen;
+};
+
 struct xdf {
-	int fd;					
+	struct xdfstream io;
 	char * filename;
-	int tmp_event_fd;
-	int tmp_code_fd;
+	struct journal evtjournal;
+	struct journal codejournal;
+	mm_thr_mutex_t journal_mtx;
+	int journal_sync;
 	mm_off_t hdr_offset;
 	unsigned int ready, mode;			
 	long pointer;			
@@ -90,17 +118,34 @@ struct xdf {
 	int nrecord, nrecread;
 	char *buff, *backbuff;		
 	void *tmpbuff[2];
+	void *trigbuff;
 	int reportval;
 	
 	unsigned int numch;
 	struct xdfch* channels;
+	struct xdfch** chtab;
+	unsigned int nchtab, maxchtab;
+	struct chblock* chblocks;
+	struct chlabel* chlabel;
+	int* chbucket;
+	unsigned int nchbucket;
 	struct convertion_data* convdata;
+	struct lutcache luts;
+	unsigned int conf_gen, transfer_gen;
 	unsigned int nbatch;
 	struct data_batch* batch;
 	unsigned int narrays;
 	size_t* array_stride;	
+	char** array_ptr;
+	int use_lut;
 
 	struct eventtable* table;
+	int lazy_events, status_events, header_only;
+	unsigned int nevent_pending;
+	unsigned int evt_memlimit;
+	unsigned int checkpoint;
+	struct trigevent* trigevt;
+	unsigned int ntrigevt, maxtrigevt;
 
 	/* Data format specific behavior */
 	struct xdfch* defaultch;
@@ -111,6 +156,7 @@ struct xdf {
 	mm_thr_mutex_t mtx;
 	mm_thr_cond_t cond;
 	int order;
+	int parked;
 
 	int closefd_ondestroy;
 };
@@ -118,7 +164,16 @@ struct xdf {
 LOCAL_FN enum xdffiletype xdf_guess_filetype(const unsigned char* magickey);
 LOCAL_FN struct xdf* xdf_alloc_file(enum xdffiletype type);
 LOCAL_FN struct xdfch* xdf_alloc_channel(struct xdf* owner);
+LOCAL_FN int xdf_reserve_channels(struct xdf* xdf, unsigned int nch);
+LOCAL_FN void xdf_free_channels(struct xdf* xdf);
 LOCAL_FN int xdf_set_error(int error);
+LOCAL_FN int xdf_journal_append(struct xdf* xdf, struct journal* j,
+                                const void* data, size_t len,
+                                const void* data2, size_t len2);
+LOCAL_FN void xdf_free_journal(struct journal* j);
+struct xdfevent;
+LOCAL_FN int xdf_read_journal_events(struct xdf* xdf, unsigned int start,
+                                     unsigned int n, struct xdfevent* evts);
 
 
 #endif /* XDFFILE_H */
@@ -23,6 +23,7 @@
 #define XDFIO_H
 
 #include <stddef.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -42,6 +43,8 @@ enum xdftype
 	XDFDOUBLE,
 	XDFINT64,
 	XDFUINT64,
+	XDFFLOAT16,
+	XDFBFLOAT16,
 	XDF_NUM_DATA_TYPES
 };
 
@@ -72,6 +75,7 @@ enum xdffield
 	XDF_F_NEVTTYPE,			/* int         */
 	XDF_F_NEVENT,			/* int         */
 	XDF_F_NREC,			/* int         */
+	XDF_F_CONV_LUT,			/* int         */
 
 	/* Format specific file fields */
 	XDF_F_SUBJ_DESC = 5000,		/* const char* */
@@ -90,6 +94,8 @@ enum xdffield
 	XDF_F_HEADSIZE,			/* double[3]	*/
 	XDF_F_REF_POS,			/* double[3]	*/
 	XDF_F_GND_POS,			/* double[3]	*/
+	XDF_F_EVT_MEMLIMIT,		/* int		*/
+	XDF_F_CHECKPOINT,		/* int		*/
 		
 
 	/* Channel configuration fields */
@@ -103,6 +109,9 @@ enum xdffield
 	XDF_CF_PMAX,		/* double 	*/
 	XDF_CF_DMIN,		/* double 	*/
 	XDF_CF_DMAX,		/* double 	*/
+	XDF_CF_NCLIPPED,	/* unsigned int	*/
+	XDF_CF_TRIGMASK,	/* int		*/
+	XDF_CF_TRIGEDGE,	/* int		*/
 	
 	/* Format specific channel fields */
 	XDF_CF_UNIT=20000,	/* const char*  */
@@ -118,13 +127,33 @@ enum xdffield
 #define XDF_READ	1
 #define XDF_CLOSEFD	0x10
 #define XDF_TRUNC	0x20
+#define XDF_LAZY_EVENTS	0x40
+#define XDF_STATUS_EVENTS	0x80
+#define XDF_HEADER_ONLY	0x100
+
+#define XDF_TRIG_RISING		0x01
+#define XDF_TRIG_FALLING	0x02
 
 struct xdf;
 struct xdfch;
 
+/* Storage backend of a xdf file. Each operation returns -1 and sets errno
+ * in case of error. pread() and pwrite() return the number of bytes
+ * transferred at the offset @off (0 at the end of file for pread()). sync()
+ * and close() may be NULL. */
+struct xdf_io_ops {
+	int64_t (*pread)(void* ctx, void* buf, size_t len, int64_t off);
+	int64_t (*pwrite)(void* ctx, const void* buf, size_t len, int64_t off);
+	int64_t (*size)(void* ctx);
+	int (*sync)(void* ctx);
+	int (*close)(void* ctx);
+};
+
 struct xdf* xdf_open(const char* filename, int mode,
    		enum xdffiletype type);
 struct xdf* xdf_fdopen(int fd, int mode, enum xdffiletype type);
+struct xdf* xdf_open_io(const struct xdf_io_ops* ops, void* ctx, int mode,
+                        enum xdffiletype type);
 int xdf_close(struct xdf* xdf);
 
 int xdf_set_conf(struct xdf* xdf, enum xdffield field, ...);
@@ -138,13 +167,24 @@ int xdf_add_event(struct xdf* xdf, int evttype, double onset,
              double duration);
 int xdf_get_event(struct xdf* xdf, unsigned int index, 
             unsigned int *evttype, double* start, double* dur);
+int xdf_add_events(struct xdf* xdf, unsigned int n, const int* types,
+                   const double* onsets, const double* durations);
+int xdf_get_events(struct xdf* xdf, unsigned int start, unsigned int n,
+                   unsigned int* types, double* onsets, double* durations);
+int xdf_find_events(struct xdf* xdf, double t0, double t1, int evttype,
+                    unsigned int* indices, unsigned int n);
 
 struct xdfch* xdf_get_channel(const struct xdf* xdf,
    			unsigned int index);
 struct xdfch* xdf_add_channel(struct xdf* xdf, const char* label);
+struct xdfch* xdf_find_channel(const struct xdf* xdf, const char* label);
 int xdf_set_chconf(struct xdfch* ch, enum xdffield field, ...);
 int xdf_get_chconf(const struct xdfch* ch, enum xdffield field,...);
 int xdf_copy_chconf(struct xdfch* dst, const struct xdfch* src);
+int xdf_set_chconf_bulk(struct xdf* xdf, enum xdffield field,
+                        unsigned int nch, const void* values);
+int xdf_get_chconf_bulk(const struct xdf* xdf, enum xdffield field,
+                        unsigned int nch, void* values);
 
 int xdf_define_arrays(struct xdf* xdf, unsigned int narrays,
    		const size_t* strides);
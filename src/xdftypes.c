@@ -20,7 +20,9 @@
 # include <config.h>
 #endif
 
+#include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <float.h>
 #include <limits.h>
@@ -69,12 +71,146 @@ union ui24 {
 
 #endif /* WORDS_BIGENDIAN */
 
+// Largest finite values of half precision and bfloat16 types
+#define HALF_MAX	65504.0
+#define BFLOAT16_MAX	3.38953139e38
+
+union fu32 {
+	float f;
+	uint32_t u;
+};
+
+/* \param f	value to convert
+ *
+ * Returns the IEEE 754 binary16 representation of f rounded to nearest
+ * even. Overflows go to infinity, NaNs become the quiet NaN of same sign
+ * (the payload is not kept).
+ */
+static inline uint16_t float_to_half(float f)
+{
+	const union fu32 denorm_magic = {.u = ((127-15) + (23-10) + 1) << 23};
+	union fu32 v = {.f = f};
+	uint32_t sign = v.u & 0x80000000;
+	uint32_t mant_odd;
+	uint16_t h;
+
+	v.u ^= sign;
+	if (v.u >= ((127+16) << 23)) {
+		// Inf or NaN (all exponent bits set)
+		h = (v.u > 0x7F800000) ? 0x7E00 : 0x7C00;
+	} else if (v.u < (113 << 23)) {
+		// Subnormal or zero: let the FPU do the rounding
+		v.f += denorm_magic.f;
+		h = v.u - denorm_magic.u;
+	} else {
+		// Normal: rebias exponent and round mantissa
+		mant_odd = (v.u >> 13) & 1;
+		v.u += ((uint32_t)(15-127) << 23) + 0xFFF + mant_odd;
+		h = v.u >> 13;
+	}
+
+	return h | (sign >> 16);
+}
+
+
+/* \param h	IEEE 754 binary16 value
+ *
+ * Returns the float value of h (exact)
+ */
+static inline float half_to_float(uint16_t h)
+{
+	const union fu32 magic = {.u = 113 << 23};
+	const uint32_t shifted_exp = 0x7C00 << 13;
+	union fu32 v;
+	uint32_t exp;
+
+	v.u = (uint32_t)(h & 0x7FFF) << 13;
+	exp = shifted_exp & v.u;
+	v.u += (127-15) << 23;
+	if (exp == shifted_exp) {
+		// Inf or NaN
+		v.u += (128-16) << 23;
+	} else if (exp == 0) {
+		// Zero or subnormal: renormalize
+		v.u += 1 << 23;
+		v.f -= magic.f;
+	}
+
+	v.u |= (uint32_t)(h & 0x8000) << 16;
+	return v.f;
+}
+
+
+/* \param f	value to convert
+ *
+ * Returns the bfloat16 representation of f rounded to nearest even
+ */
+static inline uint16_t float_to_bfloat16(float f)
+{
+	union fu32 v = {.f = f};
+
+	// Keep NaN a NaN, truncation could turn it into an infinity
+	if ((v.u & 0x7FFFFFFF) > 0x7F800000)
+		return (v.u >> 16) | 0x0040;
+
+	v.u += 0x7FFF + ((v.u >> 16) & 1);
+	return v.u >> 16;
+}
+
+
+/* \param h	bfloat16 value
+ *
+ * Returns the float value of h (exact)
+ */
+static inline float bfloat16_to_float(uint16_t h)
+{
+	union fu32 v = {.u = (uint32_t)h << 16};
+	return v.f;
+}
+
+
+/* \param d	value to convert
+ *
+ * Returns d rounded to float toward zero, with the lowest bit of the
+ * mantissa set if inexact (round to odd). Rounding this float to a type
+ * with at least 2 bits of mantissa less gives the same result as rounding
+ * d directly, which a rounding to nearest float would not.
+ */
+static inline float double_to_float_odd(double d)
+{
+	union fu32 v = {.f = (float)d};
+
+	if (v.f != d) {
+		// Rounded away from zero: take the previous float
+		if ((v.f < 0.0f ? -v.f : v.f) > (d < 0.0 ? -d : d))
+			v.u--;
+		v.u |= 1;
+	}
+
+	return v.f;
+}
+
+
+static inline uint16_t double_to_half(double d)
+{
+	return float_to_half(double_to_float_odd(d));
+}
+
+
+static inline uint16_t double_to_bfloat16(double d)
+{
+	return float_to_bfloat16(double_to_float_odd(d));
+}
+
+
 // Order this list in ascending order of precision 
 static const enum xdftype sortedlst[] = {
 	XDFINT8,
 	XDFUINT8,
 	XDFINT16,
 	XDFUINT16,
+	XDFBFLOAT16,
+	XDFFLOAT16,
 	XDFINT24,
 	XDFUINT24,
 	XDFINT32,
@@ -111,12 +247,16 @@ static const struct data_information data_info[] =
 	[XDFINT64] = {.size = sizeof(int64_t), .is_int = 1, .is_signed = 1,
 	              .lim = {INT64_MIN, INT64_MAX}},
 	[XDFUINT64] = {.size = sizeof(uint64_t), .is_int = 1, .is_signed = 0,
-	              .lim = {0, UINT64_MAX}}
+	              .lim = {0, UINT64_MAX}},
+	[XDFFLOAT16] = {.size = sizeof(uint16_t), .is_int = 0, .is_signed = 1,
+	              .lim = {-HALF_MAX, HALF_MAX}},
+	[XDFBFLOAT16] = {.size = sizeof(uint16_t), .is_int = 0, .is_signed = 1,
+	              .lim = {-BFLOAT16_MAX, BFLOAT16_MAX}}
 };
 
 
 
-static void scale_data_d(unsigned int ns, void* data, const struct scaling_param* scaling)
+static unsigned int scale_data_d(unsigned int ns, void* data, const struct scaling_param* scaling)
 {
 	double* tdata = data;
 	double sc = scaling->scale.d;
@@ -126,9 +266,10 @@ static void scale_data_d(unsigned int ns, void* data, const struct scaling_param
 		*tdata += off;
 		tdata++;
 	}
+	return 0;
 }
 
-static void scale_data_f(unsigned int ns, void* data, const struct scaling_param* scaling)
+static unsigned int scale_data_f(unsigned int ns, void* data, const struct scaling_param* scaling)
 {
 	float* tdata = data;
 	float sc = scaling->scale.f;
@@ -138,8 +279,62 @@ static void scale_data_f(unsigned int ns, void* data, const struct scaling_param
 		*tdata += off;
 		tdata++;
 	}
+	return 0;
+}
+
+// Prototype of a saturating scaling function: values out of the range
+// (NaN included) are clamped and counted. The loop is kept branchless and
+// the counter has the width of the data so that it can be vectorized.
+#define DEFINE_SCALE_CLIP_FN(fnname, type, field, tcnt)		\
+static unsigned int fnname(unsigned int ns, void* data, const struct scaling_param* scaling)	\
+{								\
+	type* tdata = data;					\
+	type sc = scaling->scale.field;				\
+	type off = scaling->offset.field;			\
+	type lo = scaling->lim[0].field;			\
+	type hi = scaling->lim[1].field;			\
+	type v;							\
+	unsigned int i;						\
+	tcnt nclip = 0;						\
+	for (i = 0; i < ns; i++) {				\
+		v = tdata[i];					\
+		v *= sc;					\
+		v += off;					\
+		nclip += !(v >= lo);				\
+		nclip += (v > hi);				\
+		v = (v >= lo) ? v : lo;				\
+		v = (v <= hi) ? v : hi;				\
+		tdata[i] = v;					\
+	}							\
+	return nclip;						\
 }
 
+// Same as above without scaling
+#define DEFINE_CLIP_FN(fnname, type, field, tcnt)			\
+static unsigned int fnname(unsigned int ns, void* data, const struct scaling_param* scaling)	\
+{								\
+	type* tdata = data;					\
+	type lo = scaling->lim[0].field;			\
+	type hi = scaling->lim[1].field;			\
+	type v;							\
+	unsigned int i;						\
+	tcnt nclip = 0;						\
+	for (i = 0; i < ns; i++) {				\
+		v = tdata[i];					\
+		nclip += !(v >= lo);				\
+		nclip += (v > hi);				\
+		v = (v >= lo) ? v : lo;				\
+		v = (v <= hi) ? v : hi;				\
+		tdata[i] = v;					\
+	}							\
+	return nclip;						\
+}
+
+DEFINE_SCALE_CLIP_FN(scale_clip_d, double, d, uint64_t)
+DEFINE_SCALE_CLIP_FN(scale_clip_f, float, f, uint32_t)
+DEFINE_CLIP_FN(clip_d, double, d, uint64_t)
+DEFINE_CLIP_FN(clip_f, float, f, uint32_t)
+
 // Prototype of a generic type conversion function
 #define DEFINE_CONV_FN(fnname, tsrc, tdst)				\
 static void fnname(unsigned int ns, void* restrict d, unsigned int std, const void* restrict s, unsigned int sts)	\
@@ -181,6 +376,30 @@ static void fnname(unsigned int ns, void* restrict d, unsigned int std, const vo
 	}							\
 }                                                               
                                                                 
+#define DEFINE_CONV_TOHALF_FN(fnname, tsrc, cvfn)			\
+static void fnname(unsigned int ns, void* restrict d, unsigned int std, const void* restrict s, unsigned int sts)	\
+{								\
+	const tsrc* src = s;					\
+	uint16_t* dst = d;					\
+	while(ns--) {						\
+		*dst = cvfn(*src);				\
+		dst = (uint16_t*)((char*)dst + std);		\
+		src = (const tsrc*)((const char*)src + sts);	\
+	}							\
+}
+
+#define DEFINE_CONV_FROMHALF_FN(fnname, tdst, cvfn)			\
+static void fnname(unsigned int ns, void* restrict d, unsigned int std, const void* restrict s, unsigned int sts)	\
+{								\
+	const uint16_t* src = s;				\
+	tdst* dst = d;						\
+	while(ns--) {						\
+		*dst = cvfn(*src);				\
+		dst = (tdst*)((char*)dst + std);			\
+		src = (const uint16_t*)((const char*)src + sts);	\
+	}							\
+}
+
 
 // Declaration/definition of type conversion functions
 DEFINE_CONV_FN(conv_i8_d, int8_t, double)
@@ -255,6 +474,15 @@ DEFINE_CONV_TO24_FN(conv_d_u24, double, u32)
 DEFINE_CONV_FROM24_FN(conv_i24_d, double, i32)
 DEFINE_CONV_FROM24_FN(conv_u24_d, double, u32)
 
+DEFINE_CONV_TOHALF_FN(conv_f_h, float, float_to_half)
+DEFINE_CONV_FROMHALF_FN(conv_h_f, float, half_to_float)
+DEFINE_CONV_TOHALF_FN(conv_f_bh, float, float_to_bfloat16)
+DEFINE_CONV_FROMHALF_FN(conv_bh_f, float, bfloat16_to_float)
+DEFINE_CONV_TOHALF_FN(conv_d_h, double, double_to_half)
+DEFINE_CONV_FROMHALF_FN(conv_h_d, double, half_to_float)
+DEFINE_CONV_TOHALF_FN(conv_d_bh, double, double_to_bfloat16)
+DEFINE_CONV_FROMHALF_FN(conv_bh_d, double, bfloat16_to_float)
+
 static void conv_ui24_ui24(unsigned int ns, void* restrict d, unsigned int std, const void * restrict s, unsigned int sts)
 {
 	uint8_t *dstc = d;
@@ -269,6 +497,41 @@ static void conv_ui24_ui24(unsigned int ns, void* restrict d, unsigned int std,
 	}
 }
 
+// Prototype of a table lookup function: the integer read in the source is
+// used as index in the table of precomputed destination values
+#define DEFINE_LUT_FN(fnname, tidx, tdst)				\
+static void fnname(unsigned int ns, void* restrict d, unsigned int std, const void* restrict s, unsigned int sts, const void* restrict t)	\
+{								\
+	const tidx* src = s;					\
+	const tdst* lut = t;					\
+	tdst* dst = d;						\
+	while(ns--) {						\
+		*dst = lut[*src];				\
+		dst = (tdst*)((char*)dst + std);			\
+		src = (const tidx*)((const char*)src + sts);	\
+	}							\
+}
+
+DEFINE_LUT_FN(lut_u8_h, uint8_t, uint16_t)
+DEFINE_LUT_FN(lut_u8_f, uint8_t, float)
+DEFINE_LUT_FN(lut_u8_d, uint8_t, double)
+DEFINE_LUT_FN(lut_u16_h, uint16_t, uint16_t)
+DEFINE_LUT_FN(lut_u16_f, uint16_t, float)
+DEFINE_LUT_FN(lut_u16_d, uint16_t, double)
+
+/* Table of lookup procedure. Use it by calling
+ luttable[index size - 1][destination size / 4] */
+static const lutproc luttable[2][3] = {
+	{lut_u8_h, lut_u8_f, lut_u8_d},
+	{lut_u16_h, lut_u16_f, lut_u16_d}
+};
+
+// A table bigger than this does not stay in cache and a lookup becomes
+// more expensive than the conversion and multiply-add it replaces
+#define LUT_MAX_SIZE	(256*1024)
+// Tables of a transfer beyond this would evict each other from the cache
+#define LUT_TOTAL_MAX	(1024*1024)
+
 /* Table of data conversion procedure. Use it by calling convtable[srctype][dsttype]:
  e.g.: convtable[XDFUINT24][XDFDOUBLE] to get the function that convert
  unsigned int 24-bits into double*/
@@ -309,13 +572,19 @@ static const convproc convtable[XDF_NUM_DATA_TYPES][XDF_NUM_DATA_TYPES] = {
 	               [XDFUINT24] = conv_f_u24, [XDFINT24] = conv_f_i24,
 	               [XDFUINT32] = conv_f_u32, [XDFINT32] = conv_f_i32,
 	               [XDFUINT64] = conv_f_u64, [XDFINT64] = conv_f_i64,
-		       [XDFFLOAT] = conv_f_f, [XDFDOUBLE] = conv_f_d},
+		       [XDFFLOAT] = conv_f_f, [XDFDOUBLE] = conv_f_d,
+		       [XDFFLOAT16] = conv_f_h, [XDFBFLOAT16] = conv_f_bh},
 	[XDFDOUBLE] = {[XDFUINT8] = conv_d_u8, [XDFINT8] = conv_d_i8,
 	               [XDFUINT16] = conv_d_u16, [XDFINT16] = conv_d_i16,
 	               [XDFUINT24] = conv_d_u24, [XDFINT24] = conv_d_i24,
 	               [XDFUINT32] = conv_d_u32, [XDFINT32] = conv_d_i32,
 	               [XDFUINT64] = conv_d_u64, [XDFINT64] = conv_d_i64,
-		       [XDFFLOAT] = conv_d_f, [XDFDOUBLE] = conv_d_d}
+		       [XDFFLOAT] = conv_d_f, [XDFDOUBLE] = conv_d_d,
+		       [XDFFLOAT16] = conv_d_h, [XDFBFLOAT16] = conv_d_bh},
+	[XDFFLOAT16] = {[XDFFLOAT16] = conv_ui16_ui16, [XDFFLOAT] = conv_h_f,
+	                [XDFDOUBLE] = conv_h_d},
+	[XDFBFLOAT16] = {[XDFBFLOAT16] = conv_ui16_ui16, [XDFFLOAT] = conv_bh_f,
+	                 [XDFDOUBLE] = conv_bh_d}
 };
 
 
@@ -377,6 +646,95 @@ static const swapproc swaptable[8] = {
 #endif
 
 
+/* \param lut		lookup table whose values must be computed
+ *
+ * Build the table of every possible converted values of a 8 or 16 bits
+ * integer type. The table is filled by the arithmetic conversion itself so
+ * that a lookup yields exactly the same value. It is not built if the
+ * tables of the cache would use too much memory.
+ *
+ * Returns 0 in case of success, -1 otherwise
+ */
+static int build_lut(struct convlut* lut)
+{
+	struct convprm tblprm;
+	unsigned int i, insize, outsize, nentry;
+	uint8_t* idx8;
+	uint16_t* idx16;
+	void *table, *idx, *tmp;
+
+	insize = data_info[lut->in_tp].size;
+	outsize = data_info[lut->out_tp].size;
+	nentry = 1U << (8*insize);
+	if (lut->cache->size + nentry*outsize > LUT_TOTAL_MAX)
+		return -1;
+
+	table = malloc(nentry*outsize);
+	idx = malloc(nentry*insize);
+	tmp = malloc(nentry*sizeof(double));
+	if (!table || !idx || !tmp) {
+		free(table);
+		free(idx);
+		free(tmp);
+		return -1;
+	}
+
+	// Enumerate all the bit patterns of the input type
+	idx8 = idx;
+	idx16 = idx;
+	for (i = 0; i < nentry; i++) {
+		if (insize == 1)
+			idx8[i] = i;
+		else
+			idx16[i] = i;
+	}
+
+	xdf_setup_transform(&tblprm, 0, insize, lut->in_tp, lut->in_mm,
+	                    outsize, lut->out_tp, lut->out_mm, NULL);
+	xdf_transconv_data(nentry, table, idx, &tblprm, tmp);
+	free(idx);
+	free(tmp);
+
+	lut->table = table;
+	lut->fn = luttable[insize-1][outsize/4];
+	lut->cache->size += nentry*outsize;
+	return 0;
+}
+
+
+/* \param lut		lookup table of a conversion
+ * \param ns		number of samples about to be converted
+ *
+ * Tell whether the conversion of @ns samples must use the table @lut. The
+ * table is built only once as many samples as its entries have been
+ * converted by arithmetic (by all the conversions sharing it): building it
+ * costs as much, so a transfer never spends more than twice the time of
+ * the better of both methods.
+ */
+static bool use_lut(struct convlut* lut, unsigned int ns)
+{
+	size_t nentry;
+
+	if (lut->table)
+		return true;
+
+	if (lut->disabled)
+		return false;
+
+	nentry = (size_t)1 << (8*data_info[lut->in_tp].size);
+	lut->nconv += ns;
+	if (lut->nconv < nentry)
+		return false;
+
+	if (build_lut(lut)) {
+		lut->disabled = true;
+		return false;
+	}
+
+	return true;
+}
+
+
 /**
  * xdf_transconv_data() - extracts data from packed channel (as in the GDF
  *                        file) and converts the data in the file into the data
@@ -386,46 +744,151 @@ static const swapproc swaptable[8] = {
  * @src: the source buffer
  * @prm: pointer to a structure containing the parameters for the conversion
  * @tmpbuff: a temporary buffer
+ *
+ * Return: the number of samples that have been clamped to the range of the
+ * destination
  * */
-LOCAL_FN void xdf_transconv_data(unsigned int ns, void* restrict dst, void* restrict src, const struct convprm* prm, void* restrict tmpbuff)
+LOCAL_FN unsigned int xdf_transconv_data(unsigned int ns, void* restrict dst, void* restrict src, const struct convprm* prm, void* restrict tmpbuff)
 {
 	void* in = src;
 	void* out = dst;
+	unsigned int nclip = 0;
 
 #if WORDS_BIGENDIAN
 	if (prm->swapinfn)
 		prm->swapinfn(ns, in, prm->stride1);
 #endif
 	
-	if (prm->cvfn1) {
-		if (prm->cvfn3)
-			out = tmpbuff;
-		prm->cvfn1(ns, out, prm->stride2, in, prm->stride1);
-		in = out;
-	}
+	if (prm->lut && use_lut(prm->lut, ns)) {
+		prm->lut->fn(ns, out, prm->stride3, in, prm->stride1,
+		             prm->lut->table);
+	} else {
+		if (prm->cvfn1) {
+			if (prm->cvfn3)
+				out = tmpbuff;
+			prm->cvfn1(ns, out, prm->stride2, in, prm->stride1);
+			in = out;
+		}
 
-	if (prm->scfn2)
-		prm->scfn2(ns, in, &(prm->scaling));
+		if (prm->scfn2)
+			nclip = prm->scfn2(ns, in, &(prm->scaling));
 
-	if (prm->cvfn3) {
-		out = dst;
-		prm->cvfn3(ns, out, prm->stride3, in, prm->stride2);
+		if (prm->cvfn3) {
+			out = dst;
+			prm->cvfn3(ns, out, prm->stride3, in, prm->stride2);
+		}
 	}
 
 #if WORDS_BIGENDIAN
 	if (prm->swapoutfn)
 		prm->swapoutfn(ns, out, prm->stride3);
 #endif
+
+	return nclip;
+}
+
+/* \param lim		array receiving the lower and upper bound
+ * \param tp		integer type of the destination
+ * \param mm		range of the destination (may be NULL)
+ *
+ * Compute the range to which values must be clamped before being cast to
+ * tp: mm restricted to the values of tp that a double can represent.
+ */
+static void get_clip_range(double lim[2], enum xdftype tp, const double* mm)
+{
+	double lo, hi;
+
+	lim[0] = data_info[tp].lim[0];
+	lim[1] = data_info[tp].lim[1];
+
+	// INT64_MAX and UINT64_MAX are rounded up when converted to double
+	if (tp == XDFINT64)
+		lim[1] = 9223372036854774784.0;
+	else if (tp == XDFUINT64)
+		lim[1] = 18446744073709549568.0;
+
+	if (mm) {
+		lo = (mm[0] < mm[1]) ? mm[0] : mm[1];
+		hi = (mm[0] < mm[1]) ? mm[1] : mm[0];
+		if (lo > lim[0])
+			lim[0] = lo;
+		if (hi < lim[1])
+			lim[1] = hi;
+	}
 }
 
+
+/* \param in_tp	type of the data to convert
+ * \param out_tp	type of the converted data
+ *
+ * Returns true if the conversion from in_tp to out_tp can be done by a
+ * table lookup: the input must be a 8 or 16 bits integer, and the table
+ * small enough to stay in cache.
+ */
+static bool lut_is_possible(enum xdftype in_tp, enum xdftype out_tp)
+{
+	size_t nentry;
+
+	if ((in_tp != XDFINT8) && (in_tp != XDFUINT8)
+	   && (in_tp != XDFINT16) && (in_tp != XDFUINT16))
+		return false;
+
+	if (data_info[out_tp].is_int)
+		return false;
+
+	nentry = (size_t)1 << (8*data_info[in_tp].size);
+	return nentry*data_info[out_tp].size <= LUT_MAX_SIZE;
+}
+
+
+/* \param luts		cache of the lookup tables of a transfer
+ * \param in_tp		type of the data to convert
+ * \param in_mm		range of the data to convert
+ * \param out_tp	type of the converted data
+ * \param out_mm	range of the converted data
+ *
+ * Find in @luts the lookup table of the conversion, or add it. The values
+ * of a new table are computed only when it becomes worth it.
+ *
+ * Returns the table in case of success, NULL otherwise
+ */
+static struct convlut* get_convlut(struct lutcache* luts,
+                                   enum xdftype in_tp, const double* in_mm,
+                                   enum xdftype out_tp, const double* out_mm)
+{
+	struct convlut* lut;
+
+	for (lut = luts->first; lut != NULL; lut = lut->next) {
+		if ((lut->in_tp == in_tp) && (lut->out_tp == out_tp)
+		   && !memcmp(lut->in_mm, in_mm, sizeof(lut->in_mm))
+		   && !memcmp(lut->out_mm, out_mm, sizeof(lut->out_mm)))
+			return lut;
+	}
+
+	lut = calloc(1, sizeof(*lut));
+	if (lut == NULL)
+		return NULL;
+
+	lut->cache = luts;
+	lut->in_tp = in_tp;
+	lut->out_tp = out_tp;
+	memcpy(lut->in_mm, in_mm, sizeof(lut->in_mm));
+	memcpy(lut->out_mm, out_mm, sizeof(lut->out_mm));
+	lut->next = luts->first;
+	luts->first = lut;
+	return lut;
+}
+
+
 LOCAL_FN
 int xdf_setup_transform(struct convprm* prm, int swaptype, 
 	    unsigned int in_str, enum xdftype in_tp, const double* in_mm, 
-	    unsigned int out_str, enum xdftype out_tp, const double* out_mm)
+	    unsigned int out_str, enum xdftype out_tp, const double* out_mm,
+	    struct lutcache* luts)
 {
-	int scaling = 1;
+	int scaling = 1, clip;
 	enum xdftype ti;
-	double sc, off;
+	double sc, off, lim[2];
 
 	// Initialize conversion structure
 	memset(prm, 0, sizeof(*prm));
@@ -438,20 +901,32 @@ int xdf_setup_transform(struct convprm* prm, int swaptype,
 
 	// Determine the intermediate type
 	ti =  (data_info[out_tp].is_int) ? in_tp : out_tp;
+	// Half precision types are only a storage format: compute in float,
+	// or in double if the input does not fit exactly in float
+	if ((ti == XDFFLOAT16) || (ti == XDFBFLOAT16))
+		ti = ((in_tp == XDFDOUBLE) || (data_info[in_tp].is_int
+		                               && data_info[in_tp].size > 3))
+		     ? XDFDOUBLE : XDFFLOAT;
 	if (scaling && data_info[ti].is_int)
 		ti = XDFDOUBLE;
 	if (!scaling && (!convtable[ti][out_tp] || !convtable[in_tp][ti]))
 		ti = data_info[in_tp].is_signed ? XDFINT64 : XDFUINT64;
+
+	// Floating point values cast to integer must be clamped. Float cannot
+	// represent exactly the limits of integers wider than 24 bits
+	clip = data_info[out_tp].is_int && !data_info[ti].is_int;
+	if (clip && (ti == XDFFLOAT) && (data_info[out_tp].size > 3))
+		ti = XDFDOUBLE;
 	prm->stride2 = data_info[ti].size;
 	
 	// Setup the conversion functions if needed
 	if ((in_tp != ti) || (data_info[in_tp].size != in_str)) {
-		prm->cvfn1 = convtable[in_tp][ti];
-		assert(prm->cvfn1 != NULL);
+		if (!(prm->cvfn1 = convtable[in_tp][ti]))
+			goto unsupported;
 	}
 	if ((ti != out_tp) || (data_info[out_tp].size != out_str)) {
-		prm->cvfn3 = convtable[ti][out_tp];
-		assert(prm->cvfn3 != NULL);
+		if (!(prm->cvfn3 = convtable[ti][out_tp]))
+			goto unsupported;
 	}
 	
 	// Setup scaling
@@ -471,11 +946,30 @@ int xdf_setup_transform(struct convprm* prm, int swaptype,
 		assert(prm->scfn2 != NULL);
 	}
 
+	// Setup clamping to the range of destination
+	if (clip) {
+		get_clip_range(lim, out_tp, out_mm);
+		if (ti == XDFDOUBLE) {
+			prm->scaling.lim[0].d = lim[0];
+			prm->scaling.lim[1].d = lim[1];
+			prm->scfn2 = scaling ? scale_clip_d : clip_d;
+		} else {
+			prm->scaling.lim[0].f = lim[0];
+			prm->scaling.lim[1].f = lim[1];
+			prm->scfn2 = scaling ? scale_clip_f : clip_f;
+		}
+	}
+
 	// data is never copied, so we need to call at least once conv
 	// function to copy data to back buffer
 	if (prm->cvfn1 == NULL && prm->cvfn3 == NULL)
 		prm->cvfn1 = convtable[in_tp][in_tp];
 
+	// Conversion and scaling may be replaced by a table lookup
+	if (luts && scaling && lut_is_possible(in_tp, out_tp)
+	   && !(prm->lut = get_convlut(luts, in_tp, in_mm, out_tp, out_mm)))
+		return -1;
+
 	// setup swap functions
 #if WORDS_BIGENDIAN
 	if (swaptype == SWAP_IN)
@@ -487,6 +981,44 @@ int xdf_setup_transform(struct convprm* prm, int swaptype,
 #endif
 
 	return 0;
+
+unsupported:
+	errno = EINVAL;
+	return -1;
+}
+
+
+/**
+ * xdf_free_transform() - frees the resources held by conversion parameters
+ * @prm: conversion parameters set up by xdf_setup_transform()
+ *
+ * The lookup table of @prm belongs to the cache passed at setup, which is
+ * freed by xdf_free_luts().
+ */
+LOCAL_FN void xdf_free_transform(struct convprm* prm)
+{
+	prm->lut = NULL;
+}
+
+
+/**
+ * xdf_free_luts() - frees the lookup tables of a transfer
+ * @luts: cache passed to xdf_setup_transform()
+ *
+ * This must be called once no conversion set up with @luts is used anymore.
+ */
+LOCAL_FN void xdf_free_luts(struct lutcache* luts)
+{
+	struct convlut *lut, *next;
+
+	for (lut = luts->first; lut != NULL; lut = next) {
+		next = lut->next;
+		free(lut->table);
+		free(lut);
+	}
+
+	luts->first = NULL;
+	luts->size = 0;
 }
 
 
@@ -516,6 +1048,51 @@ LOCAL_FN const struct data_information* xdf_datinfo(enum xdftype type)
 }
 
 
+// Number of samples compared at once by xdf_find_change()
+#define CHANGE_CHUNK	64
+
+/**
+ * xdf_find_change() - finds the first sample whose masked value changes
+ * @ns: number of samples in @val
+ * @val: values to inspect
+ * @ref: value (already masked) to which the samples are compared
+ * @mask: bits of the values that are compared
+ *
+ * The samples are compared by chunks with a reduction that the compiler can
+ * vectorize, so that the long runs of constant values of trigger and status
+ * channels are skipped quickly. Only the chunk holding the change is
+ * scanned sample by sample.
+ *
+ * Return: the index of the first value of @val whose bits in @mask differ
+ * from @ref, @ns if there is none.
+ */
+LOCAL_FN
+unsigned int xdf_find_change(unsigned int ns, const int32_t* val,
+                             int32_t ref, uint32_t mask)
+{
+	unsigned int i, j, len;
+	uint32_t acc;
+
+	for (i = 0; i < ns; i += len) {
+		len = (ns - i < CHANGE_CHUNK) ? ns - i : CHANGE_CHUNK;
+
+		acc = 0;
+		for (j = i; j < i+len; j++)
+			acc |= (uint32_t)(val[j] ^ ref);
+
+		if (acc & mask)
+			break;
+	}
+
+	for (; i < ns; i++) {
+		if ((uint32_t)(val[i] ^ ref) & mask)
+			break;
+	}
+
+	return i;
+}
+
+
 // Criterion masks
 #define C_INT		1	// Match the integer or float attribute
 #define C_SIGNED	2	// Match the signed/unsigned attribute
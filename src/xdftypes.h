@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "xdfio.h"
 
 #ifndef INT24_MAX
@@ -52,12 +53,34 @@ union generic_data {
 struct scaling_param {
 	union generic_data scale;
 	union generic_data offset;
+	union generic_data lim[2];
 };
 
 // Prototype of a type conversion preocedure
 typedef void (*convproc)(unsigned int, void* restrict, unsigned int, const void* restrict, unsigned int);
-typedef void (*scproc)(unsigned int, void*, const struct scaling_param*);
+typedef unsigned int (*scproc)(unsigned int, void*, const struct scaling_param*);
 typedef void (*swapproc)(unsigned int, void* restrict, unsigned int);
+typedef void (*lutproc)(unsigned int, void* restrict, unsigned int, const void* restrict, unsigned int, const void* restrict);
+
+// Lookup table of a conversion, shared by all the conversions with the same
+// types and ranges. The table is built once enough samples have been
+// converted by arithmetic.
+struct convlut {
+	struct convlut* next;
+	struct lutcache* cache;
+	enum xdftype in_tp, out_tp;
+	double in_mm[2], out_mm[2];
+	size_t nconv;
+	bool disabled;
+	lutproc fn;
+	void* table;
+};
+
+// Lookup tables of a transfer and memory used by the ones built
+struct lutcache {
+	struct convlut* first;
+	size_t size;
+};
 
 // Parameters of a type conversion
 struct convprm {
@@ -66,6 +89,7 @@ struct convprm {
 	convproc cvfn1;
 	scproc scfn2;
 	convproc cvfn3;
+	struct convlut* lut;
 #if WORDS_BIGENDIAN
 	swapproc swapinfn;
 	swapproc swapoutfn;
@@ -73,11 +97,16 @@ struct convprm {
 };
 
 LOCAL_FN const struct data_information* xdf_datinfo(enum xdftype type);
-LOCAL_FN void xdf_transconv_data(unsigned int ns, void* restrict dst, void* restrict src, const struct convprm* prm, void* restrict tmpbuff);
+LOCAL_FN unsigned int xdf_transconv_data(unsigned int ns, void* restrict dst, void* restrict src, const struct convprm* prm, void* restrict tmpbuff);
 LOCAL_FN int xdf_get_datasize(enum xdftype type);
 LOCAL_FN int xdf_setup_transform(struct convprm* prm, int swaptype,
 	    unsigned int in_str, enum xdftype in_tp, const double in_mm[2], 
-	    unsigned int out_str, enum xdftype out_tp, const double out_mm[2]);
+	    unsigned int out_str, enum xdftype out_tp, const double out_mm[2],
+	    struct lutcache* luts);
+LOCAL_FN void xdf_free_transform(struct convprm* prm);
+LOCAL_FN void xdf_free_luts(struct lutcache* luts);
+LOCAL_FN unsigned int xdf_find_change(unsigned int ns, const int32_t* val,
+                                      int32_t ref, uint32_t mask);
 
 LOCAL_FN enum xdftype get_closest_type(enum xdftype target,
 					const bool *supported_type);
@@ -0,0 +1,337 @@
+/*
+ * Copyright (C) 2019 MindMaze
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark of the conversion kernels of xdftypes.c.
+ *
+ * The kernels are static functions of the library, so the translation unit
+ * is included here directly: the benchmark exercises exactly the code that
+ * is compiled in the library, with the same flags.
+ *
+ * Results are written on standard output as CSV, one line per case:
+ *   kernel,intype,outtype,nsample,instride,outstride,ns_per_sample,gbps
+ * where gbps accounts for the bytes read and written by the kernel.
+ */
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mmargparse.h>
+#include <mmsysio.h>
+#include <mmtime.h>
+
+#include "xdftypes.c"
+
+// Number of channels interleaved in the arrays of the "array" layouts
+#define NCH_ARRAY       32
+#define NUM_REPEAT      5
+
+static const unsigned int record_lengths[] = {32, 512, 4096};
+#define MAX_RECLEN      4096
+
+static const char* const type_names[] = {
+	[XDFINT8] = "int8",
+	[XDFUINT8] = "uint8",
+	[XDFINT16] = "int16",
+	[XDFUINT16] = "uint16",
+	[XDFINT24] = "int24",
+	[XDFUINT24] = "uint24",
+	[XDFINT32] = "int32",
+	[XDFUINT32] = "uint32",
+	[XDFFLOAT] = "float",
+	[XDFDOUBLE] = "double",
+	[XDFINT64] = "int64",
+	[XDFUINT64] = "uint64",
+	[XDFFLOAT16] = "float16",
+	[XDFBFLOAT16] = "bfloat16",
+};
+
+/*
+ * Layouts of the buffers around a conversion: between a packed disk
+ * buffer and a packed buffer (intermediate conversions), or an array in
+ * which NCH_ARRAY channels are interleaved (read and write path).
+ */
+static const struct {
+	int in_nch;
+	int out_nch;
+} layouts[] = {
+	{1, 1},
+	{1, NCH_ARRAY},
+	{NCH_ARRAY, 1},
+};
+
+static const struct {
+	const char* name;
+	scproc fn;
+	enum xdftype type;
+} scale_kernels[] = {
+	{"scale_data_d", scale_data_d, XDFDOUBLE},
+	{"scale_data_f", scale_data_f, XDFFLOAT},
+	{"scale_clip_d", scale_clip_d, XDFDOUBLE},
+	{"scale_clip_f", scale_clip_f, XDFFLOAT},
+	{"clip_d", clip_d, XDFDOUBLE},
+	{"clip_f", clip_f, XDFFLOAT},
+};
+
+
+/**
+ * struct bench_case - parameters of a benchmarked kernel call
+ * @cv:         conversion kernel (NULL if @sc is used)
+ * @sc:         in-place scaling kernel (NULL if @cv is used)
+ * @scaling:    scaling parameters passed to @sc
+ * @ns:         number of samples converted per call
+ * @in_str:     stride of input buffer
+ * @out_str:    stride of output buffer
+ * @in:         input buffer
+ * @out:        output buffer
+ */
+struct bench_case {
+	convproc cv;
+	scproc sc;
+	struct scaling_param scaling;
+	unsigned int ns;
+	unsigned int in_str;
+	unsigned int out_str;
+	void* in;
+	void* out;
+};
+
+
+static int64_t min_batch_ns;
+
+
+static
+int64_t get_ns(void)
+{
+	struct timespec ts;
+
+	mm_gettime(MM_CLK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/* \param bc    benchmark case to run
+ * \param niter number of kernel call
+ *
+ * Returns the time in ns taken by @niter calls of the kernel
+ */
+static
+int64_t run_batch(const struct bench_case* bc, long niter)
+{
+	int64_t start;
+	long i;
+
+	start = get_ns();
+	if (bc->cv) {
+		for (i = 0; i < niter; i++)
+			bc->cv(bc->ns, bc->out, bc->out_str, bc->in, bc->in_str);
+	} else {
+		for (i = 0; i < niter; i++)
+			bc->sc(bc->ns, bc->in, &bc->scaling);
+	}
+
+	return get_ns() - start;
+}
+
+
+/* \param bc    benchmark case to run
+ *
+ * Returns the best time in ns of a kernel call over NUM_REPEAT batches, each
+ * batch lasting at least min_batch_ns.
+ */
+static
+double time_kernel(const struct bench_case* bc)
+{
+	long niter = 1;
+	int64_t t, best;
+	int i;
+
+	// Calibrate the number of calls per batch
+	while (run_batch(bc, niter) < min_batch_ns)
+		niter *= 2;
+
+	best = INT64_MAX;
+	for (i = 0; i < NUM_REPEAT; i++) {
+		t = run_batch(bc, niter);
+		if (t < best)
+			best = t;
+	}
+
+	return (double)best / niter;
+}
+
+
+static
+void print_result(const char* kernel, enum xdftype in_tp,
+                  enum xdftype out_tp, const struct bench_case* bc,
+                  size_t nbytes, double t)
+{
+	printf("%s,%s,%s,%u,%u,%u,%.4f,%.3f\n", kernel,
+	       type_names[in_tp], type_names[out_tp], bc->ns,
+	       bc->in_str, bc->out_str, t / bc->ns, nbytes / t);
+}
+
+
+/* \param buff  buffer to fill
+ * \param type  type of data in @buff
+ * \param ns    number of samples to write
+ * \param str   stride of @buff
+ *
+ * Fill @buff with a ramp spanning a realistic part of the range of @type
+ * (no NaN nor subnormals which would bias the timings).
+ */
+static
+void fill_buffer(void* buff, enum xdftype type, unsigned int ns,
+                 unsigned int str)
+{
+	static double ramp[MAX_RECLEN];
+	static float framp[MAX_RECLEN];
+	double lo = -1000.0, hi = 1000.0;
+	unsigned int i;
+
+	if (data_info[type].is_int) {
+		lo = data_info[type].lim[0] / 2;
+		hi = data_info[type].lim[1] / 2;
+	}
+
+	for (i = 0; i < ns; i++)
+		ramp[i] = lo + (hi - lo) * (i % 997) / 997.0;
+
+	if (convtable[XDFDOUBLE][type]) {
+		convtable[XDFDOUBLE][type](ns, buff, str, ramp, sizeof(double));
+	} else {
+		conv_d_f(ns, framp, sizeof(float), ramp, sizeof(double));
+		convtable[XDFFLOAT][type](ns, buff, str, framp, sizeof(float));
+	}
+}
+
+
+static
+void bench_conversions(void* in, void* out)
+{
+	struct bench_case bc = {.in = in, .out = out};
+	enum xdftype in_tp, out_tp;
+	unsigned int insize, outsize;
+	int il, ir;
+
+	for (in_tp = 0; in_tp < XDF_NUM_DATA_TYPES; in_tp++) {
+		for (out_tp = 0; out_tp < XDF_NUM_DATA_TYPES; out_tp++) {
+			bc.cv = convtable[in_tp][out_tp];
+			if (!bc.cv)
+				continue;
+
+			insize = data_info[in_tp].size;
+			outsize = data_info[out_tp].size;
+			for (il = 0; il < (int)MM_NELEM(layouts); il++) {
+				bc.in_str = layouts[il].in_nch * insize;
+				bc.out_str = layouts[il].out_nch * outsize;
+				for (ir = 0; ir < (int)MM_NELEM(record_lengths); ir++) {
+					bc.ns = record_lengths[ir];
+					fill_buffer(in, in_tp, bc.ns, bc.in_str);
+					print_result("conv", in_tp, out_tp, &bc,
+					             bc.ns * (insize + outsize),
+					             time_kernel(&bc));
+				}
+			}
+		}
+	}
+}
+
+
+static
+void bench_scalings(void* buff)
+{
+	struct bench_case bc = {.in = buff, .out = buff};
+	enum xdftype tp;
+	unsigned int size;
+	int ik, ir;
+
+	for (ik = 0; ik < (int)MM_NELEM(scale_kernels); ik++) {
+		bc.sc = scale_kernels[ik].fn;
+		tp = scale_kernels[ik].type;
+		size = data_info[tp].size;
+
+		// Applied repeatedly, the scaling converges toward 0.25 and the
+		// clamping range cuts in the initial ramp
+		if (tp == XDFDOUBLE) {
+			bc.scaling.scale.d = 1.0e-3;
+			bc.scaling.offset.d = 0.25;
+			bc.scaling.lim[0].d = -0.5;
+			bc.scaling.lim[1].d = 0.5;
+		} else {
+			bc.scaling.scale.f = 1.0e-3f;
+			bc.scaling.offset.f = 0.25f;
+			bc.scaling.lim[0].f = -0.5f;
+			bc.scaling.lim[1].f = 0.5f;
+		}
+
+		bc.in_str = bc.out_str = size;
+		for (ir = 0; ir < (int)MM_NELEM(record_lengths); ir++) {
+			bc.ns = record_lengths[ir];
+			fill_buffer(buff, tp, bc.ns, size);
+			print_result(scale_kernels[ik].name, tp, tp, &bc,
+			             2 * bc.ns * size, time_kernel(&bc));
+		}
+	}
+}
+
+
+int main(int argc, char* argv[])
+{
+	int min_time_us;
+	void *in, *out;
+	size_t bsize = MAX_RECLEN * NCH_ARRAY * sizeof(double);
+
+	struct mm_arg_opt cmdline_optv[] = {
+		{.name = "min-time", MM_OPT_INT, "1000", {.iptr = &min_time_us},
+		 .desc = "Minimal duration in microseconds of a timed batch"},
+	};
+
+	struct mm_arg_parser parser = {
+		.optv = cmdline_optv,
+		.num_opt = MM_NELEM(cmdline_optv),
+		.execname = argv[0],
+	};
+
+	if (mm_arg_parse(&parser, argc, argv) == MM_ARGPARSE_ERROR)
+		return EXIT_FAILURE;
+
+	min_batch_ns = (int64_t)min_time_us * 1000;
+
+	in = malloc(bsize);
+	out = malloc(bsize);
+	if (!in || !out) {
+		fprintf(stderr, "Cannot allocate buffers\n");
+		free(in);
+		free(out);
+		return EXIT_FAILURE;
+	}
+	memset(out, 0, bsize);
+
+	printf("kernel,intype,outtype,nsample,instride,outstride,"
+	       "ns_per_sample,gbps\n");
+	bench_conversions(in, out);
+	bench_scalings(in);
+
+	free(in);
+	free(out);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,470 @@
+/*
+ * Copyright (C) 2019 MindMaze
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * End-to-end benchmark of recording and reading.
+ *
+ * The write mode simulates an acquisition loop: nch channels sampled at fs
+ * are pushed by chunks of chunk samples with xdf_write(), optionally paced
+ * in real time. The read modes read back the recorded file sequentially,
+ * at random positions (xdf_seek() before each chunk) or only a subset of
+ * the channels.
+ *
+ * Results are written on standard output as CSV, one line per mode:
+ *   mode,format,nch,fs,chunk,nsample,wall_s,msample_per_s,mb_per_s,
+ *   ncall,p50_us,p99_us,max_us,blocked_s,overrun
+ * where the latencies are those of the xdf_write() or xdf_read() calls (a
+ * call of seek mode includes the xdf_seek()), blocked_s is the total time
+ * spent in those calls and overrun the number of calls that made the
+ * acquisition loop miss the deadline of the next chunk (real time only).
+ */
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <mmargparse.h>
+#include <mmsysio.h>
+#include <mmtime.h>
+#include <xdfio.h>
+
+#include "refsignal.h"
+
+// Channel taken in subset mode: one channel out of SUBSET_STEP
+#define SUBSET_STEP     8
+
+static const struct {
+	const char* name;
+	enum xdffiletype type;
+} formats[] = {
+	{"edf", XDF_EDF},
+	{"bdf", XDF_BDF},
+	{"gdf1", XDF_GDF1},
+	{"gdf2", XDF_GDF2},
+};
+
+
+struct bench_param {
+	const char* filename;
+	const char* fmtname;
+	enum xdffiletype type;
+	int nch;
+	int fs;
+	int chunk;
+	long nsample;
+	int realtime;
+	int events;
+};
+
+
+/**
+ * struct call_stats - timing of the calls of a benchmark run
+ * @lat:        array of the duration of each call (in ns)
+ * @ncall:      number of calls recorded in @lat
+ * @noverrun:   number of calls that made the loop miss a deadline
+ * @wall:       duration of the whole run (in ns)
+ */
+struct call_stats {
+	int64_t* lat;
+	long ncall;
+	long noverrun;
+	int64_t wall;
+};
+
+
+static
+int64_t get_ns(void)
+{
+	struct timespec ts;
+
+	mm_gettime(MM_CLK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static
+int cmp_int64(const void* a, const void* b)
+{
+	int64_t va = *(const int64_t*)a;
+	int64_t vb = *(const int64_t*)b;
+
+	return (va > vb) - (va < vb);
+}
+
+
+static
+int init_stats(struct call_stats* stats, long maxcall)
+{
+	*stats = (struct call_stats){.lat = malloc(maxcall * sizeof(int64_t))};
+	if (!stats->lat) {
+		fprintf(stderr, "Cannot allocate latency array\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/* \param mode          name of the benchmark mode
+ * \param p             parameters of the benchmark
+ * \param nch           number of channels transferred
+ * \param stats         timing of the run
+ *
+ * Print the CSV line summarizing @stats. The latency array is sorted in the
+ * process.
+ */
+static
+void report(const char* mode, const struct bench_param* p, int nch,
+            struct call_stats* stats)
+{
+	double nval = (double)stats->ncall * p->chunk * nch;
+	double wall_s = stats->wall * 1.0e-9;
+	int64_t blocked = 0, p50 = 0, p99 = 0, max = 0;
+	long i;
+
+	for (i = 0; i < stats->ncall; i++)
+		blocked += stats->lat[i];
+
+	if (stats->ncall) {
+		qsort(stats->lat, stats->ncall, sizeof(int64_t), cmp_int64);
+		p50 = stats->lat[stats->ncall / 2];
+		p99 = stats->lat[(stats->ncall * 99) / 100];
+		max = stats->lat[stats->ncall - 1];
+	}
+
+	printf("%s,%s,%i,%i,%i,%li,%.3f,%.3f,%.3f,%li,%.2f,%.2f,%.2f,%.3f,%li\n",
+	       mode, p->fmtname, nch, p->fs, p->chunk,
+	       stats->ncall * p->chunk, wall_s, nval / wall_s * 1.0e-6,
+	       nval * sizeof(float) / wall_s * 1.0e-6, stats->ncall,
+	       p50 * 1.0e-3, p99 * 1.0e-3, max * 1.0e-3, blocked * 1.0e-9,
+	       stats->noverrun);
+	fflush(stdout);
+}
+
+
+/* \param nch   number of channels
+ * \param ns    number of samples
+ *
+ * Returns an array of @ns interleaved samples of @nch channels holding the
+ * reference signal with a channel dependent phase. Any window of length
+ * chunk starting at i%FS is a valid chunk starting at sample i, if @ns is
+ * FS + chunk.
+ */
+static
+float* gen_signal(int nch, int ns)
+{
+	float* data;
+	int i, c;
+
+	data = malloc((size_t)ns * nch * sizeof(*data));
+	if (!data)
+		return NULL;
+
+	for (i = 0; i < ns; i++)
+		for (c = 0; c < nch; c++)
+			data[i*nch + c] = get_signal(i + 13*c);
+
+	return data;
+}
+
+
+static
+int setup_write(struct xdf* xdf, const struct bench_param* p)
+{
+	size_t strides[] = {p->nch * sizeof(float)};
+	enum xdftype stotype;
+	double dmax;
+	char label[32];
+	int c;
+
+	// Use the usual storage of the format: int16 for EDF, int24 for BDF
+	// and float for GDF
+	stotype = xdf_closest_type(xdf, XDFFLOAT);
+	dmax = (stotype == XDFFLOAT) ? 1.0 : (stotype == XDFINT16) ? 32767.0
+	                                                            : 8388607.0;
+
+	if (xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, p->fs,
+	                      XDF_CF_ARRTYPE, XDFFLOAT,
+	                      XDF_CF_ARRINDEX, 0,
+	                      XDF_CF_STOTYPE, stotype,
+	                      XDF_CF_PMIN, -1.0,
+	                      XDF_CF_PMAX, 1.0,
+	                      XDF_CF_DMIN, -dmax,
+	                      XDF_CF_DMAX, dmax,
+	                      XDF_NOF))
+		return -1;
+
+	for (c = 0; c < p->nch; c++) {
+		sprintf(label, "ch%i", c);
+		if (xdf_set_conf(xdf, XDF_CF_ARROFFSET, c * (int)sizeof(float),
+		                      XDF_NOF)
+		 || !xdf_add_channel(xdf, label))
+			return -1;
+	}
+
+	return xdf_define_arrays(xdf, 1, strides);
+}
+
+
+static
+int run_write(const struct bench_param* p)
+{
+	struct xdf* xdf;
+	struct call_stats stats;
+	struct event evt;
+	float* signal = NULL;
+	long k, nchunk = p->nsample / p->chunk;
+	int64_t t0, start, end, deadline;
+	int i, nevt = 0, use_events = p->events, rv = -1;
+	int64_t period = (int64_t)p->chunk * 1000000000 / p->fs;
+
+	if (init_stats(&stats, nchunk))
+		return -1;
+
+	xdf = xdf_open(p->filename, XDF_WRITE|XDF_TRUNC, p->type);
+	signal = gen_signal(p->nch, FS + p->chunk);
+	if (!xdf || !signal || setup_write(xdf, p)
+	 || xdf_prepare_transfer(xdf))
+		goto exit;
+
+	// Formats without events fail here: disable events silently
+	for (i = 0; use_events && i < NEVTTYPE; i++)
+		if (xdf_add_evttype(xdf, get_event_code(i), NULL) < 0)
+			use_events = 0;
+
+	t0 = get_ns();
+	for (k = 0; k < nchunk; k++) {
+		deadline = t0 + (k+1) * period;
+
+		start = get_ns();
+		if (xdf_write(xdf, p->chunk,
+		              signal + ((k*p->chunk) % FS) * p->nch) < 0)
+			goto exit;
+		end = get_ns();
+
+		stats.lat[stats.ncall++] = end - start;
+
+		if (use_events && sample_has_event(k)) {
+			get_event(nevt++, &evt);
+			xdf_add_event(xdf, evt.type,
+			              (double)(k*p->chunk) / p->fs, evt.dur);
+		}
+
+		if (p->realtime) {
+			end = get_ns();
+			if (end > deadline)
+				stats.noverrun++;
+			else
+				mm_relative_sleep_ns(deadline - end);
+		}
+	}
+
+	rv = xdf_close(xdf);
+	xdf = NULL;
+	stats.wall = get_ns() - t0;
+	if (rv == 0)
+		report("write", p, p->nch, &stats);
+
+exit:
+	if (rv)
+		perror("write benchmark failed");
+
+	xdf_close(xdf);
+	free(signal);
+	free(stats.lat);
+	return rv;
+}
+
+
+/* \param xdf   file opened for reading
+ * \param step   read one channel out of @step
+ * \param nsample        pointer to the number of samples in the file
+ *
+ * Returns the number of channels configured to be read, -1 in case of error
+ */
+static
+int setup_read(struct xdf* xdf, int step, long* nsample)
+{
+	struct xdfch* ch;
+	size_t strides[1];
+	int c, nch, nrec, ns_per_rec, nread = 0;
+
+	if (xdf_get_conf(xdf, XDF_F_NCHANNEL, &nch,
+	                      XDF_F_NREC, &nrec,
+	                      XDF_F_REC_NSAMPLE, &ns_per_rec,
+	                      XDF_NOF))
+		return -1;
+
+	for (c = 0; c < nch; c++) {
+		ch = xdf_get_channel(xdf, c);
+		if (c % step) {
+			xdf_set_chconf(ch, XDF_CF_ARRINDEX, -1, XDF_NOF);
+			continue;
+		}
+
+		xdf_set_chconf(ch, XDF_CF_ARRINDEX, 0,
+		                   XDF_CF_ARROFFSET, nread * (int)sizeof(float),
+		                   XDF_CF_ARRTYPE, XDFFLOAT,
+		                   XDF_CF_ARRDIGITAL, 0,
+		                   XDF_NOF);
+		nread++;
+	}
+
+	strides[0] = nread * sizeof(float);
+	if (xdf_define_arrays(xdf, 1, strides) || xdf_prepare_transfer(xdf))
+		return -1;
+
+	*nsample = (long)nrec * ns_per_rec;
+	return nread;
+}
+
+
+/* \param p     parameters of the benchmark
+ * \param mode  "seq", "seek" or "subset"
+ *
+ * Read back the file recorded by the write mode by chunks of p->chunk
+ * samples. In seek mode, each chunk is read at a random position.
+ */
+static
+int run_read(const struct bench_param* p, const char* mode)
+{
+	struct xdf* xdf;
+	struct call_stats stats = {.lat = NULL};
+	float* buff = NULL;
+	long k, nchunk, nsample, pos;
+	int64_t t0, start;
+	int nch, seek = !strcmp(mode, "seek"), rv = -1;
+	int step = strcmp(mode, "subset") ? 1 : SUBSET_STEP;
+	uint32_t rnd = 42;
+
+	xdf = xdf_open(p->filename, XDF_READ, XDF_ANY);
+	if (!xdf || (nch = setup_read(xdf, step, &nsample)) < 0)
+		goto exit;
+
+	nchunk = nsample / p->chunk;
+	buff = malloc((size_t)p->chunk * nch * sizeof(float));
+	if (!buff || init_stats(&stats, nchunk))
+		goto exit;
+
+	t0 = get_ns();
+	for (k = 0; k < nchunk; k++) {
+		start = get_ns();
+		if (seek) {
+			rnd = rnd * 1664525 + 1013904223;
+			pos = (rnd >> 8) % (nsample - p->chunk + 1);
+			if (xdf_seek(xdf, pos, SEEK_SET) < 0)
+				goto exit;
+		}
+
+		if (xdf_read(xdf, p->chunk, buff) < 0)
+			goto exit;
+
+		stats.lat[stats.ncall++] = get_ns() - start;
+	}
+	stats.wall = get_ns() - t0;
+
+	report(mode, p, nch, &stats);
+	rv = 0;
+
+exit:
+	if (rv)
+		perror("read benchmark failed");
+
+	xdf_close(xdf);
+	free(buff);
+	free(stats.lat);
+	return rv;
+}
+
+
+int main(int argc, char* argv[])
+{
+	struct bench_param param;
+	const char* mode;
+	int i, duration, keep_file, rv = 0;
+	char filename[64];
+
+	struct mm_arg_opt cmdline_optv[] = {
+		{.name = "format", MM_OPT_STR, "gdf2", {.sptr = &param.fmtname},
+		 .desc = "File format: edf, bdf, gdf1 or gdf2"},
+		{.name = "mode", MM_OPT_STR, "all", {.sptr = &mode},
+		 .desc = "write, seq, seek, subset or all"},
+		{.name = "nch", MM_OPT_INT, "64", {.iptr = &param.nch},
+		 .desc = "Number of channels"},
+		{.name = "fs", MM_OPT_INT, "2048", {.iptr = &param.fs},
+		 .desc = "Sampling frequency in Hz"},
+		{.name = "chunk", MM_OPT_INT, "32", {.iptr = &param.chunk},
+		 .desc = "Number of samples per xdf_write() or xdf_read() call"},
+		{.name = "duration", MM_OPT_INT, "30", {.iptr = &duration},
+		 .desc = "Duration in seconds of the recording"},
+		{.name = "realtime", MM_OPT_INT, "0", {.iptr = &param.realtime},
+		 .desc = "Pace the acquisition loop at the sampling frequency"},
+		{.name = "events", MM_OPT_INT, "1", {.iptr = &param.events},
+		 .desc = "Add events while recording, if format supports it"},
+		{.name = "k", MM_OPT_INT, "0", {.iptr = &keep_file},
+		 .desc = "Keep the recorded file"},
+	};
+
+	struct mm_arg_parser parser = {
+		.optv = cmdline_optv,
+		.num_opt = MM_NELEM(cmdline_optv),
+		.execname = argv[0],
+	};
+
+	if (mm_arg_parse(&parser, argc, argv) == MM_ARGPARSE_ERROR)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < (int)MM_NELEM(formats); i++)
+		if (!strcmp(param.fmtname, formats[i].name))
+			break;
+
+	if (i == (int)MM_NELEM(formats) || param.nch <= 0 || param.fs <= 0
+	   || param.chunk <= 0 || duration <= 0
+	   || (strcmp(mode, "all") && strcmp(mode, "write")
+	       && strcmp(mode, "seq") && strcmp(mode, "seek")
+	       && strcmp(mode, "subset"))) {
+		fprintf(stderr, "Invalid benchmark parameters\n");
+		return EXIT_FAILURE;
+	}
+
+	param.type = formats[i].type;
+	param.nsample = (long)duration * param.fs;
+	sprintf(filename, "bench-xdf.%s", param.fmtname);
+	param.filename = filename;
+
+	printf("mode,format,nch,fs,chunk,nsample,wall_s,msample_per_s,"
+	       "mb_per_s,ncall,p50_us,p99_us,max_us,blocked_s,overrun\n");
+
+	if (!strcmp(mode, "write") || !strcmp(mode, "all"))
+		rv = run_write(&param);
+
+	if (!rv && !strcmp(mode, "all")) {
+		rv = run_read(&param, "seq");
+		rv = rv ? rv : run_read(&param, "seek");
+		rv = rv ? rv : run_read(&param, "subset");
+	} else if (!rv && strcmp(mode, "write")) {
+		rv = run_read(&param, mode);
+	}
+
+	if (!keep_file)
+		mm_unlink(filename);
+
+	return rv ? EXIT_FAILURE : EXIT_SUCCESS;
+}
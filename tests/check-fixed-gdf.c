@@ -96,9 +96,9 @@ void check_fixed_gdf2(const char * filename)
 }
 
 
-int main(void)
+int main(int argc, char* argv[])
 {
-	check_fixed_gdf2("fixed.gdf");
+	check_fixed_gdf2(argc > 1 ? argv[1] : "fixed.gdf");
 
 	return EXIT_SUCCESS;
 }
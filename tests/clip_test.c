@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2019 MindMaze
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include <check.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xdfio.h>
+
+#include "testcases.h"
+
+#define NELEM(arr)  ((int)(sizeof(arr)/sizeof(arr[0])))
+
+#define FILENAME "ref_clip.gdf"
+
+#define SAMPLERATE 16
+
+
+static
+void setup(void)
+{
+	remove(FILENAME);
+	remove(FILENAME".code");
+	remove(FILENAME".event");
+}
+
+
+static struct xdf* xdf = NULL;
+
+static
+void teardown(void)
+{
+	if (xdf != NULL) {
+		xdf_close(xdf);
+		xdf = NULL;
+	}
+
+	setup();
+}
+
+
+static const double values[] = {
+	0.5, 2.0, -1.0, -5.0, NAN, 1.0, 1.0e12, -0.25,
+};
+#define NUM_VALUES      NELEM(values)
+#define NUM_OUTRANGE    3  // 2.0, -5.0 and NaN
+
+
+START_TEST(clip_on_write)
+{
+	struct xdfch* ch;
+	size_t strides[] = {2*sizeof(double)};
+	double data[2], rdata[2];
+	int32_t digital;
+	unsigned int nclipped;
+	int i;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_CF_ARRTYPE, XDFDOUBLE,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_NOF);
+
+	// Scaled channel
+	xdf_set_conf(xdf, XDF_CF_ARROFFSET, 0,
+	                  XDF_CF_STOTYPE, XDFINT16,
+	                  XDF_CF_PMIN, -1.0,
+	                  XDF_CF_PMAX, 1.0,
+	                  XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "scaled") != NULL);
+
+	// Unscaled channel: physical range is digital range
+	xdf_set_conf(xdf, XDF_CF_ARROFFSET, (int)sizeof(double),
+	                  XDF_CF_STOTYPE, XDFINT32,
+	                  XDF_CF_DMIN, -1.0,
+	                  XDF_CF_DMAX, 1.0,
+	                  XDF_CF_PMIN, -1.0,
+	                  XDF_CF_PMAX, 1.0,
+	                  XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "unscaled") != NULL);
+
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	// A record is converted when the first sample of the next one is
+	// written: write one sample more than a record
+	for (i = 0; i < SAMPLERATE + 1; i++) {
+		data[0] = data[1] = (i < NUM_VALUES) ? values[i] : 0.0;
+		ck_assert(xdf_write(xdf, 1, data) == 1);
+	}
+	ck_assert(xdf_end_transfer(xdf) == 0);
+
+	// 1.0e12 is out of range too
+	ch = xdf_get_channel(xdf, 0);
+	ck_assert(xdf_get_chconf(ch, XDF_CF_NCLIPPED, &nclipped, XDF_NOF) == 0);
+	ck_assert_int_eq(nclipped, NUM_OUTRANGE + 1);
+	ch = xdf_get_channel(xdf, 1);
+	ck_assert(xdf_get_chconf(ch, XDF_CF_NCLIPPED, &nclipped, XDF_NOF) == 0);
+	ck_assert_int_eq(nclipped, NUM_OUTRANGE + 1);
+
+	xdf_close(xdf);
+
+	// Check clamped values have been written
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	xdf_set_chconf(xdf_get_channel(xdf, 0), XDF_CF_ARRTYPE, XDFDOUBLE,
+	               XDF_CF_ARRDIGITAL, 0, XDF_CF_ARROFFSET, 0, XDF_NOF);
+	xdf_set_chconf(xdf_get_channel(xdf, 1), XDF_CF_ARRTYPE, XDFINT32,
+	               XDF_CF_ARRDIGITAL, 1,
+	               XDF_CF_ARROFFSET, (int)sizeof(double), XDF_NOF);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < NUM_VALUES; i++) {
+		ck_assert(xdf_read(xdf, 1, rdata) == 1);
+		memcpy(&digital, &rdata[1], sizeof(digital));
+
+		if (values[i] > 1.0) {
+			ck_assert(rdata[0] == 1.0);
+			ck_assert_int_eq(digital, 1);
+		} else if (!(values[i] >= -1.0)) {
+			ck_assert(rdata[0] == -1.0);
+			ck_assert_int_eq(digital, -1);
+		}
+	}
+}
+END_TEST
+
+
+LOCAL_FN
+TCase* create_clip_tcase(void)
+{
+	TCase * tc = tcase_create("clip");
+
+	tcase_add_checked_fixture(tc, setup, teardown);
+
+	tcase_add_test(tc, clip_on_write);
+
+	return tc;
+}
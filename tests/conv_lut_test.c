@@ -0,0 +1,311 @@
+/*
+ * Copyright (C) 2019 MindMaze
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include <check.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <xdfio.h>
+
+#include "testcases.h"
+
+#define NELEM(arr)  ((int)(sizeof(arr)/sizeof(arr[0])))
+
+#define FILENAME "ref_lut.gdf"
+
+#define SAMPLERATE 256
+// Enough samples for the 16 bits tables to be worth building
+#define NUM_SAMPLES (2*65536)
+
+static const enum xdftype stotypes[] = {
+	XDFINT8, XDFUINT8, XDFINT16, XDFUINT16,
+};
+#define NUMCH   NELEM(stotypes)
+
+
+static
+int create_ref_file(void)
+{
+	struct xdf* xdf;
+	int i, c, rv = -1;
+	double data[NUMCH];
+	size_t strides[] = {sizeof(data)};
+	char label[32];
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	if (!xdf)
+		return -1;
+
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE, XDF_NOF);
+	for (c = 0; c < NUMCH; c++) {
+		xdf_set_conf(xdf,
+		             XDF_CF_ARRTYPE, XDFDOUBLE,
+		             XDF_CF_ARRINDEX, 0,
+		             XDF_CF_ARROFFSET, c * (int)sizeof(double),
+		             XDF_CF_STOTYPE, stotypes[c],
+		             XDF_CF_PMIN, -1.0e-3,
+		             XDF_CF_PMAX, 3.0e-3,
+		             XDF_NOF);
+		sprintf(label, "lut-%i", c);
+		if (!xdf_add_channel(xdf, label))
+			goto exit;
+	}
+
+	xdf_define_arrays(xdf, 1, strides);
+	if (xdf_prepare_transfer(xdf) < 0)
+		goto exit;
+
+	// Sweep the whole physical range several times
+	for (i = 0; i < NUM_SAMPLES; i++) {
+		for (c = 0; c < NUMCH; c++)
+			data[c] = -1.0e-3 + 4.0e-3 * ((i * (c+1)) % 65537) / 65536.0;
+
+		if (xdf_write(xdf, 1, data) != 1)
+			goto exit;
+	}
+	rv = 0;
+
+exit:
+	xdf_close(xdf);
+	return rv;
+}
+
+
+static
+void tcase_setup(void)
+{
+	if (create_ref_file()) {
+		perror("Failed to create reference file");
+		abort();
+	}
+}
+
+
+static
+void tcase_cleanup(void)
+{
+	remove(FILENAME);
+	remove(FILENAME".code");
+	remove(FILENAME".event");
+}
+
+
+/**
+ * read_all() - read whole reference file in a buffer
+ * @use_lut:    value of XDF_F_CONV_LUT during the read
+ * @arrtype:    type of data in the buffer
+ *
+ * Return: the allocated buffer containing the data, NULL in case of failure
+ */
+static
+void* read_all(int use_lut, enum xdftype arrtype)
+{
+	struct xdf* xdf;
+	struct xdfch* ch;
+	size_t dsize = (arrtype == XDFFLOAT) ? sizeof(float) : sizeof(double);
+	size_t strides[] = {NUMCH * dsize};
+	char* data;
+	int c;
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	data = malloc(NUM_SAMPLES * strides[0]);
+	if (!xdf || !data)
+		goto error;
+
+	for (c = 0; c < NUMCH; c++) {
+		ch = xdf_get_channel(xdf, c);
+		xdf_set_chconf(ch, XDF_CF_ARRTYPE, arrtype,
+		                   XDF_CF_ARRDIGITAL, 0,
+		                   XDF_CF_ARRINDEX, 0,
+		                   XDF_CF_ARROFFSET, c * (int)dsize,
+		                   XDF_NOF);
+	}
+
+	if (xdf_set_conf(xdf, XDF_F_CONV_LUT, use_lut, XDF_NOF)
+	 || xdf_define_arrays(xdf, 1, strides)
+	 || xdf_prepare_transfer(xdf)
+	 || xdf_read(xdf, NUM_SAMPLES, data) != NUM_SAMPLES)
+		goto error;
+
+	xdf_close(xdf);
+	return data;
+
+error:
+	free(data);
+	xdf_close(xdf);
+	return NULL;
+}
+
+
+START_TEST(lut_matches_arithmetic)
+{
+	enum xdftype arrtype = (_i == 0) ? XDFFLOAT : XDFDOUBLE;
+	size_t dsize = (arrtype == XDFFLOAT) ? sizeof(float) : sizeof(double);
+	void *ref, *data;
+
+	ref = read_all(0, arrtype);
+	data = read_all(1, arrtype);
+	ck_assert(ref != NULL);
+	ck_assert(data != NULL);
+
+	// Table lookups must yield exactly the values of the arithmetic path
+	ck_assert(!memcmp(ref, data, NUM_SAMPLES * NUMCH * dsize));
+
+	free(ref);
+	free(data);
+}
+END_TEST
+
+
+START_TEST(lut_knob)
+{
+	struct xdf* xdf;
+	int use_lut;
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+
+	ck_assert(xdf_get_conf(xdf, XDF_F_CONV_LUT, &use_lut, XDF_NOF) == 0);
+	ck_assert_int_eq(use_lut, 1);
+
+	ck_assert(xdf_set_conf(xdf, XDF_F_CONV_LUT, 0, XDF_NOF) == 0);
+	ck_assert(xdf_get_conf(xdf, XDF_F_CONV_LUT, &use_lut, XDF_NOF) == 0);
+	ck_assert_int_eq(use_lut, 0);
+
+	xdf_close(xdf);
+}
+END_TEST
+
+
+#define WRITE_FILENAME	"ref_lut_write.gdf"
+
+/**
+ * write_read_int16() - write int16 physical values and read them back
+ * @use_lut:    value of XDF_F_CONV_LUT during the write
+ *
+ * The first channels share the same scaling, the last one has its own.
+ *
+ * Return: the allocated buffer of the digital values read back, NULL in
+ * case of failure
+ */
+static
+float* write_read_int16(int use_lut)
+{
+	struct xdf* xdf;
+	int16_t data[NUMCH];
+	size_t strides[] = {sizeof(data)};
+	float* rdata = NULL;
+	int i, c;
+
+	xdf = xdf_open(WRITE_FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	if (!xdf)
+		return NULL;
+
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_F_CONV_LUT, use_lut, XDF_NOF);
+	for (c = 0; c < NUMCH; c++) {
+		xdf_set_conf(xdf,
+		             XDF_CF_ARRTYPE, XDFINT16,
+		             XDF_CF_ARRINDEX, 0,
+		             XDF_CF_ARROFFSET, c * (int)sizeof(int16_t),
+		             XDF_CF_STOTYPE, XDFFLOAT,
+		             XDF_CF_PMIN, -32768.0,
+		             XDF_CF_PMAX, 32767.0,
+		             XDF_CF_DMIN, -1.0,
+		             XDF_CF_DMAX, (c == NUMCH-1) ? 3.0 : 1.0,
+		             XDF_NOF);
+		if (!xdf_add_channel(xdf, NULL))
+			goto exit;
+	}
+
+	if (xdf_define_arrays(xdf, 1, strides)
+	 || xdf_prepare_transfer(xdf))
+		goto exit;
+
+	for (i = 0; i < NUM_SAMPLES; i++) {
+		for (c = 0; c < NUMCH; c++)
+			data[c] = (i * (c+1)) % 65536 - 32768;
+
+		if (xdf_write(xdf, 1, data) != 1)
+			goto exit;
+	}
+	xdf_close(xdf);
+
+	xdf = xdf_open(WRITE_FILENAME, XDF_READ, XDF_ANY);
+	rdata = malloc(NUM_SAMPLES * NUMCH * sizeof(*rdata));
+	if (!xdf || !rdata)
+		goto exit;
+
+	for (c = 0; c < NUMCH; c++)
+		xdf_set_chconf(xdf_get_channel(xdf, c),
+		               XDF_CF_ARRTYPE, XDFFLOAT,
+		               XDF_CF_ARRDIGITAL, 1,
+		               XDF_CF_ARROFFSET, c * (int)sizeof(float),
+		               XDF_NOF);
+	strides[0] = NUMCH * sizeof(*rdata);
+	if (xdf_define_arrays(xdf, 1, strides)
+	 || xdf_prepare_transfer(xdf)
+	 || xdf_read(xdf, NUM_SAMPLES, rdata) != NUM_SAMPLES) {
+		free(rdata);
+		rdata = NULL;
+	}
+
+exit:
+	xdf_close(xdf);
+	remove(WRITE_FILENAME);
+	remove(WRITE_FILENAME".code");
+	remove(WRITE_FILENAME".event");
+	return rdata;
+}
+
+
+START_TEST(lut_on_write)
+{
+	float *ref, *data;
+
+	ref = write_read_int16(0);
+	data = write_read_int16(1);
+	ck_assert(ref != NULL);
+	ck_assert(data != NULL);
+
+	ck_assert(!memcmp(ref, data, NUM_SAMPLES * NUMCH * sizeof(*ref)));
+
+	free(ref);
+	free(data);
+}
+END_TEST
+
+
+LOCAL_FN
+TCase* create_conv_lut_tcase(void)
+{
+	TCase * tc = tcase_create("conv_lut");
+
+	tcase_add_unchecked_fixture(tc, tcase_setup, tcase_cleanup);
+
+	tcase_add_loop_test(tc, lut_matches_arithmetic, 0, 2);
+	tcase_add_test(tc, lut_knob);
+	tcase_add_test(tc, lut_on_write);
+
+	return tc;
+}
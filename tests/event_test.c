@@ -0,0 +1,695 @@
+/*
+ * Copyright (C) 2019 MindMaze
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include <check.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <mmsysio.h>
+
+#include <xdfio.h>
+
+#include "testcases.h"
+
+#define FILENAME "ref_events.gdf"
+#define BDF_FILENAME "ref_events.bdf"
+
+#define SAMPLERATE 256
+#define NUM_EVTTYPE 7
+// Enough events to span many batches of the event table
+#define NUM_EVENTS 100000
+
+
+static
+void setup(void)
+{
+	remove(FILENAME);
+	remove(FILENAME".code");
+	remove(FILENAME".event");
+	remove(BDF_FILENAME);
+}
+
+
+static struct xdf* xdf = NULL;
+
+static
+void teardown(void)
+{
+	if (xdf != NULL) {
+		xdf_close(xdf);
+		xdf = NULL;
+	}
+
+	setup();
+}
+
+
+static
+int get_ref_evttype(int i)
+{
+	return (i * 3) % NUM_EVTTYPE;
+}
+
+
+static
+double get_ref_onset(int i)
+{
+	return (double)i / SAMPLERATE;
+}
+
+
+static
+double get_ref_duration(int i)
+{
+	return (double)(i % 5) / SAMPLERATE;
+}
+
+
+static
+void write_ref_file(enum xdffiletype type, int evt_memlimit)
+{
+	size_t strides[] = {sizeof(float)};
+	float data = 0.0f;
+	int i;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, type);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_CF_ARRTYPE, XDFFLOAT,
+	                  XDF_CF_STOTYPE, XDFFLOAT,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_CF_ARROFFSET, 0,
+	                  XDF_NOF);
+	if (evt_memlimit)
+		ck_assert(xdf_set_conf(xdf, XDF_F_EVT_MEMLIMIT, evt_memlimit,
+		                            XDF_NOF) == 0);
+	ck_assert(xdf_add_channel(xdf, "signal") != NULL);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+
+	for (i = 0; i < NUM_EVTTYPE; i++)
+		ck_assert_int_eq(xdf_add_evttype(xdf, 0x100 + i, NULL), i);
+
+	for (i = 0; i < NUM_EVENTS; i++) {
+		ck_assert(xdf_write(xdf, 1, &data) == 1);
+		ck_assert(xdf_add_event(xdf, get_ref_evttype(i),
+		                        get_ref_onset(i),
+		                        get_ref_duration(i)) == 0);
+	}
+
+	ck_assert(xdf_close(xdf) == 0);
+	xdf = NULL;
+}
+
+
+START_TEST(many_events)
+{
+	unsigned int evttype;
+	double onset, dur;
+	int i, nevent, nevttype, code;
+	const char* desc;
+
+	write_ref_file(XDF_GDF2, 0);
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent,
+	                            XDF_F_NEVTTYPE, &nevttype, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, NUM_EVENTS);
+	ck_assert_int_eq(nevttype, NUM_EVTTYPE);
+
+	// Access events in reverse order: each access must not depend on
+	// the previous one. Event types of a file being read are numbered in
+	// the order of appearance, so check the code.
+	for (i = NUM_EVENTS - 1; i >= 0; i--) {
+		ck_assert(xdf_get_event(xdf, i, &evttype, &onset, &dur) == 0);
+		ck_assert(xdf_get_evttype(xdf, evttype, &code, &desc) == 0);
+		ck_assert_int_eq(code, 0x100 + get_ref_evttype(i));
+		ck_assert(onset == get_ref_onset(i));
+		ck_assert(dur == get_ref_duration(i));
+	}
+
+	ck_assert(xdf_get_event(xdf, NUM_EVENTS,
+	                        &evttype, &onset, &dur) == -1);
+}
+END_TEST
+
+
+static const enum xdffiletype lazy_formats[] = {XDF_GDF1, XDF_GDF2};
+
+START_TEST(lazy_events)
+{
+	size_t strides[] = {sizeof(float)};
+	float data;
+	unsigned int evttype;
+	double onset, dur;
+	int i, nevent, nevttype, code;
+	const char* desc;
+
+	write_ref_file(lazy_formats[_i], 0);
+
+	xdf = xdf_open(FILENAME, XDF_READ|XDF_LAZY_EVENTS, XDF_ANY);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, NUM_EVENTS);
+
+	// Decoding events while reading data must not disturb the transfer
+	xdf_set_chconf(xdf_get_channel(xdf, 0), XDF_CF_ARRTYPE, XDFFLOAT,
+	               XDF_CF_ARROFFSET, 0, XDF_NOF);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < 3*SAMPLERATE; i++) {
+		ck_assert(xdf_read(xdf, 1, &data) == 1);
+		ck_assert(data == 0.0f);
+		ck_assert(xdf_get_event(xdf, i*31, &evttype,
+		                        &onset, &dur) == 0);
+		ck_assert(onset == get_ref_onset(i*31));
+		ck_assert(dur == get_ref_duration(i*31));
+	}
+	ck_assert(xdf_end_transfer(xdf) == 0);
+
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVTTYPE, &nevttype, XDF_NOF) == 0);
+	ck_assert_int_eq(nevttype, NUM_EVTTYPE);
+	for (i = NUM_EVENTS - 1; i >= 0; i -= 97) {
+		ck_assert(xdf_get_event(xdf, i, &evttype, &onset, &dur) == 0);
+		ck_assert(xdf_get_evttype(xdf, evttype, &code, &desc) == 0);
+		ck_assert_int_eq(code, 0x100 + get_ref_evttype(i));
+		ck_assert(onset == get_ref_onset(i));
+		ck_assert(dur == get_ref_duration(i));
+	}
+	ck_assert(xdf_get_event(xdf, NUM_EVENTS,
+	                        &evttype, &onset, &dur) == -1);
+}
+END_TEST
+
+
+START_TEST(truncated_events)
+{
+	int fd;
+	mm_off_t flen;
+
+	write_ref_file(lazy_formats[_i], 0);
+
+	// Remove the last event of the table
+	fd = mm_open(FILENAME, O_RDWR, 0);
+	ck_assert(fd >= 0);
+	flen = mm_seek(fd, 0, SEEK_END);
+	ck_assert(flen > 0);
+	ck_assert(mm_ftruncate(fd, flen - 2) == 0);
+	mm_close(fd);
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf == NULL);
+	ck_assert_int_eq(errno, EILSEQ);
+}
+END_TEST
+
+
+START_TEST(spilled_events)
+{
+	static unsigned int types[NUM_EVENTS];
+	static double onsets[NUM_EVENTS], durations[NUM_EVENTS];
+	unsigned int evttype;
+	double onset, dur;
+	int i, nevent, code;
+	const char* desc;
+
+	write_ref_file(XDF_GDF2, 1000);
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, NUM_EVENTS);
+
+	ck_assert_int_eq(xdf_get_events(xdf, 0, NUM_EVENTS, types,
+	                                onsets, durations), NUM_EVENTS);
+	for (i = 0; i < NUM_EVENTS; i++) {
+		ck_assert(xdf_get_evttype(xdf, types[i], &code, &desc) == 0);
+		ck_assert_int_eq(code, 0x100 + get_ref_evttype(i));
+		ck_assert(onsets[i] == get_ref_onset(i));
+		ck_assert(durations[i] == get_ref_duration(i));
+	}
+	xdf_close(xdf);
+
+	// Only the last events are still in memory while writing
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_set_conf(xdf, XDF_F_EVT_MEMLIMIT, 100, XDF_NOF) == 0);
+	ck_assert_int_eq(xdf_add_evttype(xdf, 0x100, NULL), 0);
+	for (i = 0; i < 250; i++)
+		ck_assert(xdf_add_event(xdf, 0, get_ref_onset(i), 0.0) == 0);
+
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, 250);
+	ck_assert(xdf_get_event(xdf, 199, &evttype, &onset, &dur) == -1);
+	ck_assert(xdf_get_event(xdf, 249, &evttype, &onset, &dur) == 0);
+	ck_assert(onset == get_ref_onset(249));
+	ck_assert(xdf_find_events(xdf, 0.0, 1.0e9, -1, types, 100) == -1);
+	ck_assert_int_eq(errno, ERANGE);
+}
+END_TEST
+
+
+START_TEST(evttype_lookup)
+{
+	char label[32];
+	int i, evttype;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+
+	// Every third type has no label and a unique code, the others share
+	// their code
+	for (i = 0; i < 1000; i++) {
+		sprintf(label, "type-%i", i);
+		evttype = xdf_add_evttype(xdf, (i % 3) ? i % 10 : i,
+		                          (i % 3) ? label : NULL);
+		ck_assert_int_eq(evttype, i);
+	}
+
+	// Adding again an existing combination returns the existing type
+	for (i = 999; i >= 0; i--) {
+		sprintf(label, "type-%i", i);
+		evttype = xdf_add_evttype(xdf, (i % 3) ? i % 10 : i,
+		                          (i % 3) ? label : NULL);
+		ck_assert_int_eq(evttype, i);
+	}
+
+	// Same label with other code, or same code with other label, or
+	// empty label instead of no label, are new types
+	ck_assert_int_eq(xdf_add_evttype(xdf, 11, "type-1"), 1000);
+	ck_assert_int_eq(xdf_add_evttype(xdf, 1, "type-10"), 1001);
+	ck_assert_int_eq(xdf_add_evttype(xdf, 0, ""), 1002);
+	ck_assert_int_eq(xdf_add_evttype(xdf, 0, NULL), 0);
+}
+END_TEST
+
+
+#define NUM_BULK 1000
+
+START_TEST(bulk_events)
+{
+	size_t strides[] = {sizeof(float)};
+	float data = 0.0f;
+	int types[NUM_BULK];
+	unsigned int rtypes[NUM_BULK];
+	double onsets[NUM_BULK], durations[NUM_BULK];
+	double ronsets[NUM_BULK], rdurations[NUM_BULK];
+	int i, nevent, code;
+	const char* desc;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_CF_ARRTYPE, XDFFLOAT,
+	                  XDF_CF_STOTYPE, XDFFLOAT,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_CF_ARROFFSET, 0,
+	                  XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "signal") != NULL);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+
+	for (i = 0; i < NUM_EVTTYPE; i++)
+		ck_assert_int_eq(xdf_add_evttype(xdf, 0x100 + i, NULL), i);
+
+	for (i = 0; i < NUM_BULK; i++) {
+		types[i] = get_ref_evttype(i);
+		onsets[i] = get_ref_onset(i);
+		durations[i] = get_ref_duration(i);
+	}
+
+	// An invalid type anywhere rejects the whole call
+	types[NUM_BULK-1] = NUM_EVTTYPE;
+	ck_assert(xdf_add_events(xdf, NUM_BULK, types, onsets, durations) == -1);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, 0);
+	types[NUM_BULK-1] = get_ref_evttype(NUM_BULK-1);
+
+	ck_assert(xdf_add_events(xdf, NUM_BULK/2, types,
+	                         onsets, durations) == 0);
+	ck_assert(xdf_add_events(xdf, NUM_BULK/2, types + NUM_BULK/2,
+	                         onsets + NUM_BULK/2,
+	                         durations + NUM_BULK/2) == 0);
+
+	for (i = 0; i < NUM_BULK; i++)
+		ck_assert(xdf_write(xdf, 1, &data) == 1);
+
+	ck_assert(xdf_close(xdf) == 0);
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+
+	// Retrieval is clamped to the number of events
+	ck_assert_int_eq(xdf_get_events(xdf, 10, NUM_BULK, rtypes,
+	                                ronsets, rdurations), NUM_BULK - 10);
+	for (i = 0; i < NUM_BULK - 10; i++) {
+		ck_assert(xdf_get_evttype(xdf, rtypes[i], &code, &desc) == 0);
+		ck_assert_int_eq(code, 0x100 + types[i+10]);
+		ck_assert(ronsets[i] == onsets[i+10]);
+		ck_assert(rdurations[i] == durations[i+10]);
+	}
+
+	// Unwanted fields can be skipped
+	ck_assert_int_eq(xdf_get_events(xdf, 0, 5, NULL, ronsets, NULL), 5);
+	for (i = 0; i < 5; i++)
+		ck_assert(ronsets[i] == onsets[i]);
+
+	ck_assert_int_eq(xdf_get_events(xdf, NUM_BULK, 5, rtypes,
+	                                ronsets, rdurations), 0);
+	ck_assert(xdf_get_events(xdf, NUM_BULK+1, 5, rtypes,
+	                         ronsets, rdurations) == -1);
+}
+END_TEST
+
+
+START_TEST(find_events_in_range)
+{
+	unsigned int indices[NUM_EVENTS], evttype;
+	double onset, dur;
+	int i, nfound;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	for (i = 0; i < NUM_EVTTYPE; i++)
+		ck_assert_int_eq(xdf_add_evttype(xdf, 0x100 + i, NULL), i);
+
+	// Events added in reverse chronological order, with a query in the
+	// middle so that the index is updated incrementally
+	for (i = 999; i >= 500; i--)
+		ck_assert(xdf_add_event(xdf, get_ref_evttype(i),
+		                        get_ref_onset(i), 0.0) == 0);
+	ck_assert_int_eq(xdf_find_events(xdf, get_ref_onset(100),
+	                                 get_ref_onset(600), -1, NULL, 0), 100);
+	for (i = 499; i >= 0; i--)
+		ck_assert(xdf_add_event(xdf, get_ref_evttype(i),
+		                        get_ref_onset(i), 0.0) == 0);
+
+	nfound = xdf_find_events(xdf, get_ref_onset(100), get_ref_onset(600),
+	                         -1, indices, NUM_EVENTS);
+	ck_assert_int_eq(nfound, 500);
+	for (i = 0; i < nfound; i++) {
+		ck_assert(xdf_get_event(xdf, indices[i], &evttype,
+		                        &onset, &dur) == 0);
+		ck_assert(onset == get_ref_onset(100 + i));
+	}
+
+	// Only the first indices are stored if the array is too small
+	ck_assert_int_eq(xdf_find_events(xdf, get_ref_onset(0),
+	                                 get_ref_onset(1000), 2,
+	                                 indices, 3), 1000/NUM_EVTTYPE + 1);
+	for (i = 0; i < 3; i++) {
+		ck_assert(xdf_get_event(xdf, indices[i], &evttype,
+		                        &onset, &dur) == 0);
+		ck_assert_int_eq(evttype, 2);
+		ck_assert(onset == get_ref_onset(3 + i*NUM_EVTTYPE));
+	}
+
+	ck_assert_int_eq(xdf_find_events(xdf, 10.0, 20.0, -1, NULL, 0), 0);
+	ck_assert(xdf_find_events(xdf, 0.0, 1.0, -1, NULL, 1) == -1);
+	xdf_close(xdf);
+
+	// Same queries on a file read from disk
+	write_ref_file(XDF_GDF2, 0);
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+
+	nfound = xdf_find_events(xdf, get_ref_onset(1000), get_ref_onset(1500),
+	                         -1, indices, NUM_EVENTS);
+	ck_assert_int_eq(nfound, 500);
+	for (i = 0; i < nfound; i++)
+		ck_assert_int_eq(indices[i], 1000 + i);
+
+	ck_assert_int_eq(xdf_find_events(xdf, get_ref_onset(NUM_EVENTS-1),
+	                                 1.0e9, -1, indices, 1), 1);
+	ck_assert_int_eq(indices[0], NUM_EVENTS-1);
+}
+END_TEST
+
+
+static
+long get_file_size(const char* filename)
+{
+	FILE* file;
+	long size;
+
+	file = fopen(filename, "rb");
+	if (!file)
+		return -1;
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+
+START_TEST(journal_flushed_with_record)
+{
+	size_t strides[] = {sizeof(float)};
+	float data = 0.0f;
+	long evtsize;
+	int i, evttype;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_F_REC_NSAMPLE, SAMPLERATE,
+	                  XDF_CF_ARRTYPE, XDFFLOAT,
+	                  XDF_CF_STOTYPE, XDFFLOAT,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_CF_ARROFFSET, 0,
+	                  XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "signal") != NULL);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+
+	evttype = xdf_add_evttype(xdf, 0x42, "label");
+	for (i = 0; i < 10; i++)
+		ck_assert(xdf_add_event(xdf, evttype, i * 0.1, 0.0) == 0);
+
+	// The first record is surely written when the third starts
+	for (i = 0; i < 2*SAMPLERATE + 1; i++)
+		ck_assert(xdf_write(xdf, 1, &data) == 1);
+
+	evtsize = get_file_size(FILENAME".event");
+	ck_assert(evtsize > 0);
+	ck_assert(get_file_size(FILENAME".code") > 0);
+
+	// Events added during the second record are written with the third
+	for (i = 0; i < 10; i++)
+		ck_assert(xdf_add_event(xdf, evttype, 2.0 + i * 0.1, 0.0) == 0);
+
+	for (i = 0; i < 2*SAMPLERATE; i++)
+		ck_assert(xdf_write(xdf, 1, &data) == 1);
+
+	ck_assert_int_eq(get_file_size(FILENAME".event"), 2*evtsize);
+}
+END_TEST
+
+
+// Pulses written on the trigger channel: first sample, length and value
+static const struct {
+	int start, len, value;
+} pulses[] = {
+	{3, 5, 0x01},
+	{60, 10, 0x02},    // across a chunk of samples
+	{250, 20, 0x03},   // across records
+	{400, 1, 0x7f},
+	{500, 10, 0x04},
+	{510, 10, 0x05},   // follows the previous without going back to 0
+};
+#define NUM_PULSES      ((int)(sizeof(pulses)/sizeof(pulses[0])))
+
+
+static
+int get_trigger_value(int is)
+{
+	int i, value = 0;
+
+	for (i = 0; i < NUM_PULSES; i++) {
+		if (is >= pulses[i].start && is < pulses[i].start + pulses[i].len)
+			value = pulses[i].value;
+	}
+
+	// Bits out of the mask must not raise events
+	return value | ((is % 2) ? 0x100 : 0);
+}
+
+
+START_TEST(trigger_channel_events)
+{
+	size_t strides[] = {sizeof(float) + sizeof(int32_t)};
+	char data[sizeof(float) + sizeof(int32_t)] = {0};
+	struct xdfch* ch;
+	const char* desc;
+	int32_t value;
+	unsigned int evttype;
+	double onset, duration;
+	int i, iexp, code, nevent, end, exp_code[2*NUM_PULSES];
+	double exp_onset[2*NUM_PULSES];
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_F_REC_NSAMPLE, SAMPLERATE,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_NOF);
+	xdf_set_conf(xdf, XDF_CF_ARROFFSET, 0,
+	                  XDF_CF_ARRTYPE, XDFFLOAT,
+	                  XDF_CF_STOTYPE, XDFFLOAT,
+	                  XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "signal") != NULL);
+	xdf_set_conf(xdf, XDF_CF_ARROFFSET, (int)sizeof(float),
+	                  XDF_CF_ARRTYPE, XDFINT32,
+	                  XDF_CF_ARRDIGITAL, 1,
+	                  XDF_CF_STOTYPE, XDFINT32,
+	                  XDF_NOF);
+	ch = xdf_add_channel(xdf, "trigger");
+	ck_assert(ch != NULL);
+	ck_assert(xdf_set_chconf(ch, XDF_CF_TRIGMASK, 0xff,
+	                         XDF_CF_TRIGEDGE,
+	                         XDF_TRIG_RISING|XDF_TRIG_FALLING,
+	                         XDF_NOF) == 0);
+
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < 2*SAMPLERATE + 50; i++) {
+		value = get_trigger_value(i);
+		memcpy(data + sizeof(float), &value, sizeof(value));
+		ck_assert(xdf_write(xdf, 1, data) == 1);
+	}
+	xdf_close(xdf);
+
+	// Events expected in time order, falling edge first
+	iexp = 0;
+	for (i = 0; i < NUM_PULSES; i++) {
+		if (i == 0 || pulses[i-1].start + pulses[i-1].len < pulses[i].start) {
+			exp_code[iexp] = pulses[i].value;
+			exp_onset[iexp++] = pulses[i].start;
+		}
+
+		end = pulses[i].start + pulses[i].len;
+		exp_code[iexp] = pulses[i].value | 0x8000;
+		exp_onset[iexp++] = end;
+		if (i+1 < NUM_PULSES && pulses[i+1].start == end) {
+			exp_code[iexp] = pulses[i+1].value;
+			exp_onset[iexp++] = end;
+		}
+	}
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, iexp);
+	for (i = 0; i < nevent; i++) {
+		ck_assert(xdf_get_event(xdf, i, &evttype, &onset, &duration) == 0);
+		ck_assert(xdf_get_evttype(xdf, evttype, &code, &desc) == 0);
+		ck_assert_int_eq(code, exp_code[i]);
+		ck_assert(onset == exp_onset[i] / SAMPLERATE);
+		ck_assert(duration == 0.0);
+	}
+
+	// Triggers are only detected while writing
+	ch = xdf_get_channel(xdf, 1);
+	ck_assert(xdf_set_chconf(ch, XDF_CF_TRIGMASK, 1, XDF_NOF) == -1);
+}
+END_TEST
+
+
+static const int status_flags[] = {0, XDF_LAZY_EVENTS};
+
+START_TEST(status_channel_events)
+{
+	size_t strides[] = {2*sizeof(int32_t)};
+	int32_t data[2] = {0};
+	unsigned int evttype;
+	const char* desc;
+	double onset, duration;
+	int i, code, nevent;
+
+	xdf = xdf_open(BDF_FILENAME, XDF_WRITE|XDF_TRUNC, XDF_BDF);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_F_REC_NSAMPLE, SAMPLERATE,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_CF_ARRTYPE, XDFINT32,
+	                  XDF_CF_ARRDIGITAL, 1,
+	                  XDF_NOF);
+	xdf_set_conf(xdf, XDF_CF_ARROFFSET, 0, XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "signal") != NULL);
+	xdf_set_conf(xdf, XDF_CF_ARROFFSET, (int)sizeof(int32_t), XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "Status") != NULL);
+
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < 2*SAMPLERATE + 50; i++) {
+		// Bits above the 16 lower ones are status flags
+		data[1] = (get_trigger_value(i) & 0xff) | ((i%2) ? 0x10000 : 0);
+		ck_assert(xdf_write(xdf, 1, data) == 1);
+	}
+	xdf_close(xdf);
+
+	// Without the flag, BDF files have no events
+	xdf = xdf_open(BDF_FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, 0);
+	xdf_close(xdf);
+
+	xdf = xdf_open(BDF_FILENAME, XDF_READ|XDF_STATUS_EVENTS
+	                             |status_flags[_i], XDF_ANY);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nevent, NUM_PULSES);
+	for (i = 0; i < nevent; i++) {
+		ck_assert(xdf_get_event(xdf, i, &evttype, &onset, &duration) == 0);
+		ck_assert(xdf_get_evttype(xdf, evttype, &code, &desc) == 0);
+		ck_assert_int_eq(code, pulses[i].value);
+		ck_assert(onset == (double)pulses[i].start / SAMPLERATE);
+		ck_assert(duration == (double)pulses[i].len / SAMPLERATE);
+	}
+}
+END_TEST
+
+
+LOCAL_FN
+TCase* create_event_tcase(void)
+{
+	TCase * tc = tcase_create("event");
+
+	tcase_add_checked_fixture(tc, setup, teardown);
+
+	tcase_add_test(tc, many_events);
+	tcase_add_loop_test(tc, lazy_events, 0, 2);
+	tcase_add_loop_test(tc, truncated_events, 0, 2);
+	tcase_add_test(tc, spilled_events);
+	tcase_add_test(tc, evttype_lookup);
+	tcase_add_test(tc, bulk_events);
+	tcase_add_test(tc, find_events_in_range);
+	tcase_add_test(tc, journal_flushed_with_record);
+	tcase_add_test(tc, trigger_channel_events);
+	tcase_add_loop_test(tc, status_channel_events, 0, 2);
+
+	return tc;
+}
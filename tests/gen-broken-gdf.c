@@ -29,7 +29,7 @@
 #include "refsignal.h"
 
 static
-void gen_test_gdf2(const char * filename)
+void gen_test_gdf2(const char * filename, int checkpoint)
 {
 	int i, rv, nevt;
 	struct xdf *xdf = NULL;
@@ -40,7 +40,9 @@ void gen_test_gdf2(const char * filename)
 
 	xdf = xdf_open(filename, XDF_WRITE, XDF_GDF2);
 	assert(xdf != NULL);
-	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, FS, XDF_NOF);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, FS,
+	                  XDF_F_CHECKPOINT, checkpoint,
+	                  XDF_NOF);
 
 	ch = xdf_add_channel(xdf, "test channel");
 	xdf_set_chconf(ch, XDF_CF_ARRINDEX, 0,
@@ -70,12 +72,25 @@ void gen_test_gdf2(const char * filename)
 }
 
 
-int main(void)
+/* With -c, the number of records is checkpointed after each record and
+ * the file is checkpointed.gdf instead of broken.gdf */
+int main(int argc, char* argv[])
 {
-	mm_unlink("broken.gdf");
-	mm_unlink("broken.gdf.code");
-	mm_unlink("broken.gdf.event");
-	gen_test_gdf2("broken.gdf");
+	const char* filename = "broken.gdf";
+	char tmp[64];
+	int checkpoint = 0;
+
+	if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+		filename = "checkpointed.gdf";
+		checkpoint = 1;
+	}
+
+	mm_unlink(filename);
+	sprintf(tmp, "%s.code", filename);
+	mm_unlink(tmp);
+	sprintf(tmp, "%s.event", filename);
+	mm_unlink(tmp);
+	gen_test_gdf2(filename, checkpoint);
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2019 MindMaze
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include <check.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <xdfio.h>
+
+#include "testcases.h"
+
+#define NELEM(arr)  ((int)(sizeof(arr)/sizeof(arr[0])))
+
+#define FILENAME "ref_half.gdf"
+
+#define SAMPLERATE 128
+#define NUM_SAMPLES 4096
+
+static const enum xdftype stotypes[] = {
+	XDFINT16, XDFUINT8, XDFUINT16, XDFINT32, XDFFLOAT,
+};
+#define NUMCH   NELEM(stotypes)
+
+
+union fu32 {
+	float f;
+	uint32_t u;
+};
+
+
+static
+float decode_half(uint16_t h)
+{
+	union fu32 v;
+	uint32_t e = (h >> 10) & 0x1F;
+	uint32_t m = h & 0x3FF;
+
+	if (e == 0) {
+		v.f = m / 16777216.0f;
+		v.u |= (uint32_t)(h & 0x8000) << 16;
+	} else {
+		v.u = ((uint32_t)(h & 0x8000) << 16) | ((e - 15 + 127) << 23)
+		      | (m << 13);
+	}
+
+	return v.f;
+}
+
+
+static
+float decode_bfloat16(uint16_t h)
+{
+	union fu32 v = {.u = (uint32_t)h << 16};
+	return v.f;
+}
+
+
+static
+double get_ref_value(int i, int c)
+{
+	return (((i * 37 + c * 101) % 2001) - 1000) * 0.37;
+}
+
+
+static
+int create_ref_file(void)
+{
+	struct xdf* xdf;
+	int i, c, rv = -1;
+	double data[NUMCH];
+	size_t strides[] = {sizeof(data)};
+	char label[32];
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	if (!xdf)
+		return -1;
+
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE, XDF_NOF);
+	for (c = 0; c < NUMCH; c++) {
+		xdf_set_conf(xdf,
+		             XDF_CF_ARRTYPE, XDFDOUBLE,
+		             XDF_CF_ARRINDEX, 0,
+		             XDF_CF_ARROFFSET, c * (int)sizeof(double),
+		             XDF_CF_STOTYPE, stotypes[c],
+		             XDF_CF_PMIN, -400.0,
+		             XDF_CF_PMAX, 400.0,
+		             XDF_NOF);
+		sprintf(label, "half-%i", c);
+		if (!xdf_add_channel(xdf, label))
+			goto exit;
+	}
+
+	xdf_define_arrays(xdf, 1, strides);
+	if (xdf_prepare_transfer(xdf) < 0)
+		goto exit;
+
+	for (i = 0; i < NUM_SAMPLES; i++) {
+		for (c = 0; c < NUMCH; c++)
+			data[c] = get_ref_value(i, c);
+
+		if (xdf_write(xdf, 1, data) != 1)
+			goto exit;
+	}
+	rv = 0;
+
+exit:
+	xdf_close(xdf);
+	return rv;
+}
+
+
+static
+void tcase_setup(void)
+{
+	if (create_ref_file()) {
+		perror("Failed to create reference file");
+		abort();
+	}
+}
+
+
+static
+void tcase_cleanup(void)
+{
+	remove(FILENAME);
+	remove(FILENAME".code");
+	remove(FILENAME".event");
+}
+
+
+static
+int setup_read(struct xdf* xdf, enum xdftype arrtype, size_t dsize)
+{
+	struct xdfch* ch;
+	size_t strides[] = {NUMCH * dsize};
+	int c;
+
+	for (c = 0; c < NUMCH; c++) {
+		ch = xdf_get_channel(xdf, c);
+		if (xdf_set_chconf(ch, XDF_CF_ARRTYPE, arrtype,
+		                       XDF_CF_ARRDIGITAL, 0,
+		                       XDF_CF_ARRINDEX, 0,
+		                       XDF_CF_ARROFFSET, c * (int)dsize,
+		                       XDF_NOF))
+			return -1;
+	}
+
+	if (xdf_define_arrays(xdf, 1, strides)
+	 || xdf_prepare_transfer(xdf))
+		return -1;
+
+	return 0;
+}
+
+
+START_TEST(read_half)
+{
+	enum xdftype arrtype = (_i == 0) ? XDFFLOAT16 : XDFBFLOAT16;
+	float reltol = (_i == 0) ? 1.0f/2048 : 1.0f/256;
+	// Half of the smallest half precision subnormal
+	float abstol = (_i == 0) ? 1.0f/33554432 : 0.0f;
+	struct xdf *xdf, *xdfref;
+	float ref[NUMCH], dec, err;
+	uint16_t data[NUMCH];
+	int i, c;
+
+	xdfref = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdfref != NULL && xdf != NULL);
+	ck_assert(setup_read(xdfref, XDFFLOAT, sizeof(float)) == 0);
+	ck_assert(setup_read(xdf, arrtype, sizeof(uint16_t)) == 0);
+
+	for (i = 0; i < NUM_SAMPLES; i++) {
+		ck_assert(xdf_read(xdfref, 1, ref) == 1);
+		ck_assert(xdf_read(xdf, 1, data) == 1);
+
+		// Value must be the float value rounded to the nearest
+		// representable value
+		for (c = 0; c < NUMCH; c++) {
+			if (arrtype == XDFFLOAT16)
+				dec = decode_half(data[c]);
+			else
+				dec = decode_bfloat16(data[c]);
+
+			err = dec - ref[c];
+			if (err < 0)
+				err = -err;
+			ck_assert(err <= abstol
+			                 + reltol * (ref[c] < 0 ? -ref[c] : ref[c]));
+		}
+	}
+
+	xdf_close(xdfref);
+	xdf_close(xdf);
+}
+END_TEST
+
+
+// Storage types of GDF2, written from half precision arrays with and without
+// scaling
+static const enum xdftype write_stotypes[] = {
+	XDFINT16, XDFINT32, XDFUINT32, XDFFLOAT, XDFDOUBLE, XDFINT64,
+};
+#define NUM_WRITE_STOTYPES	NELEM(write_stotypes)
+#define WRITE_RANGE		2048.0
+
+
+/* \param vals	array receiving the values of the selected bit patterns
+ * \param pats	array receiving the selected bit patterns
+ * \param bf16	non zero for bfloat16, half precision otherwise
+ *
+ * Select the bit patterns whose value is an integer within WRITE_RANGE,
+ * hence exactly representable in any storage type.
+ *
+ * Returns the number of selected patterns
+ */
+static
+int get_integer_patterns(float* vals, uint16_t* pats, int bf16)
+{
+	float val;
+	int i, n = 0;
+
+	for (i = 0; i < 65536; i++) {
+		val = bf16 ? decode_bfloat16(i) : decode_half(i);
+		if ((val != (float)(int)val)
+		   || (val < -WRITE_RANGE) || (val > WRITE_RANGE))
+			continue;
+
+		vals[n] = val;
+		pats[n++] = i;
+	}
+
+	return n;
+}
+
+
+START_TEST(write_half)
+{
+	enum xdftype stotype = write_stotypes[_i % NUM_WRITE_STOTYPES];
+	int scaled = _i / NUM_WRITE_STOTYPES;
+	struct xdf* xdf;
+	static float vals[2][65536];
+	static uint16_t pats[2][65536];
+	uint16_t data[2];
+	float val[2], exp;
+	size_t strides[] = {sizeof(data)};
+	int i, c, n[2], ns;
+	// Unsigned storage of an unscaled channel clamps negative values
+	double dmin = (stotype == XDFUINT32 && !scaled) ? 0.0 : -WRITE_RANGE;
+
+	n[0] = get_integer_patterns(vals[0], pats[0], 0);
+	n[1] = get_integer_patterns(vals[1], pats[1], 1);
+	ns = (n[0] > n[1]) ? n[0] : n[1];
+
+	// Write a file from half precision arrays. When scaled, the physical
+	// range is mapped to an even digital range, so values stay exact.
+	xdf = xdf_open(FILENAME".half", XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_CF_STOTYPE, stotype,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_CF_PMIN, scaled ? -WRITE_RANGE : dmin,
+	                  XDF_CF_PMAX, WRITE_RANGE,
+	                  XDF_CF_DMIN, scaled ? 0.0 : dmin,
+	                  XDF_CF_DMAX, scaled ? 4*WRITE_RANGE : WRITE_RANGE,
+	                  XDF_NOF);
+	xdf_set_conf(xdf, XDF_CF_ARRTYPE, XDFFLOAT16,
+	                  XDF_CF_ARROFFSET, 0, XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "half") != NULL);
+	xdf_set_conf(xdf, XDF_CF_ARRTYPE, XDFBFLOAT16,
+	                  XDF_CF_ARROFFSET, (int)sizeof(uint16_t), XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "bfloat16") != NULL);
+
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < ns; i++) {
+		for (c = 0; c < 2; c++)
+			data[c] = (i < n[c]) ? pats[c][i] : 0;
+		ck_assert(xdf_write(xdf, 1, data) == 1);
+	}
+	xdf_close(xdf);
+
+	// Read back as float
+	xdf = xdf_open(FILENAME".half", XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	strides[0] = sizeof(val);
+	xdf_set_chconf(xdf_get_channel(xdf, 0), XDF_CF_ARRTYPE, XDFFLOAT,
+	               XDF_CF_ARRDIGITAL, 0, XDF_CF_ARROFFSET, 0, XDF_NOF);
+	xdf_set_chconf(xdf_get_channel(xdf, 1), XDF_CF_ARRTYPE, XDFFLOAT,
+	               XDF_CF_ARRDIGITAL, 0,
+	               XDF_CF_ARROFFSET, (int)sizeof(float), XDF_NOF);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < ns; i++) {
+		ck_assert(xdf_read(xdf, 1, val) == 1);
+		for (c = 0; c < 2; c++) {
+			exp = (i < n[c]) ? vals[c][i] : 0.0f;
+			if (exp < dmin)
+				exp = dmin;
+			ck_assert(val[c] == exp);
+		}
+	}
+	xdf_close(xdf);
+
+	remove(FILENAME".half");
+	remove(FILENAME".half.code");
+	remove(FILENAME".half.event");
+}
+END_TEST
+
+
+static const float special_values[] = {
+	NAN, INFINITY, -INFINITY, 1.0e6f, 65504.0f, 65520.0f, 1.0e-8f, -0.0f,
+};
+static const uint16_t special_halves[] = {
+	0x7E00, 0x7C00, 0xFC00, 0x7C00, 0x7BFF, 0x7C00, 0x0000, 0x8000,
+};
+#define NUM_SPECIAL	NELEM(special_values)
+
+
+START_TEST(special_half)
+{
+	struct xdf* xdf;
+	size_t strides[] = {sizeof(float)};
+	uint16_t data;
+	int i;
+
+	xdf = xdf_open(FILENAME".special", XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_CF_STOTYPE, XDFFLOAT,
+	                  XDF_CF_ARRTYPE, XDFFLOAT,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_CF_ARROFFSET, 0,
+	                  XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "special") != NULL);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < SAMPLERATE; i++)
+		ck_assert(xdf_write(xdf, 1, &special_values[i % NUM_SPECIAL]) == 1);
+	xdf_close(xdf);
+
+	// Overflows go to infinity and NaNs become the canonical quiet NaN
+	xdf = xdf_open(FILENAME".special", XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	strides[0] = sizeof(data);
+	xdf_set_chconf(xdf_get_channel(xdf, 0), XDF_CF_ARRTYPE, XDFFLOAT16,
+	               XDF_CF_ARRDIGITAL, 0, XDF_CF_ARROFFSET, 0, XDF_NOF);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < SAMPLERATE; i++) {
+		ck_assert(xdf_read(xdf, 1, &data) == 1);
+		ck_assert_int_eq(data, special_halves[i % NUM_SPECIAL]);
+	}
+	xdf_close(xdf);
+
+	remove(FILENAME".special");
+	remove(FILENAME".special.code");
+	remove(FILENAME".special.event");
+}
+END_TEST
+
+
+// Just above the midpoint of 1 and the next half value, which is itself a
+// float: rounding to float before rounding to half would give 1.
+#define ABOVE_TIE	(1.0 + 1.0/2048 + 1.0/1099511627776.0)
+
+START_TEST(double_to_half)
+{
+	struct xdf* xdf;
+	size_t strides[] = {sizeof(double)};
+	double ref = ABOVE_TIE;
+	uint16_t data;
+	int i;
+
+	xdf = xdf_open(FILENAME".double", XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, SAMPLERATE,
+	                  XDF_CF_STOTYPE, XDFDOUBLE,
+	                  XDF_CF_ARRTYPE, XDFDOUBLE,
+	                  XDF_CF_ARRINDEX, 0,
+	                  XDF_CF_ARROFFSET, 0,
+	                  XDF_CF_PMIN, -4.0,
+	                  XDF_CF_PMAX, 4.0,
+	                  XDF_CF_DMIN, -4.0,
+	                  XDF_CF_DMAX, 4.0,
+	                  XDF_NOF);
+	ck_assert(xdf_add_channel(xdf, "double") != NULL);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (i = 0; i < SAMPLERATE; i++)
+		ck_assert(xdf_write(xdf, 1, &ref) == 1);
+	xdf_close(xdf);
+
+	// Values are rounded once, from double
+	xdf = xdf_open(FILENAME".double", XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	strides[0] = sizeof(data);
+	xdf_set_chconf(xdf_get_channel(xdf, 0), XDF_CF_ARRTYPE, XDFFLOAT16,
+	               XDF_CF_ARRDIGITAL, 0, XDF_CF_ARROFFSET, 0, XDF_NOF);
+	ck_assert(xdf_define_arrays(xdf, 1, strides) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	ck_assert(xdf_read(xdf, 1, &data) == 1);
+	ck_assert_int_eq(data, 0x3C01);
+	xdf_close(xdf);
+
+	remove(FILENAME".double");
+	remove(FILENAME".double.code");
+	remove(FILENAME".double.event");
+}
+END_TEST
+
+
+LOCAL_FN
+TCase* create_halffloat_tcase(void)
+{
+	TCase * tc = tcase_create("halffloat");
+
+	tcase_add_unchecked_fixture(tc, tcase_setup, tcase_cleanup);
+
+	tcase_add_loop_test(tc, read_half, 0, 2);
+	tcase_add_loop_test(tc, write_half, 0, 2*NUM_WRITE_STOTYPES);
+	tcase_add_test(tc, special_half);
+	tcase_add_test(tc, double_to_half);
+
+	return tc;
+}
@@ -21,11 +21,16 @@
 
 #include <check.h>
 #include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <mmsysio.h>
 #include <xdfio.h>
 
 
 #define FILENAME "dummy.bdf"
+#define NUM_CHANNELS 5000
 
 static struct xdf * xdf = NULL;
 
@@ -65,6 +70,368 @@ START_TEST(trunc_flag)
 END_TEST
 
 
+static const enum xdffiletype truncated_types[] = {XDF_BDF, XDF_GDF2};
+
+START_TEST(truncated_header)
+{
+	enum xdffiletype type = truncated_types[_i];
+	int fd;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, type);
+	ck_assert(xdf != NULL);
+	xdf_add_channel(xdf, "ch0");
+	xdf_add_channel(xdf, "ch1");
+	xdf_add_channel(xdf, "ch2");
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	xdf_close(xdf);
+
+	// Cut the file in the middle of the channel fields
+	fd = mm_open(FILENAME, O_RDWR, 0);
+	ck_assert(fd >= 0);
+	ck_assert(mm_ftruncate(fd, 256 + 100) == 0);
+	mm_close(fd);
+
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_ANY);
+	ck_assert(xdf == NULL);
+	ck_assert_int_eq(errno, EILSEQ);
+}
+END_TEST
+
+
+#define GDF_FILENAME	"dummy.gdf"
+
+START_TEST(header_only)
+{
+	int nch, nevent, evttype;
+	unsigned int type;
+	double onset, dur;
+	const char* label;
+	float data[2] = {0};
+
+	mm_unlink(GDF_FILENAME);
+	xdf = xdf_open(GDF_FILENAME, XDF_WRITE, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, 16,
+	                  XDF_CF_ARRTYPE, XDFFLOAT,
+	                  XDF_CF_STOTYPE, XDFFLOAT,
+	                  XDF_NOF);
+	xdf_add_channel(xdf, "ch0");
+	xdf_add_channel(xdf, "ch1");
+	evttype = xdf_add_evttype(xdf, 42, NULL);
+	xdf_add_event(xdf, evttype, 0.5, 0.0);
+	ck_assert(xdf_define_arrays(xdf, 1, (size_t[]){sizeof(data)}) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	ck_assert(xdf_write(xdf, 1, data) == 1);
+	xdf_close(xdf);
+
+	xdf = xdf_open(GDF_FILENAME, XDF_READ|XDF_HEADER_ONLY, XDF_ANY);
+	ck_assert(xdf != NULL);
+
+	// Headers are available
+	ck_assert(xdf_get_conf(xdf, XDF_F_NCHANNEL, &nch, XDF_NOF) == 0);
+	ck_assert_int_eq(nch, 2);
+	ck_assert(xdf_get_chconf(xdf_get_channel(xdf, 1),
+	                         XDF_CF_LABEL, &label, XDF_NOF) == 0);
+	ck_assert_str_eq(label, "ch1");
+
+	// Events and data are not: not read is not the same as none
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVENT, &nevent, XDF_NOF) == -1);
+	ck_assert_int_eq(errno, EPERM);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NEVTTYPE, &nevent, XDF_NOF) == -1);
+	ck_assert_int_eq(errno, EPERM);
+	ck_assert(xdf_get_event(xdf, 0, &type, &onset, &dur) == -1);
+	ck_assert_int_eq(errno, EPERM);
+	ck_assert(xdf_prepare_transfer(xdf) == -1);
+	ck_assert_int_eq(errno, EPERM);
+
+	xdf_close(xdf);
+	xdf = NULL;
+	mm_unlink(GDF_FILENAME);
+	mm_unlink(GDF_FILENAME".code");
+	mm_unlink(GDF_FILENAME".event");
+}
+END_TEST
+
+
+START_TEST(many_channels)
+{
+	struct xdfch *ch, *prev = NULL;
+	char label[32];
+	const char* rlabel;
+	int i;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_BDF);
+	ck_assert(xdf != NULL);
+
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		sprintf(label, "ch%i", i);
+		ch = xdf_add_channel(xdf, label);
+		ck_assert(ch != NULL);
+		ck_assert(xdf_get_channel(xdf, i) == ch);
+		if (prev)
+			ck_assert(xdf_get_channel(xdf, i-1) == prev);
+		prev = ch;
+	}
+
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		sprintf(label, "ch%i", i);
+		ch = xdf_get_channel(xdf, i);
+		ck_assert(xdf_get_chconf(ch, XDF_CF_LABEL, &rlabel, XDF_NOF) == 0);
+		ck_assert_str_eq(rlabel, label);
+	}
+
+	ck_assert(xdf_get_channel(xdf, NUM_CHANNELS) == NULL);
+	ck_assert_int_eq(errno, EINVAL);
+}
+END_TEST
+
+
+START_TEST(find_channel)
+{
+	struct xdfch *ch, *dup;
+	char label[32];
+	int i;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_BDF);
+	ck_assert(xdf != NULL);
+
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		sprintf(label, "ch%i", i);
+		ck_assert(xdf_add_channel(xdf, label) != NULL);
+	}
+
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		sprintf(label, "ch%i", i);
+		ck_assert(xdf_find_channel(xdf, label) == xdf_get_channel(xdf, i));
+	}
+	ck_assert(xdf_find_channel(xdf, "unknown") == NULL);
+	ck_assert_int_eq(errno, ENOENT);
+
+	// The index follows the label changes
+	ch = xdf_get_channel(xdf, 10);
+	ck_assert(xdf_set_chconf(ch, XDF_CF_LABEL, "renamed", XDF_NOF) == 0);
+	ck_assert(xdf_find_channel(xdf, "renamed") == ch);
+	ck_assert(xdf_find_channel(xdf, "ch10") == NULL);
+
+	// The first channel of a label is found, even if added later
+	dup = xdf_add_channel(xdf, "ch5");
+	ck_assert(dup != NULL);
+	ck_assert(xdf_find_channel(xdf, "ch5") == xdf_get_channel(xdf, 5));
+	ck_assert(xdf_set_chconf(xdf_get_channel(xdf, 5),
+	                         XDF_CF_LABEL, "other", XDF_NOF) == 0);
+	ck_assert(xdf_find_channel(xdf, "ch5") == dup);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	ck_assert(xdf_close(xdf) == 0);
+
+	// The labels read from the header are indexed
+	xdf = xdf_open(FILENAME, XDF_READ, XDF_BDF);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_find_channel(xdf, "renamed") == xdf_get_channel(xdf, 10));
+	ck_assert(xdf_find_channel(xdf, "ch5") == xdf_get_channel(xdf,
+	                                                   NUM_CHANNELS));
+	ck_assert(xdf_find_channel(xdf, "ch10") == NULL);
+}
+END_TEST
+
+
+START_TEST(chconf_bulk)
+{
+	static char labels[NUM_CHANNELS][32];
+	const char* lbl_ptrs[NUM_CHANNELS];
+	const char* lbl_res[NUM_CHANNELS];
+	double pmax[NUM_CHANNELS], pmax_res[NUM_CHANNELS];
+	double val;
+	int i;
+
+	xdf = xdf_open(FILENAME, XDF_WRITE|XDF_TRUNC, XDF_BDF);
+	ck_assert(xdf != NULL);
+
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		ck_assert(xdf_add_channel(xdf, NULL) != NULL);
+		sprintf(labels[i], "bulk%i", i);
+		lbl_ptrs[i] = labels[i];
+		pmax[i] = 100.0 + i;
+	}
+
+	ck_assert(xdf_set_chconf_bulk(xdf, XDF_CF_LABEL,
+	                              NUM_CHANNELS, lbl_ptrs) == 0);
+	ck_assert(xdf_set_chconf_bulk(xdf, XDF_CF_PMAX,
+	                              NUM_CHANNELS, pmax) == 0);
+
+	// Values are seen by the per channel getter and the label index
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		ck_assert(xdf_get_chconf(xdf_get_channel(xdf, i),
+		                         XDF_CF_PMAX, &val, XDF_NOF) == 0);
+		ck_assert(val == pmax[i]);
+		ck_assert(xdf_find_channel(xdf, labels[i])
+		          == xdf_get_channel(xdf, i));
+	}
+
+	ck_assert(xdf_get_chconf_bulk(xdf, XDF_CF_LABEL,
+	                              NUM_CHANNELS, lbl_res) == 0);
+	ck_assert(xdf_get_chconf_bulk(xdf, XDF_CF_PMAX,
+	                              NUM_CHANNELS, pmax_res) == 0);
+	for (i = 0; i < NUM_CHANNELS; i++) {
+		ck_assert_str_eq(lbl_res[i], labels[i]);
+		ck_assert(pmax_res[i] == pmax[i]);
+	}
+
+	ck_assert(xdf_set_chconf_bulk(xdf, XDF_CF_PMAX,
+	                              NUM_CHANNELS+1, pmax) == -1);
+	ck_assert_int_eq(errno, EINVAL);
+	ck_assert(xdf_get_chconf_bulk(xdf, XDF_F_NREC, 1, pmax_res) == -1);
+	ck_assert_int_eq(errno, EINVAL);
+}
+END_TEST
+
+
+/* File held in memory, accessed through a custom backend */
+struct memfile {
+	char* data;
+	size_t len;
+	int nclose;
+};
+
+
+static
+int64_t mem_pread(void* ctx, void* buf, size_t len, int64_t off)
+{
+	struct memfile* mf = ctx;
+
+	if (off >= (int64_t)mf->len)
+		return 0;
+
+	if (len > mf->len - off)
+		len = mf->len - off;
+	memcpy(buf, mf->data + off, len);
+	return len;
+}
+
+
+static
+int64_t mem_pwrite(void* ctx, const void* buf, size_t len, int64_t off)
+{
+	struct memfile* mf = ctx;
+	char* data;
+
+	if (off + len > mf->len) {
+		data = realloc(mf->data, off + len);
+		if (!data)
+			return -1;
+		if ((size_t)off > mf->len)
+			memset(data + mf->len, 0, off - mf->len);
+		mf->data = data;
+		mf->len = off + len;
+	}
+
+	memcpy(mf->data + off, buf, len);
+	return len;
+}
+
+
+static
+int64_t mem_size(void* ctx)
+{
+	struct memfile* mf = ctx;
+	return mf->len;
+}
+
+
+static
+int mem_close(void* ctx)
+{
+	struct memfile* mf = ctx;
+	mf->nclose++;
+	return 0;
+}
+
+
+static const struct xdf_io_ops mem_ops = {
+	.pread = mem_pread,
+	.pwrite = mem_pwrite,
+	.size = mem_size,
+	.close = mem_close,
+};
+
+
+#define IO_NS		17
+#define IO_NREC		5
+
+static const enum xdffiletype io_types[] = {XDF_BDF, XDF_GDF1, XDF_GDF2};
+
+START_TEST(custom_io)
+{
+	enum xdffiletype type = io_types[_i];
+	struct memfile mf = {.data = NULL};
+	int32_t data[2*IO_NS];
+	int i, irec, nch, nevent, evttype;
+	const char* label;
+
+	// Write a file in memory
+	xdf = xdf_open_io(&mem_ops, &mf, XDF_WRITE|XDF_CLOSEFD, type);
+	ck_assert(xdf != NULL);
+	xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, IO_NS,
+	                  XDF_CF_ARRTYPE, XDFINT32,
+	                  XDF_CF_ARRDIGITAL, 1,
+	                  XDF_CF_STOTYPE, XDFINT24,
+	                  XDF_NOF);
+	xdf_add_channel(xdf, "ch0");
+	xdf_add_channel(xdf, "ch1");
+	if (type != XDF_BDF) {
+		evttype = xdf_add_evttype(xdf, 42, NULL);
+		ck_assert(xdf_add_event(xdf, evttype, 1.0, 0.0) == 0);
+	}
+	ck_assert(xdf_define_arrays(xdf, 1,
+	                            (size_t[]){2*sizeof(int32_t)}) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (irec = 0; irec < IO_NREC; irec++) {
+		for (i = 0; i < 2*IO_NS; i++)
+			data[i] = irec*1000 + i;
+		ck_assert(xdf_write(xdf, IO_NS, data) == IO_NS);
+	}
+	ck_assert(xdf_close(xdf) == 0);
+	xdf = NULL;
+	ck_assert_int_eq(mf.nclose, 1);
+	ck_assert(mf.len > 256);
+
+	// Read it back
+	xdf = xdf_open_io(&mem_ops, &mf, XDF_READ, XDF_ANY);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_get_conf(xdf, XDF_F_NCHANNEL, &nch,
+	                            XDF_F_NEVENT, &nevent, XDF_NOF) == 0);
+	ck_assert_int_eq(nch, 2);
+	ck_assert_int_eq(nevent, (type != XDF_BDF) ? 1 : 0);
+	ck_assert(xdf_get_chconf(xdf_get_channel(xdf, 1),
+	                         XDF_CF_LABEL, &label, XDF_NOF) == 0);
+	ck_assert_str_eq(label, "ch1");
+
+	for (i = 0; i < 2; i++)
+		xdf_set_chconf(xdf_get_channel(xdf, i),
+		               XDF_CF_ARRTYPE, XDFINT32,
+		               XDF_CF_ARROFFSET, i*(int)sizeof(int32_t),
+		               XDF_CF_ARRDIGITAL, 1, XDF_NOF);
+	ck_assert(xdf_define_arrays(xdf, 1,
+	                            (size_t[]){2*sizeof(int32_t)}) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	for (irec = 0; irec < IO_NREC; irec++) {
+		ck_assert(xdf_read(xdf, IO_NS, data) == IO_NS);
+		for (i = 0; i < 2*IO_NS; i++)
+			ck_assert_int_eq(data[i], irec*1000 + i);
+	}
+	ck_assert(xdf_read(xdf, IO_NS, data) == 0);
+	ck_assert(xdf_close(xdf) == 0);
+	xdf = NULL;
+
+	// Without XDF_CLOSEFD, the backend is not closed
+	ck_assert_int_eq(mf.nclose, 1);
+	free(mf.data);
+
+	ck_assert(xdf_open_io(NULL, &mf, XDF_READ, XDF_ANY) == NULL);
+	ck_assert_int_eq(errno, EINVAL);
+}
+END_TEST
+
+
 LOCAL_FN
 TCase* create_open_tcase(void)
 {
@@ -73,6 +440,12 @@ TCase* create_open_tcase(void)
 	tcase_add_checked_fixture(tc, setup, teardown);
 
 	tcase_add_test(tc, trunc_flag);
+	tcase_add_loop_test(tc, truncated_header, 0, 2);
+	tcase_add_test(tc, header_only);
+	tcase_add_test(tc, many_channels);
+	tcase_add_test(tc, find_channel);
+	tcase_add_test(tc, chconf_bulk);
+	tcase_add_loop_test(tc, custom_io, 0, 3);
 
 	return tc;
 }
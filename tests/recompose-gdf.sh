@@ -11,5 +11,24 @@ $EXECUTABLESRC/gdf-repair broken.gdf fixed.gdf
 # test fixed.gdf contains all the expected data
 $EXECUTABLETEST/check-fixed-gdf
 
+# repair broken.gdf in place and test it the same way
+$EXECUTABLESRC/gdf-repair -i broken.gdf
+$EXECUTABLETEST/check-fixed-gdf broken.gdf
+
+# same with a recording interrupted after a checkpoint
+$EXECUTABLETEST/gen-broken-gdf -c
+$EXECUTABLESRC/gdf-repair -i checkpointed.gdf
+$EXECUTABLETEST/check-fixed-gdf checkpointed.gdf
+
+# a completed file is left untouched, with its events
+cp fixed.gdf complete.gdf
+if $EXECUTABLESRC/gdf-repair -i complete.gdf; then
+	exit 1
+fi
+cmp fixed.gdf complete.gdf
+$EXECUTABLETEST/check-fixed-gdf complete.gdf
+
 # remove generated files
 rm broken.gdf broken.gdf.code broken.gdf.event
+rm checkpointed.gdf checkpointed.gdf.code checkpointed.gdf.event
+rm complete.gdf
@@ -6,5 +6,9 @@
 TCase* create_xdf_prepare_end_transfer_tcase(void);
 TCase* create_open_tcase(void);
 TCase* create_read_tcase(void);
+TCase* create_conv_lut_tcase(void);
+TCase* create_halffloat_tcase(void);
+TCase* create_clip_tcase(void);
+TCase* create_event_tcase(void);
 
 #endif /* TESTCASES_H */
@@ -12,6 +12,10 @@ api_test_suite(void)
     suite_add_tcase(s, create_xdf_prepare_end_transfer_tcase());
     suite_add_tcase(s, create_open_tcase());
     suite_add_tcase(s, create_read_tcase());
+    suite_add_tcase(s, create_conv_lut_tcase());
+    suite_add_tcase(s, create_halffloat_tcase());
+    suite_add_tcase(s, create_clip_tcase());
+    suite_add_tcase(s, create_event_tcase());
 
     return s;
 }
@@ -1,4 +1,6 @@
 #include <check.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -8,6 +10,8 @@
 #define TESTFILE_GDF SRCDIR"/ref128-13-97-50-11-7-1.gdf2"
 #define NCH 20
 #define NSAMPLE 1
+#define MANYCH_FILE "manych.gdf"
+#define NMANYCH 60000
 
 
 static struct xdf * xdf = NULL;
@@ -87,6 +91,96 @@ START_TEST(test_xdf_end_transfer)
 END_TEST
 
 
+START_TEST(test_xdf_transfer_cycles)
+{
+	int i, rv;
+	size_t stride[1] = {NCH * sizeof(double)};
+	double ref[NCH], buffer[NCH];
+	enum xdftype types[NCH];
+	int offsets[NCH], iarrays[NCH];
+
+	xdf = xdf_open(TESTFILE_GDF, XDF_READ, XDF_GDF2);
+	ck_assert(xdf != NULL);
+
+	for (i = 0; i < NCH; i++) {
+		types[i] = XDFDOUBLE;
+		offsets[i] = i * sizeof(double);
+		iarrays[i] = 0;
+	}
+	ck_assert(xdf_set_chconf_bulk(xdf, XDF_CF_ARRTYPE, NCH, types) == 0);
+	ck_assert(xdf_set_chconf_bulk(xdf, XDF_CF_ARROFFSET, NCH, offsets) == 0);
+	ck_assert(xdf_define_arrays(xdf, 1, stride) == 0);
+
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	ck_assert(xdf_read(xdf, 1, ref) == 1);
+	ck_assert(xdf_end_transfer(xdf) == 0);
+
+	// Unchanged configuration: each transfer restarts from the beginning
+	for (i = 0; i < 3; i++) {
+		ck_assert(xdf_prepare_transfer(xdf) == 0);
+		ck_assert(xdf_read(xdf, 1, buffer) == 1);
+		ck_assert(memcmp(ref, buffer, sizeof(ref)) == 0);
+		ck_assert(xdf_end_transfer(xdf) == 0);
+	}
+
+	// A channel configuration change must be taken into account
+	iarrays[0] = -1;
+	ck_assert(xdf_set_chconf_bulk(xdf, XDF_CF_ARRINDEX, NCH, iarrays) == 0);
+	buffer[0] = -12345.0;
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	rv = xdf_read(xdf, 1, buffer);
+	ck_assert(rv == 1);
+	ck_assert(buffer[0] == -12345.0);
+	ck_assert(memcmp(ref+1, buffer+1, sizeof(ref)-sizeof(ref[0])) == 0);
+
+	xdf_cleanup();
+}
+END_TEST
+
+
+/* The per channel transfer objects must not be limited by the stack size */
+START_TEST(test_xdf_prepare_many_channels)
+{
+	int i, rv;
+	size_t stride[1] = {NMANYCH * sizeof(int32_t)};
+	int32_t* data = malloc(NMANYCH * sizeof(*data));
+	int32_t* rdata = malloc(NMANYCH * sizeof(*rdata));
+	ck_assert(data != NULL && rdata != NULL);
+
+	for (i = 0; i < NMANYCH; i++)
+		data[i] = i - NMANYCH/2;
+
+	xdf = xdf_open(MANYCH_FILE, XDF_WRITE|XDF_TRUNC, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	rv = xdf_set_conf(xdf, XDF_F_SAMPLING_FREQ, 1,
+	                       XDF_CF_ARRTYPE, XDFINT32,
+	                       XDF_CF_STOTYPE, XDFINT32,
+	                       XDF_CF_ARRDIGITAL, 1,
+	                       XDF_NOF);
+	ck_assert(rv == 0);
+	for (i = 0; i < NMANYCH; i++)
+		ck_assert(xdf_add_channel(xdf, NULL) != NULL);
+
+	ck_assert(xdf_define_arrays(xdf, 1, stride) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	ck_assert(xdf_write(xdf, 1, data) == 1);
+	xdf_cleanup();
+
+	xdf = xdf_open(MANYCH_FILE, XDF_READ, XDF_GDF2);
+	ck_assert(xdf != NULL);
+	ck_assert(xdf_define_arrays(xdf, 1, stride) == 0);
+	ck_assert(xdf_prepare_transfer(xdf) == 0);
+	ck_assert(xdf_read(xdf, 1, rdata) == 1);
+	ck_assert(memcmp(data, rdata, NMANYCH * sizeof(*data)) == 0);
+
+	xdf_cleanup();
+	remove(MANYCH_FILE);
+	free(data);
+	free(rdata);
+}
+END_TEST
+
+
 TCase* create_xdf_prepare_end_transfer_tcase(void)
 {
 	TCase * tc = tcase_create("xdf-prepare-end-transfer");
@@ -95,6 +189,8 @@ TCase* create_xdf_prepare_end_transfer_tcase(void)
 
 	tcase_add_test(tc, test_xdf_prepare_transfer);
 	tcase_add_test(tc, test_xdf_end_transfer);
+	tcase_add_test(tc, test_xdf_transfer_cycles);
+	tcase_add_test(tc, test_xdf_prepare_many_channels);
 
 	return tc;
 }